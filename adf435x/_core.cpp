@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// This file is part of the adf435x project.
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Python binding of libadf435x for arrays of frequencies, there is no register
+// calculation of its own: freq_make_regs() (MHz) and solve_regs() (Hz) call
+// adf435x_solve_n(), decode_stream() the register stream decoder.
+//
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "adf435x.h"
+
+
+// array.array( typecode, bytes of data )
+static PyObject *newArray( const char *typecode, const void *data, size_t bytes ) {
+    PyObject *arrayModule = PyImport_ImportModule( "array" );
+    if ( !arrayModule )
+        return nullptr;
+    PyObject *b = PyBytes_FromStringAndSize( static_cast< const char * >( data ), bytes );
+    PyObject *result = b ? PyObject_CallMethod( arrayModule, "array", "sO", typecode, b ) : nullptr;
+    Py_XDECREF( b );
+    Py_DECREF( arrayModule );
+    return result;
+}
+
+
+// DeviceType.ADF4351 == 1, everything else is handled as ADF4350 like in core.py (ADF4350 is the tuple (0,))
+static bool deviceOf( PyObject *deviceType, uint8_t &device ) {
+    device = ADF435X_ADF4351;
+    if ( !deviceType )
+        return true;
+    PyObject *one = PyLong_FromLong( 1 );
+    int eq = PyObject_RichCompareBool( deviceType, one, Py_EQ );
+    Py_DECREF( one );
+    if ( eq < 0 )
+        return false;
+    device = eq ? ADF435X_ADF4351 : ADF435X_ADF4350;
+    return true;
+}
+
+
+// adf435x_solve_n() without the GIL, returns the number of frequencies done
+static size_t solveAll( const adf435x_config &cfg, const adf435x_params &base, const std::vector< uint64_t > &hz,
+                        std::vector< uint32_t > &regs, int &err ) {
+    regs.resize( 6 * hz.size() );
+    size_t done;
+    Py_BEGIN_ALLOW_THREADS;
+    done = adf435x_solve_n( &cfg, &base, hz.data(), hz.size(), regs.data(), &err );
+    Py_END_ALLOW_THREADS;
+    return done;
+}
+
+
+// freq_make_regs() for frequencies in MHz: libadf435x rounded to the nearest FRAC with MOD = PFD / 1 kHz,
+// the same as the float calculation of calculate_regs(), and the fields of make_regs( mux_out=DigitalLockDetect ),
+// the frequency goes in as 1/65536 Hz, rounding to Hz before the RF divider would move FRAC
+static PyObject *freq_make_regs( PyObject *, PyObject *args, PyObject *kwargs ) {
+    static const char *keywords[] = { "freqs",    "device_type",     "ref_freq",
+                                      "r_counter", "ref_doubler",     "ref_div2",
+                                      "feedback_select", "band_select_clock_mode", nullptr };
+    PyObject *freqs, *deviceType = nullptr;
+    double refFreq = 25.0;
+    int rCounter = 250, refDoubler = 0, refDiv2 = 0, feedbackSelect = 1, bandSelClkMode = 0;
+    if ( !PyArg_ParseTupleAndKeywords( args, kwargs, "O|$Odippii", const_cast< char ** >( keywords ), &freqs,
+                                       &deviceType, &refFreq, &rCounter, &refDoubler, &refDiv2, &feedbackSelect,
+                                       &bandSelClkMode ) )
+        return nullptr;
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    if ( !deviceOf( deviceType, cfg.device ) )
+        return nullptr;
+    const double refHz = std::nearbyint( refFreq * 1e6 );
+    if ( rCounter < 1 || rCounter > 1023 || !( refHz >= 1 && refHz <= UINT32_MAX ) ) {
+        PyErr_SetString( PyExc_ValueError, adf435x_strerror( ADF435X_ERR_PARAM ) );
+        return nullptr;
+    }
+    cfg.ref_hz = uint32_t( refHz );
+    cfg.r_counter = rCounter;
+    cfg.channel_hz = 1000; // MOD = round( 1000.0 * pfd_freq ) with the PFD in MHz
+    cfg.flags = ADF435X_CFG_NEAREST | ADF435X_CFG_FREQ_Q16 | ( refDoubler ? ADF435X_CFG_REF_DOUBLER : 0 ) |
+                ( refDiv2 ? ADF435X_CFG_REF_DIV2 : 0 ) | ( feedbackSelect == 1 ? 0 : ADF435X_CFG_FEEDBACK_DIVIDED ) |
+                ( bandSelClkMode == 1 ? ADF435X_CFG_BAND_SELECT_HIGH : 0 );
+    adf435x_params base; // make_regs() defaults
+    adf435x_params_default( &base );
+    base.double_buffer = 0;
+    base.mtld = 0;
+
+    // input as contiguous doubles (array('d'), numpy.float64, ...) or any sequence of numbers
+    std::vector< double > values;
+    PyObject *seq = nullptr;
+    Py_buffer view;
+    if ( PyObject_CheckBuffer( freqs ) && PyObject_GetBuffer( freqs, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS ) == 0 ) {
+        bool isDouble = view.format && ( !strcmp( view.format, "d" ) || !strcmp( view.format, "<d" ) ||
+                                         !strcmp( view.format, "=d" ) || !strcmp( view.format, "@d" ) );
+        if ( isDouble && view.itemsize == sizeof( double ) ) {
+            const double *d = static_cast< const double * >( view.buf );
+            values.assign( d, d + view.len / sizeof( double ) );
+        }
+        PyBuffer_Release( &view );
+        if ( !isDouble )
+            seq = PySequence_Fast( freqs, "freqs must be a sequence of numbers" );
+    } else {
+        PyErr_Clear();
+        seq = PySequence_Fast( freqs, "freqs must be a sequence of numbers" );
+    }
+    if ( seq ) {
+        Py_ssize_t n = PySequence_Fast_GET_SIZE( seq );
+        values.resize( n );
+        for ( Py_ssize_t iii = 0; iii < n; ++iii ) {
+            values[ iii ] = PyFloat_AsDouble( PySequence_Fast_GET_ITEM( seq, iii ) );
+            if ( values[ iii ] == -1.0 && PyErr_Occurred() ) {
+                Py_DECREF( seq );
+                return nullptr;
+            }
+        }
+        Py_DECREF( seq );
+    } else if ( PyErr_Occurred() )
+        return nullptr;
+
+    // 1/65536 Hz, values that do not fit (also nan) are out of range for the solver
+    const size_t n = values.size();
+    std::vector< uint64_t > hz( n );
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        const double f = std::nearbyint( values[ iii ] * 1e6 * 65536 );
+        hz[ iii ] = f >= 0 && f < 1e19 ? uint64_t( f ) : UINT64_MAX;
+    }
+    std::vector< uint32_t > regs;
+    int err;
+    const size_t done = solveAll( cfg, base, hz, regs, err );
+    if ( done < n ) {
+        PyObject *freq = PyFloat_FromDouble( values[ done ] );
+        if ( freq ) {
+            PyErr_Format( PyExc_ValueError, "freq = %R MHz: %s", freq, adf435x_strerror( err ) );
+            Py_DECREF( freq );
+        }
+        return nullptr;
+    }
+    return newArray( "I", regs.data(), regs.size() * sizeof( uint32_t ) );
+}
+
+
+static PyObject *solve_regs( PyObject *, PyObject *args, PyObject *kwargs ) {
+    static const char *keywords[] = { "freqs",          "device_type", "ref_freq",       "r_counter",
+                                      "ref_doubler",    "ref_div2",    "feedback_select", "band_select_clock_mode",
+                                      "channel",        "nearest",     nullptr };
+    PyObject *freqs, *deviceType = nullptr;
+    unsigned long refFreq = 25000000, channel = 1000;
+    int rCounter = 250, refDoubler = 0, refDiv2 = 0, feedbackSelect = 1,
+        bandSelClkMode = 0, nearest = 1;
+    if ( !PyArg_ParseTupleAndKeywords( args, kwargs, "O|$Okippiikp", const_cast< char ** >( keywords ), &freqs,
+                                       &deviceType, &refFreq, &rCounter, &refDoubler, &refDiv2, &feedbackSelect,
+                                       &bandSelClkMode, &channel, &nearest ) )
+        return nullptr;
+    if ( rCounter < 1 || rCounter > 1023 || !refFreq || refFreq > UINT32_MAX || !channel || channel > UINT32_MAX ) {
+        PyErr_SetString( PyExc_ValueError, adf435x_strerror( ADF435X_ERR_PARAM ) );
+        return nullptr;
+    }
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    if ( !deviceOf( deviceType, cfg.device ) )
+        return nullptr;
+    cfg.ref_hz = refFreq;
+    cfg.r_counter = rCounter;
+    cfg.channel_hz = channel;
+    cfg.flags = ( refDoubler ? ADF435X_CFG_REF_DOUBLER : 0 ) | ( refDiv2 ? ADF435X_CFG_REF_DIV2 : 0 ) |
+                ( feedbackSelect == 1 ? 0 : ADF435X_CFG_FEEDBACK_DIVIDED ) |
+                ( bandSelClkMode == 1 ? ADF435X_CFG_BAND_SELECT_HIGH : 0 ) | ( nearest ? ADF435X_CFG_NEAREST : 0 );
+    adf435x_params base;
+    adf435x_params_default( &base );
+
+    // integer frequencies in Hz
+    PyObject *seq = PySequence_Fast( freqs, "freqs must be a sequence of integers" );
+    if ( !seq )
+        return nullptr;
+    const size_t n = PySequence_Fast_GET_SIZE( seq );
+    std::vector< uint64_t > values( n );
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        values[ iii ] = PyLong_AsUnsignedLongLong( PySequence_Fast_GET_ITEM( seq, iii ) );
+        if ( PyErr_Occurred() ) {
+            Py_DECREF( seq );
+            return nullptr;
+        }
+    }
+    Py_DECREF( seq );
+
+    std::vector< uint32_t > regs;
+    int err;
+    const size_t done = solveAll( cfg, base, values, regs, err );
+    if ( done < n ) {
+        PyErr_Format( PyExc_ValueError, "freq = %llu Hz: %s", (unsigned long long)values[ done ],
+                      adf435x_strerror( err ) );
+        return nullptr;
+    }
+    return newArray( "I", regs.data(), regs.size() * sizeof( uint32_t ) );
+}
+
+
+// unsigned 32 bit words of a sequence, false with an exception set
+static bool toWords( PyObject *obj, const char *message, std::vector< uint32_t > &words ) {
+    PyObject *seq = PySequence_Fast( obj, message );
+    if ( !seq )
+        return false;
+    const size_t n = PySequence_Fast_GET_SIZE( seq );
+    words.resize( n );
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        unsigned long value = PyLong_AsUnsignedLong( PySequence_Fast_GET_ITEM( seq, iii ) );
+        if ( PyErr_Occurred() || value > UINT32_MAX ) {
+            if ( !PyErr_Occurred() )
+                PyErr_SetString( PyExc_OverflowError, "register word does not fit into 32 bit" );
+            Py_DECREF( seq );
+            return false;
+        }
+        words[ iii ] = value;
+    }
+    Py_DECREF( seq );
+    return true;
+}
+
+
+static PyObject *decode_stream( PyObject *, PyObject *args, PyObject *kwargs ) {
+    static const char *keywords[] = { "words", "ref_freq", "regs", nullptr };
+    PyObject *wordsObj, *regsObj = Py_None;
+    unsigned long refFreq = 25000000;
+    if ( !PyArg_ParseTupleAndKeywords( args, kwargs, "O|$kO", const_cast< char ** >( keywords ), &wordsObj, &refFreq,
+                                       &regsObj ) )
+        return nullptr;
+    if ( !refFreq || refFreq > UINT32_MAX ) {
+        PyErr_SetString( PyExc_ValueError, adf435x_strerror( ADF435X_ERR_PARAM ) );
+        return nullptr;
+    }
+    std::vector< uint32_t > regs;
+    if ( regsObj != Py_None ) {
+        if ( !toWords( regsObj, "regs must be a sequence of 6 integers", regs ) )
+            return nullptr;
+        if ( regs.size() != 6 ) {
+            PyErr_SetString( PyExc_ValueError, "regs must be a sequence of 6 integers" );
+            return nullptr;
+        }
+    }
+    std::vector< uint32_t > words;
+    if ( !toWords( wordsObj, "words must be a sequence of integers", words ) )
+        return nullptr;
+
+    std::vector< double > rf( words.size() );
+    adf435x_stream stream;
+    Py_BEGIN_ALLOW_THREADS;
+    adf435x_stream_init( &stream, refFreq, regs.empty() ? nullptr : regs.data() );
+    adf435x_decode_stream( &stream, words.data(), words.size(), rf.data() );
+    Py_END_ALLOW_THREADS;
+    return newArray( "d", rf.data(), rf.size() * sizeof( double ) );
+}
+
+
+static PyMethodDef methods[] = {
+    { "freq_make_regs", reinterpret_cast< PyCFunction >( reinterpret_cast< void ( * )( void ) >( freq_make_regs ) ),
+      METH_VARARGS | METH_KEYWORDS,
+      "freq_make_regs(freqs, *, device_type=1, ref_freq=25.0, r_counter=250, ref_doubler=False, ref_div2=False,\n"
+      "               feedback_select=1, band_select_clock_mode=0)\n"
+      "--\n\n"
+      "Register words R0..R5 for all frequencies (MHz) as array('I') of 6 * len(freqs) words,\n"
+      "libadf435x with MOD = PFD / 1 kHz and the nearest FRAC, ref_freq in MHz." },
+    { "solve_regs", reinterpret_cast< PyCFunction >( reinterpret_cast< void ( * )( void ) >( solve_regs ) ),
+      METH_VARARGS | METH_KEYWORDS,
+      "solve_regs(freqs, *, device_type=1, ref_freq=25000000, r_counter=250, ref_doubler=False, ref_div2=False,\n"
+      "           feedback_select=1, band_select_clock_mode=0, channel=1000, nearest=True)\n"
+      "--\n\n"
+      "Register words R0..R5 for all integer frequencies (Hz) as array('I') of 6 * len(freqs) words,\n"
+      "exact integer solution of libadf435x, ref_freq and channel in Hz." },
+    { "decode_stream", reinterpret_cast< PyCFunction >( reinterpret_cast< void ( * )( void ) >( decode_stream ) ),
+      METH_VARARGS | METH_KEYWORDS,
+      "decode_stream(words, *, ref_freq=25000000, regs=None)\n"
+      "--\n\n"
+      "RF output frequency (Hz) after every register word as array('d'), nan while the registers are\n"
+      "invalid, 0.0 while the output is off. regs: R0..R5 before the stream, None: all fields 0.\n"
+      "Double buffered fields take effect with the next R0 write like in the chip." },
+    { nullptr, nullptr, 0, nullptr } };
+
+
+static struct PyModuleDef module = { PyModuleDef_HEAD_INIT, "_core", "Compiled ADF435x register calculation", -1,
+                                     methods };
+
+
+PyMODINIT_FUNC PyInit__core( void ) { return PyModule_Create( &module ); }
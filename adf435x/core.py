@@ -22,6 +22,11 @@
 
 from math import ceil, floor, log
 
+try:
+    from adf435x import _core
+except ImportError:
+    _core = None
+
 
 class DeviceType:
     ADF4350 = 0,
@@ -303,10 +308,37 @@ def make_regs(
 
 def freq_make_regs(freq):
     'prepare register values'
-    INT, MOD, FRAC, output_divider, band_select_clock_divider = \
-            calculate_regs(freq=freq)
-    return make_regs(INT=INT, MOD=MOD, FRAC=FRAC,
-            output_divider=output_divider,
-            band_select_clock_divider=band_select_clock_divider,
-            mux_out=MuxOut.DigitalLockDetect
-    )
+    return list(freq_make_regs_array([freq]))
+
+
+def _lib():
+    'compiled libadf435x binding'
+    if _core is None:
+        raise ImportError('adf435x._core is not built, run "python3 setup.py build_ext --inplace"')
+    return _core
+
+
+def freq_make_regs_array(freqs, **kwargs):
+    """register values R0..R5 for all frequencies in MHz as array('I') of 6 * len(freqs) words,
+    libadf435x with MOD = PFD / 1 kHz and the nearest FRAC like calculate_regs() and the
+    fields of make_regs(mux_out=MuxOut.DigitalLockDetect), LDF and LDP follow INT/FRAC mode.
+    kwargs: device_type, ref_freq (MHz), r_counter, ref_doubler, ref_div2, feedback_select,
+    band_select_clock_mode"""
+    return _lib().freq_make_regs(freqs, **kwargs)
+
+
+def solve_regs_array(freqs, **kwargs):
+    """register values R0..R5 for integer frequencies in Hz as array('I') of 6 * len(freqs) words,
+    exact integer solution of libadf435x (adf4351-eval, adf435xgui),
+    kwargs: device_type, ref_freq (Hz), r_counter, ref_doubler, ref_div2, feedback_select,
+    band_select_clock_mode, channel (Hz, MOD = PFD / channel) and nearest (round FRAC, else truncate)"""
+    return _lib().solve_regs(freqs, **kwargs)
+
+
+def decode_stream_array(words, ref_freq=25000000, regs=None):
+    """RF output frequency in Hz after every register word of a recorded stream as array('d'),
+    nan while the registers are invalid (R counter 0), 0.0 while the output is off,
+    regs: R0..R5 before the stream (None: all fields 0). MOD, phase, R counter, doubler,
+    divide-by-2, charge pump current and (double buffered) RF divider wait for the next R0 write,
+    adf435x_decode_stream() of libadf435x"""
+    return _lib().decode_stream(words, ref_freq=ref_freq, regs=regs)
@@ -24,6 +24,7 @@ import struct
 import usb.core
 import serial
 import time
+import zlib
 
 
 logger = logging.getLogger(__name__)
@@ -39,6 +40,36 @@ USB_REQ_LIBFX2_PAGE_SIZE   = 0xB0
 USB_REQ_SET_REG = 0xDD # send one 32bit register
 USB_REQ_EE_REGS = 0xDE # store or clear default setting in EEPROM
 USB_REQ_GET_MUX = 0xDF # get status of the MUX pin
+USB_REQ_GET_EVENTS = 0xE0 # read the lock event log
+USB_REQ_CRC32 = 0xE1 # CRC32 of an EEPROM or XRAM range
+CRC32_XRAM = 0x8000 # USB_REQ_CRC32 wIndex flag
+USB_REQ_GET_STATE = 0xE2 # registers, init type, lock status and counters
+USB_REQ_GET_CLOCK = 0xE3 # timer ticks at the next USB (micro)frame start, FW 0.4.5
+USB_REQ_COUNT_MUX = 0xE4 # count MUXOUT edges in a gate time, FW 0.4.6
+USB_REQ_SUPERVISOR = 0xE5 # configure or read the lock supervisor, FW 0.4.7
+EP_STATUS = 0x81 # interrupt IN endpoint with status messages, FW 0.4.4
+
+# status message flags
+STATUS_MUX = 0x01 # MUXOUT changed
+STATUS_DONE = 0x02 # OUT request done
+STATUS_RELOCK = 0x04 # the lock supervisor rewrote R0, FW 0.4.7
+EESIZE = 8192 # 24LC64 on the eval board
+
+# lock event types
+EVENT_UNLOCK = 0
+EVENT_LOCK = 1
+EVENT_R0 = 2
+EVENT_RELOCK = 3 # lock supervisor rewrites R0, an EVENT_R0 follows, FW 0.4.7
+EVENT_TICK_US = 0.25 # FX2 timer 2 at CLKOUT/12
+
+# lock supervisor state, FW 0.4.7
+SV_OFF = 0
+SV_ACTIVE = 1
+SV_UNSUPERVISED = 2 # MUXOUT is not digital lock detect, not supervisable
+
+# USB frame numbers of the FW count microframes: frame << 3 | microframe
+FRAME_NS = 125000
+FRAME_WRAP = 1 << 14 # 2.048 s
 
 # init type
 INIT_NEVER = 0
@@ -86,6 +117,93 @@ class FX2:
         return self.dev.ctrl_transfer(
             bmRequestType=0xC0, bRequest=USB_REQ_GET_MUX, wValue=0, wIndex=0, data_or_wLength=1 )
 
+    def get_lock_events( self, frames=False ):
+        '''drain the lock event log, return ( lost, [ ( type, hop, ticks ), ... ] )
+        ticks are relative to the last R0 write, see EVENT_TICK_US
+        frames=True adds the USB frame number of the event: ( type, hop, ticks, frame ), FW 0.4.5'''
+        if not self.dev:
+            return None
+        lost = 0
+        events = []
+        while True:
+            data = self.dev.ctrl_transfer(
+                bmRequestType=0xC0, bRequest=USB_REQ_GET_EVENTS, wValue=0, wIndex=0, data_or_wLength=64 )
+            num, lost_now = data[0], data[1]
+            lost += lost_now
+            for pos in range( 2, 2 + 8 * num, 8 ):
+                typ, hop, frame, ticks = struct.unpack_from( '<BBHI', data, pos )
+                events.append( ( typ, hop, ticks, frame ) if frames else ( typ, hop, ticks ) )
+            if num == 0:
+                return lost, events
+
+    def get_state( self ):
+        '''device state in one transfer, requires FW 0.4.3, dict with
+        'regs': [ R0, ..., R5 ] as last written, 'written': bit n set if Rn was written since power-on,
+        'init_type', 'mux', 'events' (entries in the lock event log),
+        'reg_writes', 'r0_writes' (since power-on), 'ticks' (see EVENT_TICK_US)'''
+        if not self.dev:
+            return None
+        data = self.dev.ctrl_transfer(
+            bmRequestType=0xC0, bRequest=USB_REQ_GET_STATE, wValue=0, wIndex=0, data_or_wLength=40 )
+        fields = struct.unpack( '<6IBBBBIII', data )
+        return { 'regs': list( fields[ 0:6 ] ), 'init_type': fields[ 6 ], 'mux': fields[ 7 ], 'written': fields[ 8 ],
+                 'events': fields[ 9 ], 'reg_writes': fields[ 10 ], 'r0_writes': fields[ 11 ], 'ticks': fields[ 12 ] }
+
+    def get_status( self, timeout=1000 ):
+        '''wait for the next status message of the interrupt endpoint (FW 0.4.4), None after timeout ms
+        dict with 'flags' (STATUS_MUX, STATUS_DONE), 'mux', 'request' (last OUT request done),
+        'hop' (R0 counter), 'ticks' (see EVENT_TICK_US)'''
+        if not self.dev:
+            return None
+        try:
+            data = self.dev.read( EP_STATUS, 8, timeout=timeout )
+        except usb.core.USBTimeoutError:
+            return None
+        flags, mux, request, hop, ticks = struct.unpack( '<BBBBI', data )
+        return { 'flags': flags, 'mux': mux, 'request': request, 'hop': hop, 'ticks': ticks }
+
+    def get_clock( self ):
+        '''wait for the next USB (micro)frame start in the FW (0.4.5), return ( ticks, frame, wait ):
+        the timer at the frame start, its frame number (see FRAME_NS) and the ticks the FW waited for it'''
+        if not self.dev:
+            return None
+        data = self.dev.ctrl_transfer(
+            bmRequestType=0xC0, bRequest=USB_REQ_GET_CLOCK, wValue=0, wIndex=0, data_or_wLength=8 )
+        return struct.unpack( '<IHH', data )
+
+    def count_mux( self, gate_ms=100 ):
+        '''frequency of MUXOUT in Hz counted by the FW (0.4.6) for gate_ms (1 .. 1000),
+        set MUXOUT to the R counter or N divider output before, both run at the PFD frequency'''
+        if not self.dev:
+            return None
+        data = self.dev.ctrl_transfer(
+            bmRequestType=0xC0, bRequest=USB_REQ_COUNT_MUX, wValue=gate_ms, wIndex=0, data_or_wLength=8,
+            timeout=gate_ms + 1000 )
+        edges, ticks = struct.unpack( '<II', data )
+        return edges * 4e6 / ticks if ticks else 0.0
+
+    def set_supervisor( self, unlock_us, retry_max=0 ):
+        '''lock supervisor (FW 0.4.7): with MUXOUT = digital lock detect the FW rewrites R0 when the lock
+        is lost for more than unlock_us (1 .. 65535, 0 = off), up to retry_max times (0 = no limit)
+        until the next lock; set_startup() stores the setting in EEPROM'''
+        if not self.dev:
+            return None
+        self.dev.ctrl_transfer(
+            bmRequestType=0x40, bRequest=USB_REQ_SUPERVISOR, wValue=unlock_us, wIndex=retry_max, data_or_wLength=None )
+
+    def get_supervisor( self ):
+        '''lock supervisor setting and counters (FW 0.4.7), dict with 'unlock_us', 'retry_max',
+        'retries' (rewrites since the last lock), 'losses' (unlocks without R0 write), 'relocks' (R0 rewrites),
+        'recovered' (locks after a rewrite), 'ticks' (timer at the last rewrite, see EVENT_TICK_US)
+        and 'state' (SV_OFF, SV_ACTIVE, SV_UNSUPERVISED: MUXOUT is not digital lock detect)'''
+        if not self.dev:
+            return None
+        data = self.dev.ctrl_transfer(
+            bmRequestType=0xC0, bRequest=USB_REQ_SUPERVISOR, wValue=0, wIndex=0, data_or_wLength=21 )
+        fields = struct.unpack( '<HBBIIIIB', data )
+        return dict( zip( ( 'unlock_us', 'retry_max', 'retries', 'losses', 'relocks', 'recovered', 'ticks', 'state' ),
+                          fields ) )
+
     def get_eeprom( self, addr=8160, size=32 ):
         'read part of EEPROM content, default is the register set'
         if not self.dev:
@@ -100,6 +218,28 @@ class FX2:
         self.dev.ctrl_transfer(
             bmRequestType=0x40, bRequest=USB_REQ_CYPRESS_EEPROM_DB, wValue=addr, wIndex=0, data_or_wLength=data )
 
+    def get_crc32( self, addr=0, size=EESIZE, xram=False ):
+        'CRC32 (as zlib.crc32) of an EEPROM or XRAM range calculated by the FW, requires FW 0.4.2'
+        if not self.dev:
+            return None
+        data = self.dev.ctrl_transfer(
+            bmRequestType=0xC0, bRequest=USB_REQ_CRC32, wValue=addr, wIndex=size | ( CRC32_XRAM if xram else 0 ),
+            data_or_wLength=4, timeout=5000 )
+        return struct.unpack( '<I', data )[0]
+
+    def program_eeprom( self, data, addr=0, block=4096, skip_same=False ):
+        '''write an image into the EEPROM and verify it with the CRC32 of the FW (0.4.2 or later)
+        skip_same: the FW reads every page first and skips unchanged ones (FW 0.4.8 or later),
+        faster for an image that is mostly there already, slower for a new one
+        return True if the CRC matches'''
+        if not self.dev:
+            return None
+        for pos in range( 0, len( data ), block ):
+            self.dev.ctrl_transfer(
+                bmRequestType=0x40, bRequest=USB_REQ_CYPRESS_EEPROM_DB, wValue=addr + pos, wIndex=int( skip_same ),
+                data_or_wLength=data[ pos : pos + block ], timeout=30000 )
+        return self.get_crc32( addr, len( data ) ) == zlib.crc32( bytes( data ) )
+
     def get_xram( self, addr=0x3e00, size=32 ):
         'read part of XRAM content, default is the register set'
         if not self.dev:
@@ -146,6 +286,129 @@ class FX2:
         return None
 
 
+class ClockSync:
+    '''Map FX2 timer ticks and USB frame numbers to the host clock time.monotonic_ns() (CLOCK_MONOTONIC).
+    Every sample waits in the FW for the next start of (micro)frame, the SOF of the host controller,
+    and latches the timer; the host brackets the request with its clock, the SOF lies between
+    the start of the request plus the FW wait and the end of the request.
+    Weighted least squares over the samples give host ns per frame and timer ticks per frame,
+    i.e. the drift of the host clock and of the FX2 crystal against the USB bus.
+    The frame numbers wrap after 2.048 s, so sample at least every second.'''
+    def __init__( self, intf, window=256 ):
+        self.intf = intf
+        self.window = window # samples kept for the fit
+        self.samples = [] # ( frame, ticks, lo_ns, hi_ns ), frame and ticks unwrapped
+        self.full_speed = True # no microframes seen
+        self.ns_per_frame = FRAME_NS
+        self.ticks_per_frame = FRAME_NS / 1000 / EVENT_TICK_US
+        self.offset_ns = 0 # host time of frame 0
+        self.rms_ns = 0
+        self._last = None # raw frame, raw ticks, host time, unwrapped frame and ticks of the last sample
+
+    def sample( self, count=16, interval=0.005 ):
+        'take count samples and update the fit'
+        for _ in range( count ):
+            t0 = time.monotonic_ns()
+            ticks, frame, wait = self.intf.get_clock()
+            t1 = time.monotonic_ns()
+            self.full_speed &= frame & 7 == 0
+            if self._last is None:
+                frame_ext, ticks_ext = frame, ticks
+            else:
+                raw_frame, raw_ticks, host, last_frame, last_ticks = self._last
+                elapsed = t1 - host
+                frame_ext = last_frame + self._unwrap( frame - raw_frame, elapsed / FRAME_NS, FRAME_WRAP )
+                ticks_ext = last_ticks + self._unwrap( ticks - raw_ticks, elapsed / 1000 / EVENT_TICK_US, 1 << 32 )
+            self._last = ( frame, ticks, t1, frame_ext, ticks_ext )
+            self.samples.append( ( frame_ext, ticks_ext, t0 + round( wait * EVENT_TICK_US * 1000 ), t1 ) )
+            if interval:
+                time.sleep( interval )
+        del self.samples[ : -self.window ]
+        self._fit()
+
+    @staticmethod
+    def _unwrap( delta, expected, wrap ):
+        'counter difference with the wraps the elapsed host time says'
+        delta %= wrap
+        return delta + max( 0, round( ( expected - delta ) / wrap ) ) * wrap
+
+    @staticmethod
+    def _linfit( x, y, w ):
+        'weighted least squares y = a + b * x, return ( a, b )'
+        sw = sum( w )
+        mx = sum( wi * xi for xi, wi in zip( x, w ) ) / sw
+        my = sum( wi * yi for yi, wi in zip( y, w ) ) / sw
+        sxx = sum( wi * ( xi - mx ) ** 2 for xi, wi in zip( x, w ) )
+        sxy = sum( wi * ( xi - mx ) * ( yi - my ) for xi, yi, wi in zip( x, y, w ) )
+        b = sxy / sxx if sxx else 0
+        return my - b * mx, b
+
+    def _fit( self ):
+        if len( { s[ 0 ] for s in self.samples } ) < 2:
+            return
+        x0 = self.samples[ 0 ][ 0 ]
+        x = [ s[ 0 ] - x0 for s in self.samples ]
+        mid = [ ( s[ 2 ] + s[ 3 ] ) / 2 for s in self.samples ]
+        w = [ 1 / max( s[ 3 ] - s[ 2 ], 1000 ) ** 2 for s in self.samples ] # narrow brackets count more
+        a, self.ns_per_frame = self._linfit( x, mid, w )
+        self.offset_ns = a - self.ns_per_frame * x0
+        _, self.ticks_per_frame = self._linfit( x, [ s[ 1 ] for s in self.samples ], [ 1 ] * len( x ) )
+        self.rms_ns = ( sum( ( m - a - self.ns_per_frame * xi ) ** 2 for xi, m in zip( x, mid ) ) / len( x ) ) ** 0.5
+
+    def host_drift_ppm( self ):
+        'host clock against the USB bus'
+        return ( self.ns_per_frame / FRAME_NS - 1 ) * 1e6
+
+    def device_drift_ppm( self ):
+        'FX2 crystal against the USB bus'
+        return ( self.ticks_per_frame * EVENT_TICK_US * 1000 / FRAME_NS - 1 ) * 1e6
+
+    def tick_ns( self ):
+        'length of a timer tick in host ns'
+        return self.ns_per_frame / self.ticks_per_frame
+
+    def frame_ns( self, frame ):
+        'host time of the start of an unwrapped frame'
+        return self.offset_ns + self.ns_per_frame * frame
+
+    def unwrap_frame( self, frame ):
+        'unwrapped number of a frame seen up to 2.048 s before the last sample'
+        last_raw, last_ext = self._last[ 0 ], self._last[ 3 ]
+        return last_ext - ( last_raw - frame ) % FRAME_WRAP
+
+    def place_events( self, events ):
+        '''host times of lock events ( type, hop, ticks, frame ) read with get_lock_events( frames=True )
+        before the last sample, return [ ( ns, uncertainty_ns ), ... ]
+        An event lies in its (micro)frame, all events after an R0 are that R0 plus their ticks,
+        the intersection of their frames narrows the time of the R0 and so of every event.'''
+        length = ( 8 if self.full_speed else 1 ) * self.ns_per_frame
+        tick = self.tick_ns()
+        placed = []
+        group = [] # ( index, ns after the R0, frame start ns )
+
+        def solve():
+            lo = max( start - d for _, d, start in group )
+            hi = min( start + length - d for _, d, start in group )
+            if lo > hi: # the polled timestamps are a few us late
+                lo = hi = sum( start + length / 2 - d for _, d, start in group ) / len( group )
+            for index, d, _ in group:
+                placed[ index ] = ( ( lo + hi ) / 2 + d, ( hi - lo ) / 2 )
+
+        hop = None
+        for index, ( typ, ev_hop, ticks, frame ) in enumerate( events ):
+            start = self.frame_ns( self.unwrap_frame( frame ) )
+            placed.append( ( start + length / 2, length / 2 ) )
+            if typ == EVENT_R0:
+                if group:
+                    solve()
+                group, hop = [ ( index, 0, start ) ], ev_hop
+            elif group and ev_hop == hop:
+                group.append( ( index, ticks * tick, start ) )
+        if group:
+            solve()
+        return placed
+
+
 class FX2_FX2LIB:
     '''The old fx2lib based FW (fx2.fx2lib) supports only "__init__()" and "set_regs()".'''
     def __init__(self):
@@ -232,21 +495,72 @@ class BusPirate:
 class tinyADF:
     '''This interface communicates via usb serial port to a ATtiny85
     that translates the command in native three wire DAT, CLK, LE.
-    Tested, but very slow transfer (need ~100 ms delay per register).'''
-
-    def __init__( self, device='/dev/ttyACM0' ):
-        'init the serial communication to /dev/ttyACM0'
+    Tested, but very slow transfer (need ~100 ms delay per register).
+    With binary=True all registers are sent in one acknowledged frame.'''
+
+    FRAME_EXIT = 0x00
+    FRAME_REGS = 0x02
+    FRAME_MUX = 0x03
+    FRAME_CRC = 0x80
+    MUX_UNKNOWN = 0xFF # mux reply of a board without mux pin
+    ACK = 0x06
+
+    def __init__( self, device='/dev/ttyACM0', binary=False, crc=False ):
+        'init the serial communication to /dev/ttyACM0, optional binary frame mode'
         # print( 'tinyADF.__init__()' )
         self.ADF=serial.Serial( device, timeout=0 )
+        self.binary = False
+        self.crc = crc
+        if binary:
+            self.ADF.timeout = 0.2
+            self.ADF.write( b'X' ) # enter binary mode, answered by ACK after the echo
+            while True:
+                c = self.ADF.read()
+                if not c:
+                    logger.warning( 'tinyADF: no binary mode, using ASCII' )
+                    self.ADF.timeout = 0
+                    break
+                if c[0] == self.ACK:
+                    self.binary = True
+                    break
 
     def __del__( self ):
         'Close the device when last instance is deleted'
         # print( 'tinyADF.__del__()' )
+        if self.binary:
+            self._frame( self.FRAME_EXIT )
         self.ADF.close()
 
+    @staticmethod
+    def _crc8( data ):
+        'CRC-8 with polynomial 0x07, same as the firmware'
+        crc = 0
+        for b in data:
+            crc ^= b
+            for _ in range( 8 ):
+                crc = ( ( crc << 1 ) ^ 0x07 ) & 0xFF if crc & 0x80 else ( crc << 1 ) & 0xFF
+        return crc
+
+    def _frame( self, typ, payload=b'', reply=0 ):
+        'send a binary frame [len][type][payload][crc], return the reply bytes or None if not acknowledged'
+        if self.crc:
+            typ |= self.FRAME_CRC
+        frame = bytes( [ 1 + len( payload ) + ( 1 if self.crc else 0 ), typ ] ) + payload
+        if self.crc:
+            frame += bytes( [ self._crc8( frame ) ] )
+        self.ADF.write( frame )
+        answer = self.ADF.read( 1 + reply )
+        if len( answer ) != 1 + reply or answer[0] != self.ACK:
+            logger.error( f'tinyADF: frame 0x{typ:02X} not acknowledged' )
+            return None
+        return answer[1:]
+
     def set_regs(self, regs):
-        'send the 6 regs as 32 bit hex value (8 char) followed by char "R".'
+        'send the 6 regs as 32 bit hex value (8 char) followed by char "R" or as one binary frame.'
         # print( 'tinyADF.set_regs()' )
+        if self.binary:
+            self._frame( self.FRAME_REGS, struct.pack( f'<{len(regs)}I', *regs ) )
+            return
         for reg in regs:
             command = f'{reg:08X}R'
             self.ADF.write( command.encode() )
@@ -260,8 +574,13 @@ class tinyADF:
         return
 
     def get_mux( self ):
-        'get the status of the MUX bit - not possible with this interface'
-        return 1 # DUMMY
+        '''get the status of the MUX bit as one byte like FX2 (0: MUXOUT=LOW or 1: MUXOUT=HIGH),
+        None if unknown: only in binary mode and if the board has a mux pin'''
+        if self.binary:
+            mux = self._frame( self.FRAME_MUX, reply=1 )
+            if mux is not None and mux[0] != self.MUX_UNKNOWN:
+                return mux
+        return None
 
     def get_eeprom( self, addr, size ):
         'not possible with this interface'
@@ -6,20 +6,12 @@
 
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 
 #include "adf4351.h"
+#include "adf435x.h"
 
-// calculate greatest common denominator
-static uint32_t getGCD( uint32_t n1, uint32_t n2 ) {
-    while ( n1 != n2 )
-        if ( n1 > n2 )
-            n1 -= n2;
-        else
-            n2 -= n1;
-    return n1;
-}
-
-
+// registers for freq with the settings of the command line tools, calculated by libadf435x
 void ADF4351::calculateFreq( double freq, uint32_t RCounter ) {
 
     // init register with default values
@@ -38,60 +30,23 @@ void ADF4351::calculateFreq( double freq, uint32_t RCounter ) {
         return;
     }
 
-    RCounter &= 0x3FF;
-    double fPFD = refIn / RCounter;
-    uint32_t bandSelClkDiv = uint32_t( ceil( fPFD / 125000 ) );
-    uint32_t divider = 1;
-    uint32_t RF_DIV = 0;
-
-    for ( double f = 2.2e9; f > 66e6; f /= 2 ) {
-        if ( freq >= f )
-            break;
-        ++RF_DIV;
-        divider *= 2;
-    }
-    double VCO_Freq = freq * divider;
-
-    INT = VCO_Freq / fPFD;
-    MOD = fPFD / 1000;
-    FRAC = MOD * ( ( VCO_Freq / fPFD ) - INT );
-
-    if ( !FRAC ) { // INT mode
-        MOD = 2;
-        R2.b.LDF = LDF_INT;
-        R2.b.LDP = LDP_6NS;
-    } else { // FRAC mode
-        uint32_t gcd = getGCD( FRAC, MOD );
-        FRAC /= gcd;
-        MOD /= gcd;
-        R2.b.LDF = LDF_FRAC;
-        R2.b.LDP = LDP_10NS;
-    }
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    cfg.ref_hz = refIn;
+    cfg.r_counter = RCounter;
+    adf435x_params p;
+    adf435x_params_default( &p );
+    // range errors are checked by the caller, the registers are set anyway
+    if ( freq < 0 || adf435x_solve( &cfg, uint64_t( llround( freq ) ), &p ) == ADF435X_ERR_PARAM )
+        return;
 
-    // set register values
-    R5.b.LDPinMode = LD_PIN_DIGITAL_LOCK;
-    //
-    R4.b.feedback = FEEDBACK_FUNDAMENTAL;
-    R4.b.RFDivSel = RF_DIV;
-    R4.b.bandSelClkDiv = bandSelClkDiv;
-    R4.b.outEnable = ENABLE;
-    R4.b.outPower = POWER_PLUS5DB;
-    R4.b.MTLD = ENABLE;
-    //
-    R3.b.clkDiv = 150;
-    //
-    R2.b.muxOut = MUX_DIGITALLOCK; // dig lock detect
-    R2.b.RCounter = RCounter;
-    R2.b.doubleBuffer = ENABLE;
-    R2.b.CPCurrent = CPCURRENT_2_50; // 2.50 mA
-    R2.b.PDPolarity = POLARITY_POSITIVE;
-    //
-    R1.b.MOD = MOD;
-    R1.b.phase = 1;
-    R1.b.prescaler = PRESCALER_8_9;
-    //
-    R0.b.INT = INT;
-    R0.b.FRAC = FRAC;
+    INT = p.INT;
+    FRAC = p.FRAC;
+    MOD = p.MOD;
+    uint32_t reg[ 6 ];
+    adf435x_pack( &p, reg );
+    for ( int iii = 0; iii < 6; ++iii )
+        *R[ iii ] = reg[ iii ];
 }
 
 
@@ -102,3 +57,29 @@ uint32_t ADF4351::getReg( int index, int bits, int pos ) {
     else // return a register section
         return ( *R[ index ] >> pos ) & ( ( 1U << bits ) - 1 );
 }
+
+
+// parse a frequency (double value with optional suffix 'k', 'M', 'G')
+double ADF4351::parseFreq( const char *arg, char **end ) {
+    char *suffix;
+    double freq = strtod( arg, &suffix );
+    if ( freq ) {
+        if ( *suffix == 'k' )
+            freq *= 1e3;
+        else if ( *suffix == 'M' )
+            freq *= 1e6;
+        else if ( *suffix == 'G' )
+            freq *= 1e9;
+        else if ( freq <= 5 ) // GHz
+            freq *= 1e9;
+        else if ( freq <= 5000 ) // MHz
+            freq *= 1e6;
+        else if ( freq < 5000000 ) // kHz
+            freq *= 1e3;
+    }
+    if ( *suffix == 'k' || *suffix == 'M' || *suffix == 'G' )
+        ++suffix;
+    if ( end )
+        *end = suffix;
+    return freq;
+}
@@ -16,6 +16,84 @@ class ADF4351 {
     uint32_t getINT() { return INT; };
     uint32_t getFRAC() { return FRAC; };
     uint32_t getMOD() { return MOD; };
+    uint32_t getRefIn() { return refIn; };
+    // parse a frequency (double value with optional suffix 'k', 'M', 'G'),
+    // values without suffix <= 5 are GHz, <= 5000 MHz, < 5000000 kHz
+    static double parseFreq( const char *arg, char **end = nullptr );
+
+    // Compile time register set for a fixed reference and R counter.
+    // Integer version of calculateFreq() with the same settings, e.g.
+    //   constexpr auto r100 = ADF4351::Plan< 25000000, 250 >::regs< 100000000 >();
+    //   constexpr ADF4351::Plan< 25000000 >::Regs table[] = { Plan::regs< f1 >(), Plan::regs< f2 >() };
+    // regs<>() checks the frequency dependent limits with static_assert,
+    // calculate() can also be used at runtime.
+    template < uint32_t refIn, uint32_t Rcounter = 250 > struct Plan {
+        static constexpr uint32_t fPFD = refIn / ( Rcounter ? Rcounter : 1 );
+        static constexpr uint32_t bandSelClkDiv = ( fPFD + 124999 ) / 125000; // band select clock <= 125 kHz
+
+        static_assert( Rcounter >= 1 && Rcounter <= 1023, "R counter must be 1..1023" );
+        static_assert( fPFD >= 2000, "PFD too low, MOD = PFD / 1 kHz must be at least 2" );
+        static_assert( fPFD <= 32000000, "PFD above 32 MHz is not allowed in FRAC mode" );
+        static_assert( bandSelClkDiv <= 255, "band select clock divider above 255" );
+
+        struct Regs {
+            uint32_t R[ 6 ]; // R0..R5
+            uint32_t INT;
+            uint32_t FRAC;
+            uint32_t MOD;
+            uint32_t RFDiv; // RF divider select, divider = 1 << RFDiv
+            constexpr uint32_t operator[]( int index ) const { return R[ index ]; }
+        };
+
+        // registers for freq_Hz, 0 powers down the VCO
+        static constexpr Regs calculate( uint64_t freq_Hz ) {
+            Regs r{ { 0x00000000, 0x00000001, 0x00000002, 0x00000003, 0x00000004, 0x00180005 }, 0, 0, 0, 0 };
+            if ( freq_Hz == 0 ) {
+                r.R[ 4 ] |= uint32_t( VCO_POWERDOWN ) << 11; // VCOPowerDown
+                return r;
+            }
+            for ( uint64_t f = 2200000000; f > 66000000; f /= 2 ) {
+                if ( freq_Hz >= f )
+                    break;
+                ++r.RFDiv;
+            }
+            const uint64_t vco = freq_Hz << r.RFDiv;
+            r.INT = uint32_t( vco / fPFD );
+            r.MOD = fPFD / 1000;
+            r.FRAC = uint32_t( r.MOD * ( vco % fPFD ) / fPFD );
+            if ( !r.FRAC ) { // INT mode
+                r.MOD = 2;
+                r.R[ 2 ] |= uint32_t( LDF_INT ) << 8 | uint32_t( LDP_6NS ) << 7; // LDF, LDP
+            } else {                                                           // FRAC mode
+                uint32_t a = r.FRAC, b = r.MOD;
+                while ( b ) {
+                    uint32_t t = a % b;
+                    a = b;
+                    b = t;
+                }
+                r.FRAC /= a;
+                r.MOD /= a;
+            }
+            r.R[ 5 ] |= uint32_t( LD_PIN_DIGITAL_LOCK ) << 22; // LDPinMode
+            r.R[ 4 ] |= uint32_t( FEEDBACK_FUNDAMENTAL ) << 23 | r.RFDiv << 20 | bandSelClkDiv << 12 |
+                        uint32_t( ENABLE ) << 10 | uint32_t( ENABLE ) << 5 | uint32_t( POWER_PLUS5DB ) << 3; // MTLD, outEnable
+            r.R[ 3 ] |= 150 << 3;                                                                           // clkDiv
+            r.R[ 2 ] |= uint32_t( MUX_DIGITALLOCK ) << 26 | ( Rcounter & 0x3FF ) << 14 | uint32_t( ENABLE ) << 13 |
+                        uint32_t( CPCURRENT_2_50 ) << 9 | uint32_t( POLARITY_POSITIVE ) << 6;
+            r.R[ 1 ] |= ( r.MOD & 0xFFF ) << 3 | 1 << 15 | uint32_t( PRESCALER_8_9 ) << 27; // MOD, phase, prescaler
+            r.R[ 0 ] |= ( r.INT & 0xFFFF ) << 15 | ( r.FRAC & 0xFFF ) << 3;
+            return r;
+        }
+
+        template < uint64_t freq_Hz > static constexpr Regs regs() {
+            static_assert( freq_Hz == 0 || ( freq_Hz >= 33000000 && freq_Hz <= 4500000000 ),
+                           "frequency outside of 33 MHz ... 4500 MHz" );
+            constexpr Regs r = calculate( freq_Hz );
+            static_assert( freq_Hz == 0 || ( r.INT >= 75 && r.INT <= 65535 ), "INT must be 75..65535 with prescaler 8/9" );
+            static_assert( r.MOD <= 4095, "MOD does not fit into 12 bit" );
+            return r;
+        }
+    };
 
   private:
     uint32_t INT;
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <cerrno>
+#include <ctime>
+#include <thread>
+
+#include "coherent.h"
+#include "trace.h"
+
+
+CoherentRetune::CoherentRetune( const std::vector< adf435x_transport > &boards, const adf435x_config &cfg,
+                                const adf435x_params &base )
+    : boards{ boards }, cfg{ cfg }, base{ base }, regs( boards.size() ) {
+    // keep MOD = fPFD / channel also in INT mode and after a FRAC reduction, it is the phase resolution
+    this->cfg.flags |= ADF435X_CFG_KEEP_MOD;
+}
+
+
+// sleep until shortly before the deadline and spin the rest, the wake-up jitter of the
+// scheduler would otherwise be the skew between the boards; spinning threads without
+// a CPU of their own would delay each other, they only sleep
+static void waitUntil( uint64_t deadline_ns, bool spin ) {
+    const uint64_t SPIN_NS = spin ? 100000 : 0;
+    if ( deadline_ns > SPIN_NS ) {
+        uint64_t wake = deadline_ns - SPIN_NS;
+        struct timespec ts = { time_t( wake / 1000000000 ), long( wake % 1000000000 ) };
+        while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr ) == EINTR )
+            ;
+    }
+    while ( Trace::now() < deadline_ns )
+        ;
+}
+
+
+bool CoherentRetune::writeR0( RetuneReport &report ) {
+    const size_t n = boards.size();
+    std::vector< int > rc( n, 0 );
+    std::vector< std::thread > threads;
+    const bool spin = std::thread::hardware_concurrency() > n;
+    const uint64_t deadline = Trace::now() + lead_ns;
+    for ( size_t iii = 0; iii < n; ++iii )
+        threads.emplace_back( [ this, iii, deadline, spin, &rc, &report ]() {
+            waitUntil( deadline, spin );
+            report.start_ns[ iii ] = Trace::now();
+            rc[ iii ] = boards[ iii ].write_reg( boards[ iii ].ctx, regs[ iii ][ 0 ] );
+            report.done_ns[ iii ] = Trace::now();
+        } );
+    for ( auto &thread : threads )
+        thread.join();
+    uint64_t first = UINT64_MAX, last = 0;
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        if ( rc[ iii ] )
+            return false;
+        if ( report.start_ns[ iii ] < first )
+            first = report.start_ns[ iii ];
+        if ( report.done_ns[ iii ] > last )
+            last = report.done_ns[ iii ];
+    }
+    report.skew_ns = n ? last - first : 0;
+    report.inWindow = report.skew_ns <= report.window_s * 1e9;
+    return true;
+}
+
+
+int CoherentRetune::retune( uint64_t freq_Hz, RetuneReport &report ) {
+    const size_t n = boards.size();
+    adf435x_params p = base;
+    int err = adf435x_solve( &cfg, freq_Hz, &p );
+    if ( err == ADF435X_OK )
+        err = adf435x_resync( cfg.ref_hz, &p, lock_s );
+    if ( err != ADF435X_OK )
+        return err;
+
+    uint64_t num, den;
+    adf435x_pfd( &cfg, &num, &den );
+    report.tSync_s = adf435x_sync_time( cfg.ref_hz, &p );
+    report.window_s = p.FRAC ? double( den ) / num : report.tSync_s;
+    report.phase.assign( n, 0 );
+    report.start_ns.assign( n, 0 );
+    report.done_ns.assign( n, 0 );
+    report.skew_ns = 0;
+    report.attempts = 0;
+    report.inWindow = false;
+
+    // R5..R1 board by board, only the changed ones
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        p.phase = report.phase[ iii ] = adf435x_phase_word( &p, iii < phaseDeg.size() ? phaseDeg[ iii ] : 0 );
+        uint32_t reg[ 6 ];
+        adf435x_pack( &p, reg );
+        unsigned mask = written ? adf435x_changed( regs[ iii ].data(), reg ) & 0x3E : 0x3E;
+        for ( int r = 0; r < 6; ++r )
+            regs[ iii ][ r ] = reg[ r ];
+        if ( ( err = adf435x_write_regs( &boards[ iii ], reg, mask ) ) != ADF435X_OK ) {
+            written = false;
+            return err;
+        }
+    }
+    written = true;
+
+    // R0 on all boards at once, again if the latches were too far apart
+    while ( report.attempts < maxAttempts ) {
+        ++report.attempts;
+        if ( !writeR0( report ) ) {
+            written = false;
+            return ADF435X_ERR_TRANSPORT;
+        }
+        if ( report.inWindow )
+            break;
+    }
+    return ADF435X_OK;
+}
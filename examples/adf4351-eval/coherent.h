@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "adf435x.h"
+
+
+// result of one coherent retune, CLOCK_MONOTONIC ns
+struct RetuneReport {
+    double tSync_s;                 // resync after the R0 write
+    double window_s;                // all R0 latches must be inside for the same output phase
+    std::vector< uint16_t > phase;  // phase word per board
+    std::vector< uint64_t > start_ns; // R0 transfer started, per board
+    std::vector< uint64_t > done_ns;  // R0 transfer done
+    uint64_t skew_ns;               // last done - first start: the latches happened within this time
+    unsigned attempts;              // R0 rounds written
+    bool inWindow;
+};
+
+
+// Phase coherent retune of several ADF4351 that share one reference.
+// All boards get the same INT/FRAC/MOD with phase resync (CLK_DIV_MODE 2) and their own PHASE word.
+// The output phase is set t_sync after the R0 write at a PFD edge counted from the R0 latch,
+// in FRAC mode the sigma-delta state differs from edge to edge, so all boards must latch R0 within
+// one PFD period; in INT mode every edge is the same and the window is t_sync.
+// R5..R1 are written board by board first, the fields that matter are double buffered
+// or do nothing before R0. Then one thread per board writes R0 at a common absolute deadline,
+// the latches are apart by the USB scheduling jitter instead of one transfer time per board.
+// A round with the R0 latches outside the window is repeated (R0 restarts the resync timer).
+class CoherentRetune {
+  public:
+    CoherentRetune( const std::vector< adf435x_transport > &boards, const adf435x_config &cfg,
+                    const adf435x_params &base );
+
+    void setPhases( const std::vector< double > &deg ) { phaseDeg = deg; }; // per board, missing: 0
+    void setLockTime( double s ) { lock_s = s; };                          // t_sync >= lock time
+    void setAttempts( unsigned n ) { maxAttempts = n ? n : 1; };           // R0 rounds per retune
+    void setLead( uint64_t ns ) { lead_ns = ns; }; // R0 deadline after the threads are started
+
+    // adf435x error code, the registers are not written if the frequency can not be set
+    int retune( uint64_t freq_Hz, RetuneReport &report );
+    const uint32_t *registers( size_t board ) const { return regs[ board ].data(); };
+
+  private:
+    bool writeR0( RetuneReport &report );
+
+    std::vector< adf435x_transport > boards;
+    adf435x_config cfg;
+    adf435x_params base;
+    std::vector< double > phaseDeg;
+    double lock_s = 1e-3;
+    unsigned maxAttempts = 3;
+    uint64_t lead_ns = 1000000;
+    std::vector< std::array< uint32_t, 6 > > regs;
+    bool written = false; // regs are in the boards
+};
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Phase coherent retune of several eval boards that share one reference
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctype.h>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+#include "adf4351.h"
+#include "coherent.h"
+#include "eval.h"
+
+
+int main( int argc, char *argv[] ) {
+    bool useEvalboard = true;
+    int verbose = 0;
+    unsigned attempts = 3;
+    double lock_us = 1000;
+    double ref = 25e6;
+    unsigned rCounter = 250;
+    double channel = 1000;
+    double dwell_ms = 0;
+    std::vector< unsigned > devices;
+    std::vector< double > phases;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "a:c:dD:hl:p:r:R:vw:" ) ) != -1 )
+        switch ( c ) {
+        case 'a': // R0 rounds
+            attempts = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'c': // channel
+            channel = ADF4351::parseFreq( optarg );
+            break;
+        case 'd': // dry run
+            useEvalboard = false;
+            break;
+        case 'D': { // device list
+            char *next = optarg;
+            do
+                devices.push_back( strtoul( next, &next, 0 ) );
+            while ( *next++ == ',' );
+            break;
+        }
+        case 'l': // lock time
+            lock_us = strtod( optarg, nullptr );
+            break;
+        case 'p': { // phase list
+            char *next = optarg;
+            do
+                phases.push_back( strtod( next, &next ) );
+            while ( *next++ == ',' );
+            break;
+        }
+        case 'r': // reference
+            ref = ADF4351::parseFreq( optarg );
+            break;
+        case 'R': // R counter
+            rCounter = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'v': // increase verbosity
+            ++verbose;
+            break;
+        case 'w': // dwell between the frequencies
+            dwell_ms = strtod( optarg, nullptr );
+            break;
+        case 'h': // help
+            puts( "adf4351-coherent [-a COUNT] [-c CHANNEL] [-d] [-D DEV,...] [-h] [-l LOCK] [-p DEG,...] [-r REF]\n"
+                  "                 [-R RCOUNTER] [-v] [-w DWELL] FREQ ...\n"
+                  "  -a COUNT  : R0 rounds per retune until the latches are in the resync window (default 3)\n"
+                  "  -c CHANNEL: channel spacing, phase step = 360 deg * CHANNEL / PFD (default 1 kHz)\n"
+                  "  -d        : dry run, do not open the eval boards\n"
+                  "  -D DEV,...: eval boards sharing the reference, 0 = first (default 0,1)\n"
+                  "  -h        : show this help\n"
+                  "  -l LOCK   : lock time in us, resync happens after it (default 1000)\n"
+                  "  -p DEG,...: phase offset per board in degrees (default 0)\n"
+                  "  -r REF    : reference frequency (default 25 MHz)\n"
+                  "  -R RCOUNTER: R counter (default 250)\n"
+                  "  -v        : increase verbosity\n"
+                  "  -w DWELL  : time per frequency in ms (default 0)\n"
+                  "  FREQ      : frequencies like '-f' of adf4351-eval, retuned in this order" );
+            return 1;
+        case '?':
+            if ( optopt == 'a' || optopt == 'l' || optopt == 'R' || optopt == 'w' )
+                fprintf( stderr, "option '-%c' requires a numeric argument.\n", optopt );
+            else if ( optopt == 'c' || optopt == 'r' )
+                fprintf( stderr, "option '-%c' requires a frequency argument.\n", optopt );
+            else if ( optopt == 'D' || optopt == 'p' )
+                fprintf( stderr, "option '-%c' requires a list.\n", optopt );
+            else if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c'.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+
+    if ( optind == argc ) {
+        fprintf( stderr, "adf4351-coherent: frequency required, '-h' shows the usage\n" );
+        return 1;
+    }
+    if ( ref < 1 || ref > 250e6 || channel < 1 || channel > ref || lock_us < 0 ) {
+        fprintf( stderr, "bad reference, channel or lock time\n" );
+        return 1;
+    }
+    if ( devices.empty() )
+        devices = { 0, 1 };
+    if ( phases.size() > devices.size() )
+        fprintf( stderr, "%zu phases for %zu boards, ignoring the rest\n", phases.size(), devices.size() );
+
+    std::vector< std::unique_ptr< EVAL > > evals;
+    std::vector< adf435x_transport > boards;
+    for ( unsigned index : devices ) {
+        if ( useEvalboard ) {
+            evals.emplace_back( new EVAL );
+            if ( !evals.back()->init( index ) )
+                return 1;
+            boards.push_back( evals.back()->transport() );
+        } else { // dry run, the writes take no time
+            adf435x_transport dry = { nullptr, []( void *, uint32_t ) { return 0; }, nullptr };
+            boards.push_back( dry );
+        }
+    }
+
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    cfg.ref_hz = uint32_t( llround( ref ) );
+    cfg.r_counter = rCounter;
+    cfg.channel_hz = uint32_t( llround( channel ) );
+    adf435x_params base;
+    adf435x_params_default( &base );
+
+    CoherentRetune retune( boards, cfg, base );
+    retune.setPhases( phases );
+    retune.setLockTime( lock_us * 1e-6 );
+    retune.setAttempts( attempts );
+
+    bool allInWindow = true;
+    for ( int arg = optind; arg < argc; ++arg ) {
+        double freq = ADF4351::parseFreq( argv[ arg ] );
+        RetuneReport report;
+        int err = retune.retune( uint64_t( llround( freq ) ), report );
+        if ( err != ADF435X_OK ) {
+            fprintf( stderr, "f = %.6f MHz: %s\n", freq / 1e6, adf435x_strerror( err ) );
+            return 1;
+        }
+        allInWindow &= report.inWindow;
+        printf( "f = %.6f MHz: t sync %.1f us, window %.3f us, R0 skew %.3f us, %u round%s%s\n", freq / 1e6,
+                report.tSync_s * 1e6, report.window_s * 1e6, report.skew_ns / 1e3, report.attempts,
+                report.attempts == 1 ? "" : "s", report.inWindow ? "" : ", NOT COHERENT" );
+        if ( verbose ) {
+            uint64_t first = report.start_ns[ 0 ];
+            for ( size_t iii = 1; iii < devices.size(); ++iii )
+                if ( report.start_ns[ iii ] < first )
+                    first = report.start_ns[ iii ];
+            adf435x_params p;
+            adf435x_unpack( retune.registers( 0 ), &p );
+            for ( size_t iii = 0; iii < devices.size(); ++iii )
+                printf( "  #%u: PHASE %u / %u = %.2f deg, R0 +%.3f .. +%.3f us\n", devices[ iii ], report.phase[ iii ],
+                        p.MOD, 360.0 * report.phase[ iii ] / p.MOD, ( report.start_ns[ iii ] - first ) / 1e3,
+                        ( report.done_ns[ iii ] - first ) / 1e3 );
+        }
+        if ( verbose > 1 )
+            for ( size_t iii = 0; iii < devices.size(); ++iii ) {
+                printf( "  #%u:", devices[ iii ] );
+                for ( int r = 5; r >= 0; --r )
+                    printf( " %08X", retune.registers( iii )[ r ] );
+                printf( "\n" );
+            }
+        if ( dwell_ms > 0 && arg + 1 < argc )
+            usleep( useconds_t( dwell_ms * 1000 ) );
+    }
+    return allInWindow ? 0 : 2;
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Decode register words (e.g. read back or from "adf4351-eval -l") or a recorded register stream
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctype.h>
+#include <unistd.h>
+#include <vector>
+
+#include "adf4351.h"
+#include "adf435x.h"
+#include "regstream.h"
+#include "trace.h"
+
+
+static void printFields( const adf435x_params &p ) {
+    static const char *const muxout[] = { "three-state", "DVdd", "DGND", "R counter", "N divider",
+                                          "analog lock detect", "digital lock detect", "reserved" };
+    static const char *const ldPin[] = { "low", "digital lock detect", "low", "high" };
+    static const char *const clkDiv[] = { "off", "fast lock", "resync", "reserved" };
+    printf( "R0: INT %u, FRAC %u\n", p.INT, p.FRAC );
+    printf( "R1: phase adjust %u, prescaler %s, phase %u, MOD %u\n", p.phase_adjust, p.prescaler_8_9 ? "8/9" : "4/5",
+            p.phase, p.MOD );
+    printf( "R2: %s, MUXOUT %s, doubler %u, div2 %u, R %u, double buffer %u, CP %u, LDF %s, LDP %s ns, "
+            "PD polarity %s\n",
+            p.low_noise_spur_mode == 3 ? "low spur" : p.low_noise_spur_mode ? "reserved noise mode" : "low noise",
+            muxout[ p.muxout & 7 ], p.ref_doubler, p.ref_div2, p.r_counter, p.double_buffer, p.cp_current,
+            p.ldf ? "INT-N" : "FRAC-N", p.ldp ? "6" : "10", p.pd_polarity ? "positive" : "negative" );
+    printf( "    power-down %u, CP three-state %u, counter reset %u\n", p.powerdown, p.cp_three_state,
+            p.counter_reset );
+    printf( "R3: band select clock %s, ABP %s ns, charge cancel %u, CSR %u, clock divider %s %u\n",
+            p.band_select_clock_mode ? "high" : "low", p.abp ? "3" : "6", p.charge_cancel, p.csr,
+            clkDiv[ p.clk_div_mode & 3 ], p.clock_divider );
+    printf( "R4: feedback %s, RF divider %u, band select divider %u, VCO power-down %u, MTLD %u\n",
+            p.feedback_fundamental ? "fundamental" : "divided", 1U << p.rf_div_select, p.band_select_clock_divider,
+            p.vco_powerdown, p.mtld );
+    printf( "    AUX %s %s %+d dBm, RF %s %+d dBm\n", p.aux_output_select ? "fundamental" : "divided",
+            p.aux_output_enable ? "on" : "off", 3 * p.aux_output_power - 4, p.output_enable ? "on" : "off",
+            3 * p.output_power - 4 );
+    printf( "R5: LD pin %s\n", ldPin[ p.ld_pin_mode & 3 ] );
+}
+
+
+static void printOutput( const adf435x_output &o ) {
+    printf( "PFD %.6f MHz, N %.6f, VCO %.6f MHz, RF %.6f MHz%s, AUX %.6f MHz, step %.3f Hz\n", o.pfd_hz / 1e6, o.n,
+            o.vco_hz / 1e6, o.rf_hz / 1e6, o.off ? " (off)" : "", o.aux_hz / 1e6, o.step_hz );
+    printf( "band select clock %.3f kHz, CP %.4f mA\n", o.band_select_clock_hz / 1e3, o.cp_current_ma );
+}
+
+
+// frequency changes of a recorded stream as "time_s freq_Hz", 0 Hz: output off, nan: invalid registers
+static int decodeFile( const char *path, uint32_t ref, const uint32_t *reg, int verbose ) {
+    RegStreamReader stream;
+    if ( !stream.open( path ) )
+        return 1;
+    std::vector< uint32_t > words;
+    std::vector< uint64_t > times;
+    RegRecord record;
+    while ( stream.next( record ) ) {
+        words.push_back( record.word );
+        times.push_back( record.time_ns );
+    }
+    std::vector< double > rf( words.size() );
+
+    adf435x_stream state;
+    adf435x_stream_init( &state, ref, reg );
+    double last = state.rf_hz;
+    uint64_t t0 = Trace::now();
+    size_t changes = adf435x_decode_stream( &state, words.data(), words.size(), rf.data() );
+    double dt = ( Trace::now() - t0 ) / 1e9;
+
+    for ( size_t iii = 0; iii < words.size(); ++iii ) {
+        if ( verbose > 1 )
+            printf( "# %10.6f R%u: 0x%08X\n", times[ iii ] / 1e9, words[ iii ] & 0b111, words[ iii ] );
+        // NAN != NAN, print a change from or to an invalid state only once
+        if ( rf[ iii ] == last || ( std::isnan( rf[ iii ] ) && std::isnan( last ) ) )
+            continue;
+        printf( "%.9f %.3f\n", times[ iii ] / 1e9, rf[ iii ] );
+        last = rf[ iii ];
+    }
+    if ( verbose )
+        fprintf( stderr, "%s: %zu registers, %zu frequency changes, decoded in %.3f ms (%.0f registers/s)\n", path,
+                 words.size(), changes, dt * 1e3, dt > 0 ? words.size() / dt : 0.0 );
+    return 0;
+}
+
+
+int main( int argc, char *argv[] ) {
+    double ref = 25e6;
+    const char *file = nullptr;
+    bool quiet = false;
+    int verbose = 0;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "f:hqr:v" ) ) != -1 )
+        switch ( c ) {
+        case 'f': // register stream
+            file = optarg;
+            break;
+        case 'q': // output values only
+            quiet = true;
+            break;
+        case 'r': // reference
+            ref = ADF4351::parseFreq( optarg );
+            break;
+        case 'v': // increase verbosity
+            ++verbose;
+            break;
+        case 'h': // help
+            puts( "adf4351-decode [-f FILE] [-h] [-q] [-r REF] [-v] [REG ...]\n"
+                  "  -f FILE : print the frequency changes of a register stream as \"time_s freq_Hz\",\n"
+                  "            REG ... is the register state before the stream\n"
+                  "  -h      : show this help\n"
+                  "  -q      : print the output values only\n"
+                  "  -r REF  : reference frequency (default 25 MHz)\n"
+                  "  -v      : increase verbosity\n"
+                  "  REG     : register hex value, the control bits select R0..R5, missing registers are 0" );
+            return 1;
+        case '?':
+            if ( optopt == 'r' )
+                fprintf( stderr, "option '-r' requires a frequency argument.\n" );
+            else if ( optopt == 'f' )
+                fprintf( stderr, "option '-f' requires a file argument.\n" );
+            else if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c'.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+
+    if ( ref < 1 || ref > 250e6 ) {
+        fprintf( stderr, "bad reference frequency '%g'\n", ref );
+        return 1;
+    }
+    if ( !file && optind == argc ) {
+        fprintf( stderr, "adf4351-decode: registers or '-f FILE' required, '-h' shows the usage\n" );
+        return 1;
+    }
+
+    uint32_t reg[ 6 ] = { 0, 1, 2, 3, 4, 5 };
+    unsigned set = 0;
+    for ( int iii = optind; iii < argc; ++iii ) {
+        char *end;
+        uint32_t word = strtoul( argv[ iii ], &end, 16 );
+        unsigned index = word & 0b111;
+        if ( *end || index > 5 ) {
+            fprintf( stderr, "bad register value '%s'\n", argv[ iii ] );
+            return 1;
+        }
+        if ( set & ( 1U << index ) )
+            fprintf( stderr, "R%u given twice, using 0x%08X\n", index, word );
+        set |= 1U << index;
+        reg[ index ] = word;
+    }
+
+    if ( file )
+        return decodeFile( file, uint32_t( llround( ref ) ), set ? reg : nullptr, verbose );
+
+    adf435x_params p;
+    adf435x_output o;
+    int err = adf435x_decode( uint32_t( llround( ref ) ), reg, &p, &o );
+    if ( set != 0x3F )
+        fprintf( stderr, "missing registers are 0\n" );
+    if ( !quiet || verbose ) {
+        for ( int iii = 5; iii >= 0; --iii )
+            printf( "R%d: 0x%08X\n", iii, reg[ iii ] );
+        printFields( p );
+    }
+    if ( err ) {
+        fprintf( stderr, "%s\n", adf435x_strerror( err ) );
+        return 1;
+    }
+    printOutput( o );
+    return 0;
+}
@@ -5,21 +5,48 @@
 //
 
 #include "eval.h"
+#include "trace.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 
 
-bool EVAL::init() {
+// little endian uint32 of a FW reply
+static uint32_t le32( const uint8_t *data ) {
+    return uint32_t( data[ 0 ] ) | uint32_t( data[ 1 ] ) << 8 | uint32_t( data[ 2 ] ) << 16 | uint32_t( data[ 3 ] ) << 24;
+}
+
+
+bool EVAL::init( unsigned index ) {
     int rc;
+    device = index;
     if ( ( rc = libusb_init( &context ) ) ) {
         fprintf( stderr, "EVAL init: %s\n", libusb_strerror( rc ) );
         return false;
     }
 
-    dev_handle = libusb_open_device_with_vid_pid( context, VID, PID );
+    if ( index == 0 )
+        dev_handle = libusb_open_device_with_vid_pid( context, VID, PID );
+    else { // several boards with the same VID:PID, take them in bus order
+        libusb_device **list;
+        ssize_t n = libusb_get_device_list( context, &list );
+        unsigned found = 0;
+        for ( ssize_t iii = 0; iii < n; ++iii ) {
+            libusb_device_descriptor desc;
+            if ( libusb_get_device_descriptor( list[ iii ], &desc ) || desc.idVendor != VID || desc.idProduct != PID )
+                continue;
+            if ( found++ == index ) {
+                if ( libusb_open( list[ iii ], &dev_handle ) )
+                    dev_handle = nullptr;
+                break;
+            }
+        }
+        if ( n >= 0 )
+            libusb_free_device_list( list, 1 );
+    }
 
     if ( dev_handle == nullptr ) {
-        fprintf( stderr, "Error: Could not open ADF4351-EVAL device 0x%04X:0x%04X\n", VID, PID );
+        fprintf( stderr, "Error: Could not open ADF4351-EVAL device 0x%04X:0x%04X #%u\n", VID, PID, index );
         return false;
     }
     return true;
@@ -27,6 +54,8 @@ bool EVAL::init() {
 
 
 EVAL::~EVAL() {
+    if ( statusEndpoint > 0 )
+        libusb_release_interface( dev_handle, 0 );
     if ( dev_handle )
         libusb_close( dev_handle );
     if ( context )
@@ -36,9 +65,13 @@ EVAL::~EVAL() {
 
 int EVAL::sendReg( uint32_t reg ) { // transfer one 32 bit register
     int rc;
+    ADF_TRACE_START( t );
     rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_SET_REG, wValue, wIndex, (uint8_t *)&reg, 4, timeout );
+    ADF_TRACE_STOP( t, SET_REG, rc, reg, device );
     if ( rc != 4 )
         fprintf( stderr, "USB send register: %s\n", libusb_strerror( rc ) );
+    else if ( recorder.isOpen() )
+        recorder.append( reg );
     return rc;
 }
 
@@ -46,8 +79,225 @@ int EVAL::sendReg( uint32_t reg ) { // transfer one 32 bit register
 uint8_t EVAL::getMux() {
     uint8_t mux = 0;
     int rc;
+    ADF_TRACE_START( t );
     rc = libusb_control_transfer( dev_handle, requestRead, USB_REQ_GET_MUX, wValue, wIndex, &mux, 1, timeout );
+    ADF_TRACE_STOP( t, GET_MUX, rc, mux, device );
     if ( rc != 1 )
         fprintf( stderr, "USB get mux: %s\n", libusb_strerror( rc ) );
     return mux;
 }
+
+
+bool EVAL::getState( DeviceState &state ) {
+    uint8_t data[ 40 ];
+    int rc;
+    ADF_TRACE_START( t );
+    rc = libusb_control_transfer( dev_handle, requestRead, USB_REQ_GET_STATE, wValue, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, GET_STATE, rc, rc == sizeof( data ) ? data[ 26 ] : 0, device );
+    if ( rc != sizeof( data ) ) // older FW stalls
+        return false;
+    for ( int reg = 0; reg < 6; ++reg )
+        state.reg[ reg ] = le32( data + 4 * reg );
+    state.initType = data[ 24 ];
+    state.mux = data[ 25 ];
+    state.written = data[ 26 ];
+    state.events = data[ 27 ];
+    state.regWrites = le32( data + 28 );
+    state.r0Writes = le32( data + 32 );
+    state.ticks = le32( data + 36 );
+    return true;
+}
+
+
+bool EVAL::countMux( unsigned gate_ms, double &freq_Hz ) {
+    uint8_t data[ 8 ];
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestRead, USB_REQ_COUNT_MUX, uint16_t( gate_ms ), wIndex, data,
+                                      sizeof( data ), gate_ms + 100 );
+    ADF_TRACE_STOP( t, COUNT_MUX, rc, gate_ms, device );
+    if ( rc != sizeof( data ) ) // older FW stalls
+        return false;
+    const uint32_t ticks = le32( data + 4 ); // 0.25 us
+    freq_Hz = ticks ? le32( data ) * 4e6 / ticks : 0;
+    return true;
+}
+
+
+bool EVAL::waitStatus( StatusMessage &msg, unsigned timeout_ms ) {
+    if ( statusEndpoint == 0 ) // the interface with the endpoint must be claimed, control transfers do not need it
+        statusEndpoint = libusb_claim_interface( dev_handle, 0 ) == 0 ? 1 : -1;
+    if ( statusEndpoint < 0 )
+        return false;
+    uint8_t data[ 8 ];
+    int len = 0;
+    int rc = libusb_interrupt_transfer( dev_handle, EP_STATUS, data, sizeof( data ), &len, timeout_ms );
+    if ( rc == LIBUSB_ERROR_TIMEOUT )
+        return false;
+    if ( rc || len != sizeof( data ) ) { // older FW without the endpoint
+        libusb_release_interface( dev_handle, 0 );
+        statusEndpoint = -1;
+        return false;
+    }
+    msg.flags = data[ 0 ];
+    msg.mux = data[ 1 ];
+    msg.request = data[ 2 ];
+    msg.hop = data[ 3 ];
+    msg.ticks = le32( data + 4 );
+    return true;
+}
+
+
+adf435x_transport EVAL::transport() {
+    adf435x_transport t;
+    t.ctx = this;
+    t.write_reg = []( void *ctx, uint32_t reg ) { return static_cast< EVAL * >( ctx )->sendReg( reg ) == 4 ? 0 : -1; };
+    t.read_mux = []( void *ctx, uint8_t *mux ) {
+        *mux = static_cast< EVAL * >( ctx )->getMux();
+        return 0;
+    };
+    return t;
+}
+
+
+bool EVAL::setFreq( uint64_t freq_Hz ) {
+    uint8_t data[ 8 ];
+    for ( int iii = 0; iii < 8; ++iii )
+        data[ iii ] = freq_Hz >> ( 8 * iii );
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_SET_FREQ, wValue, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, SET_FREQ, rc, uint32_t( freq_Hz / 1000 ), device );
+    if ( rc != sizeof( data ) ) {
+        fprintf( stderr, "USB set frequency: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::setFreq( uint64_t freq_Hz, uint32_t refIn, uint16_t Rcounter, uint8_t flags ) {
+    uint8_t data[ 16 ] = { 0 };
+    for ( int iii = 0; iii < 8; ++iii )
+        data[ iii ] = freq_Hz >> ( 8 * iii );
+    for ( int iii = 0; iii < 4; ++iii )
+        data[ 8 + iii ] = refIn >> ( 8 * iii );
+    data[ 12 ] = Rcounter;
+    data[ 13 ] = Rcounter >> 8;
+    data[ 14 ] = flags;
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_SET_FREQ, wValue, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, SET_FREQ, rc, uint32_t( freq_Hz / 1000 ), device );
+    if ( rc != sizeof( data ) ) {
+        fprintf( stderr, "USB set frequency: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::startSweep( uint64_t start_Hz, uint64_t stop_Hz, uint32_t step_Hz, uint32_t dwell_us, uint16_t repeat ) {
+    uint8_t data[ 28 ] = { 0 };
+    for ( int iii = 0; iii < 8; ++iii ) {
+        data[ iii ] = start_Hz >> ( 8 * iii );
+        data[ 8 + iii ] = stop_Hz >> ( 8 * iii );
+    }
+    for ( int iii = 0; iii < 4; ++iii ) {
+        data[ 16 + iii ] = step_Hz >> ( 8 * iii );
+        data[ 20 + iii ] = dwell_us >> ( 8 * iii );
+    }
+    data[ 24 ] = repeat;
+    data[ 25 ] = repeat >> 8;
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_SWEEP, 1, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, SWEEP, rc, 1, device );
+    if ( rc != sizeof( data ) ) {
+        fprintf( stderr, "USB start sweep: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::stopSweep() {
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_SWEEP, 0, wIndex, nullptr, 0, timeout );
+    ADF_TRACE_STOP( t, SWEEP, rc, 0, device );
+    if ( rc < 0 ) {
+        fprintf( stderr, "USB stop sweep: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::uploadSymbols( const std::vector< uint8_t > &bits ) {
+    const size_t CHUNK = 64; // one control packet
+    for ( size_t pos = 0; pos < bits.size(); pos += CHUNK ) {
+        const uint16_t len = uint16_t( std::min( CHUNK, bits.size() - pos ) );
+        ADF_TRACE_START( t );
+        int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_KEY_DATA, uint16_t( pos ), wIndex,
+                                          const_cast< uint8_t * >( bits.data() + pos ), len, timeout );
+        ADF_TRACE_STOP( t, KEY, rc, uint32_t( pos ), device );
+        if ( rc != len ) {
+            fprintf( stderr, "USB upload symbols: %s\n", libusb_strerror( rc ) );
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool EVAL::startKeying( uint32_t rate_Hz, uint32_t symbols, uint32_t word0, uint32_t word1, uint32_t idle,
+                        uint16_t repeat ) {
+    uint8_t data[ 24 ] = { 0 };
+    for ( int iii = 0; iii < 4; ++iii ) {
+        data[ iii ] = rate_Hz >> ( 8 * iii );
+        data[ 4 + iii ] = symbols >> ( 8 * iii );
+        data[ 8 + iii ] = word0 >> ( 8 * iii );
+        data[ 12 + iii ] = word1 >> ( 8 * iii );
+        data[ 16 + iii ] = idle >> ( 8 * iii );
+    }
+    data[ 20 ] = repeat;
+    data[ 21 ] = repeat >> 8;
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_KEY, 1, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, KEY, rc, rate_Hz, device );
+    if ( rc != sizeof( data ) ) {
+        fprintf( stderr, "USB start keying: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::stopKeying() {
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestWrite, USB_REQ_KEY, 0, wIndex, nullptr, 0, timeout );
+    ADF_TRACE_STOP( t, KEY, rc, 0, device );
+    if ( rc < 0 ) {
+        fprintf( stderr, "USB stop keying: %s\n", libusb_strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+bool EVAL::getKeyStatus( KeyStatus &status ) {
+    uint8_t data[ 32 ];
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( dev_handle, requestRead, USB_REQ_KEY, wValue, wIndex, data, sizeof( data ), timeout );
+    ADF_TRACE_STOP( t, KEY, rc, rc == sizeof( data ) ? data[ 30 ] : 0, device );
+    if ( rc != sizeof( data ) ) {
+        fprintf( stderr, "USB keying status: %s\n", rc < 0 ? libusb_strerror( rc ) : "short read" );
+        return false;
+    }
+    status.rate_Hz = le32( data ) / 1e3;
+    status.symbols = le32( data + 4 );
+    status.latched = le32( data + 8 );
+    status.dropped = le32( data + 12 );
+    status.latMin_ns = le32( data + 16 );
+    status.latMax_ns = le32( data + 20 );
+    status.latMean_ns = le32( data + 24 );
+    status.passes = data[ 28 ] | data[ 29 ] << 8;
+    status.active = data[ 30 ];
+    return true;
+}
@@ -7,15 +7,92 @@
 #pragma once
 
 #include <libusb-1.0/libusb.h>
+#include <vector>
+
+#include "adf435x.h"
+#include "regstream.h"
+
+
+// FX2 FW 0.4.3: device state read with one transfer
+struct DeviceState {
+    uint32_t reg[ 6 ];   // R0..R5 as last written, from USB or the EEPROM init
+    uint8_t initType;    // stored in EEPROM: 0 never, 1 stand-alone, 2 always
+    uint8_t mux;         // MUXOUT pin
+    uint8_t written;     // bit n: Rn written to the chip since power-on
+    uint8_t events;      // entries in the lock event log
+    uint32_t regWrites;  // register writes since power-on
+    uint32_t r0Writes;   // R0 writes since power-on
+    uint32_t ticks;      // FW time base, 0.25 us
+    bool regsKnown() const { return written == 0x3F; }; // reg[] is what the chip runs
+};
+
+
+// FX2 FW 0.4.4: message of the interrupt endpoint, sent when MUXOUT changes or an OUT request is done
+struct StatusMessage {
+    static const uint8_t MUX = 0x01;    // flags: MUXOUT changed
+    static const uint8_t DONE = 0x02;   // flags: OUT request done
+    static const uint8_t RELOCK = 0x04; // flags: the lock supervisor rewrote R0 (FW 0.4.7)
+    uint8_t flags;   // since the previous message
+    uint8_t mux;     // MUXOUT pin
+    uint8_t request; // last OUT request done
+    uint8_t hop;     // R0 counter, low byte
+    uint32_t ticks;  // FW time base, 0.25 us
+};
+
+
+// STM32 FW: state of the keying engine
+struct KeyStatus {
+    double rate_Hz;       // achieved symbol rate
+    uint32_t symbols;     // symbols clocked since the start
+    uint32_t latched;     // register words latched, one per change of the symbol
+    uint32_t dropped;     // words dropped by a full SPI queue
+    uint32_t latMin_ns;   // ideal symbol edge to the latch of its word
+    uint32_t latMax_ns;   // max - min is the timing jitter
+    uint32_t latMean_ns;
+    uint16_t passes;      // finished passes through the symbol buffer
+    bool active;
+};
 
 
 class EVAL {
   public:
     EVAL( uint16_t VID = 0x0456, uint16_t PID = 0xb40d ) : VID{ VID }, PID{ PID } {};
     ~EVAL();
-    bool init();
-    int sendReg( uint32_t reg ); // transfer one 32 bit register to the device
+    bool init( unsigned index = 0 ); // open the index-th device with VID:PID
+    int sendReg( uint32_t reg );     // transfer one 32 bit register to the device
+    // append all register words that were sent successfully to a register stream file
+    bool record( const char *path ) { return recorder.open( path ); };
     uint8_t getMux();            // get the mux status
+    // FX2 FW 0.4.3 or later, false w/o message if the FW does not know the request
+    bool getState( DeviceState &state );
+    // FX2 FW 0.4.4 or later: wait for the next status message, false after timeout_ms (> 0)
+    // or if the FW has no status endpoint
+    bool waitStatus( StatusMessage &msg, unsigned timeout_ms );
+    bool hasStatus() const { return statusEndpoint > 0; }; // known after the first waitStatus()
+    // FX2 FW 0.4.6 or later: frequency of MUXOUT counted by the FW for gate_ms (1 .. 1000),
+    // e.g. with the R counter or N divider output; false w/o message if the FW does not know the request
+    bool countMux( unsigned gate_ms, double &freq_Hz );
+    // the FW polls MUXOUT (PB0 has no counter input), countMux() is only valid below this rate
+    static const uint32_t COUNT_MAX_HZ = 250000;
+    // libadf435x register transport through sendReg() and getMux()
+    adf435x_transport transport();
+    // STM32 FW only: calculate the registers on the device and send the changed ones
+    bool setFreq( uint64_t freq_Hz );
+    bool setFreq( uint64_t freq_Hz, uint32_t refIn, uint16_t Rcounter, uint8_t flags = 0 );
+    static const uint8_t FREQ_REF_DOUBLER = 0x01; // flags for setFreq()
+    static const uint8_t FREQ_REF_DIV2 = 0x02;
+    // STM32 FW only: linear sweep generated by the device, repeat = 0 sweeps until stopped
+    bool startSweep( uint64_t start_Hz, uint64_t stop_Hz, uint32_t step_Hz, uint32_t dwell_us, uint16_t repeat = 0 );
+    bool stopSweep();
+    // STM32 FW only: keying from a symbol buffer, one bit per symbol, MSB of bits[ 0 ] first;
+    // word0 / word1 are sent when the symbol changes to 0 / 1 and must address the same register,
+    // idle is sent when the keying ends, repeat = 0 keys until stopped
+    bool uploadSymbols( const std::vector< uint8_t > &bits );
+    bool startKeying( uint32_t rate_Hz, uint32_t symbols, uint32_t word0, uint32_t word1, uint32_t idle,
+                      uint16_t repeat = 0 );
+    bool stopKeying();
+    bool getKeyStatus( KeyStatus &status );
+    static const uint32_t KEY_SYMBOLS_MAX = 8 * 4096; // size of the FW symbol buffer
 
   private:
     const uint16_t VID;
@@ -23,11 +100,21 @@ class EVAL {
     // direction:1: 0=host to dev, 1: dev to host; type:2: 10=vendor, recipient:5: 00000=device
     const uint8_t requestWrite = 0b0'10'00000;
     const uint8_t requestRead = 0b1'10'00000;
+    const uint8_t USB_REQ_SET_FREQ = 0xD0;
+    const uint8_t USB_REQ_SWEEP = 0xD1;
+    const uint8_t USB_REQ_KEY = 0xD2;
+    const uint8_t USB_REQ_KEY_DATA = 0xD3;
     const uint8_t USB_REQ_SET_REG = 0xDD;
     const uint8_t USB_REQ_GET_MUX = 0xDF;
+    const uint8_t USB_REQ_GET_STATE = 0xE2;
+    const uint8_t USB_REQ_COUNT_MUX = 0xE4;
+    const uint8_t EP_STATUS = 0x81;
     const uint16_t wValue = 0x0000;
     const uint16_t wIndex = 0x0000;
     const uint8_t timeout = 10;
+    unsigned device = 0; // index given to init(), in the trace events
+    int statusEndpoint = 0; // 1: interface claimed for waitStatus(), -1: not available
     libusb_context *context = nullptr;
     libusb_device_handle *dev_handle = nullptr;
+    RegStreamWriter recorder;
 };
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// OOK or 2-FSK keying of a bit stream by the STM32 firmware
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctype.h>
+#include <unistd.h>
+#include <vector>
+
+#include "adf4351.h"
+#include "eval.h"
+
+
+static void printStatus( const KeyStatus &s ) {
+    printf( "%.3f symbols/s, %u symbols, %u words latched, %u dropped, %u passes%s\n", s.rate_Hz, s.symbols,
+            s.latched, s.dropped, s.passes, s.active ? ", active" : "" );
+    if ( s.latched )
+        printf( "latch after the symbol edge: min %.1f us, mean %.1f us, max %.1f us, jitter %.1f us\n",
+                s.latMin_ns / 1e3, s.latMean_ns / 1e3, s.latMax_ns / 1e3, ( s.latMax_ns - s.latMin_ns ) / 1e3 );
+}
+
+
+int main( int argc, char *argv[] ) {
+    bool useEvalboard = true;
+    int verbose = 0;
+    bool stop = false;
+    bool query = false;
+    unsigned device = 0;
+    double ref = 25e6;
+    unsigned rCounter = 250;
+    double rate = 1000;
+    double shift = 0;
+    unsigned repeat = 1;
+    char *bitArg = nullptr;
+    char *inFile = nullptr;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "b:dD:F:hi:kn:qr:R:s:v" ) ) != -1 )
+        switch ( c ) {
+        case 'b': // bits as text
+            bitArg = optarg;
+            break;
+        case 'd': // dry run
+            useEvalboard = false;
+            break;
+        case 'D': // device
+            device = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'F': // FSK shift
+            shift = ADF4351::parseFreq( optarg );
+            break;
+        case 'i': // bits from file
+            inFile = optarg;
+            break;
+        case 'k': // stop keying
+            stop = true;
+            break;
+        case 'n': // passes
+            repeat = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'q': // status
+            query = true;
+            break;
+        case 'r': // reference
+            ref = ADF4351::parseFreq( optarg );
+            break;
+        case 'R': // R counter
+            rCounter = strtoul( optarg, nullptr, 0 );
+            break;
+        case 's': // symbol rate
+            rate = strtod( optarg, nullptr );
+            break;
+        case 'v': // increase verbosity
+            ++verbose;
+            break;
+        case 'h': // help
+            puts( "adf4351-key [-b BITS] [-d] [-D DEV] [-F SHIFT] [-h] [-i FILE] [-k] [-n COUNT] [-q] [-r REF]\n"
+                  "            [-R RCOUNTER] [-s RATE] [-v] FREQ\n"
+                  "  -b BITS    : symbols as text of '0' and '1', other characters are ignored\n"
+                  "  -d         : dry run, do not open the eval board\n"
+                  "  -D DEV     : eval board, 0 = first (default)\n"
+                  "  -F SHIFT   : 2-FSK, symbol 1 is FREQ + SHIFT (default OOK, symbol 1 is the carrier on)\n"
+                  "  -h         : show this help\n"
+                  "  -i FILE    : symbols from a binary file, MSB of the first byte first\n"
+                  "  -k         : stop keying, the output is left at the idle state\n"
+                  "  -n COUNT   : passes through the symbols, 0 = endless (default 1)\n"
+                  "  -q         : show the keying status\n"
+                  "  -r REF     : reference frequency (default 25 MHz)\n"
+                  "  -R RCOUNTER: R counter (default 250)\n"
+                  "  -s RATE    : symbols per second (default 1000)\n"
+                  "  -v         : increase verbosity\n"
+                  "  FREQ       : carrier like '-f' of adf4351-eval\n"
+                  "needs the STM32 FW, the symbols are clocked by a timer on the device" );
+            return 1;
+        case '?':
+            if ( optopt == 'D' || optopt == 'n' || optopt == 'R' || optopt == 's' )
+                fprintf( stderr, "option '-%c' requires a numeric argument.\n", optopt );
+            else if ( optopt == 'F' || optopt == 'r' )
+                fprintf( stderr, "option '-%c' requires a frequency argument.\n", optopt );
+            else if ( optopt == 'b' )
+                fprintf( stderr, "option '-b' requires a bit string.\n" );
+            else if ( optopt == 'i' )
+                fprintf( stderr, "option '-i' requires a file argument.\n" );
+            else if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c'.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+
+    EVAL eval;
+    if ( useEvalboard && !eval.init( device ) )
+        return 1;
+
+    if ( stop || query ) {
+        KeyStatus status;
+        if ( useEvalboard && stop && !eval.stopKeying() )
+            return 1;
+        if ( useEvalboard && query ) {
+            if ( !eval.getKeyStatus( status ) )
+                return 1;
+            printStatus( status );
+        }
+        return 0;
+    }
+
+    // symbols, one bit each, MSB first
+    std::vector< uint8_t > bits;
+    uint32_t symbols = 0;
+    if ( bitArg ) {
+        for ( const char *p = bitArg; *p; ++p ) {
+            if ( *p != '0' && *p != '1' )
+                continue;
+            if ( symbols % 8 == 0 )
+                bits.push_back( 0 );
+            if ( *p == '1' )
+                bits.back() |= 0x80 >> ( symbols % 8 );
+            ++symbols;
+        }
+    } else if ( inFile ) {
+        FILE *fp = fopen( inFile, "rb" );
+        if ( !fp ) {
+            perror( inFile );
+            return 1;
+        }
+        for ( int ch; ( ch = fgetc( fp ) ) != EOF; )
+            bits.push_back( uint8_t( ch ) );
+        fclose( fp );
+        symbols = 8 * bits.size();
+    }
+    if ( !symbols || symbols > EVAL::KEY_SYMBOLS_MAX ) {
+        fprintf( stderr, "%u symbols, 1 .. %u required ('-b' or '-i')\n", symbols, EVAL::KEY_SYMBOLS_MAX );
+        return 1;
+    }
+    if ( optind == argc ) {
+        fprintf( stderr, "adf4351-key: frequency required, '-h' shows the usage\n" );
+        return 1;
+    }
+    const double freq = ADF4351::parseFreq( argv[ optind ] );
+    if ( rate < 1 || ref < 1 || ref > 250e6 || repeat > 0xFFFF ) {
+        fprintf( stderr, "bad symbol rate, reference or count\n" );
+        return 1;
+    }
+
+    // registers of the carrier, FSK keeps MOD so that only R0 differs for the second frequency
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    cfg.ref_hz = uint32_t( llround( ref ) );
+    cfg.r_counter = rCounter;
+    if ( shift )
+        cfg.flags |= ADF435X_CFG_KEEP_MOD;
+    adf435x_params p;
+    adf435x_params_default( &p );
+    int err = adf435x_solve( &cfg, uint64_t( llround( freq ) ), &p );
+    if ( err != ADF435X_OK ) {
+        fprintf( stderr, "f = %.6f MHz: %s\n", freq / 1e6, adf435x_strerror( err ) );
+        return 1;
+    }
+    uint32_t reg[ 6 ];
+    adf435x_pack( &p, reg );
+
+    uint32_t word[ 2 ], idle;
+    if ( shift ) { // symbol 0: FREQ, symbol 1: FREQ + SHIFT
+        adf435x_params p1 = p;
+        uint32_t reg1[ 6 ];
+        err = adf435x_solve( &cfg, uint64_t( llround( freq + shift ) ), &p1 );
+        if ( err != ADF435X_OK ) {
+            fprintf( stderr, "f = %.6f MHz: %s\n", ( freq + shift ) / 1e6, adf435x_strerror( err ) );
+            return 1;
+        }
+        // one tone may be INT-N (FRAC = 0), both use the FRAC-N lock detect settings so that R2 is the same
+        p.ldf = p1.ldf = 0;
+        p.ldp = p1.ldp = 0;
+        adf435x_pack( &p, reg );
+        adf435x_pack( &p1, reg1 );
+        const unsigned differ = adf435x_changed( reg, reg1 ) & 0x3E;
+        if ( differ ) {
+            fprintf( stderr, "FSK shift %g kHz changes more than R0:", shift / 1e3 );
+            for ( int r = 1; r < 6; ++r )
+                if ( differ & 1 << r )
+                    fprintf( stderr, " R%d%s", r, r == 4 && p.rf_div_select != p1.rf_div_select ? " (RF divider)" : "" );
+            fprintf( stderr, ", use a smaller shift\n" );
+            return 1;
+        }
+        word[ 0 ] = idle = reg[ 0 ];
+        word[ 1 ] = reg1[ 0 ];
+        // every R0 starts the VCO band selection, the symbol must be longer
+        uint64_t num, den;
+        adf435x_pfd( &cfg, &num, &den );
+        const double bandSelect = 10.0 * p.band_select_clock_divider * den / num;
+        if ( rate * bandSelect > 1 )
+            fprintf( stderr, "warning: band selection after each R0 takes %.1f us, more than a symbol\n",
+                     bandSelect * 1e6 );
+    } else { // OOK: symbol 0 output off, symbol 1 on, off when done
+        p.output_enable = 0;
+        uint32_t off[ 6 ];
+        adf435x_pack( &p, off );
+        word[ 0 ] = idle = off[ 4 ];
+        word[ 1 ] = reg[ 4 ];
+        reg[ 4 ] = off[ 4 ]; // start dark
+    }
+    if ( verbose ) {
+        printf( "%s, %u symbols at %g symbols/s\n", shift ? "2-FSK" : "OOK", symbols, rate );
+        printf( "R5..R0:" );
+        for ( int r = 5; r >= 0; --r )
+            printf( " %08X", reg[ r ] );
+        printf( "\nsymbol 0: %08X, symbol 1: %08X, idle: %08X\n", word[ 0 ], word[ 1 ], idle );
+    }
+    if ( !useEvalboard )
+        return 0;
+
+    // all registers, the symbol buffer, then start; keying owns the register queue until it ends
+    adf435x_transport board = eval.transport();
+    if ( !eval.stopKeying() || adf435x_write_regs( &board, reg, 0x3F ) != ADF435X_OK ) {
+        fprintf( stderr, "error writing the registers\n" );
+        return 1;
+    }
+    if ( !eval.uploadSymbols( bits ) ||
+         !eval.startKeying( uint32_t( lround( rate ) ), symbols, word[ 0 ], word[ 1 ], idle, repeat ) ) {
+        fprintf( stderr, "error starting keying on device (STM32 FW required, rate <= ~34000 symbols/s)\n" );
+        return 1;
+    }
+
+    KeyStatus status;
+    if ( repeat ) { // wait for the end
+        const double duration = double( symbols ) * repeat / rate;
+        usleep( useconds_t( std::min( duration, 3600.0 ) * 1e6 ) );
+        do
+            if ( !eval.getKeyStatus( status ) )
+                return 1;
+        while ( status.active && usleep( 10000 ) == 0 );
+    } else if ( !eval.getKeyStatus( status ) )
+        return 1;
+    printStatus( status );
+    return 0;
+}
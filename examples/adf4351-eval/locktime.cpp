@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "locktime.h"
+#include "threadpool.h"
+
+
+// value with optional suffix p, n, u, m, k, M, G
+static double parseValue( const char *s ) {
+    char *end;
+    double v = strtod( s, &end );
+    switch ( *end ) {
+    case 'p':
+        return v * 1e-12;
+    case 'n':
+        return v * 1e-9;
+    case 'u':
+        return v * 1e-6;
+    case 'm':
+        return v * 1e-3;
+    case 'k':
+        return v * 1e3;
+    case 'M':
+        return v * 1e6;
+    case 'G':
+        return v * 1e9;
+    }
+    return v;
+}
+
+
+bool LoopFilter::load( const char *path ) {
+    FILE *fp = fopen( path, "r" );
+    if ( !fp )
+        return false;
+    struct {
+        const char *name;
+        double *value;
+    } keys[] = { { "C1", &C1 },     { "C2", &C2 },           { "R2", &R2 },         { "R2fast", &R2fast },
+                 { "Kvco", &Kvco }, { "vcoBand", &vcoBand }, { "tol", &tol_Hz } };
+    char line[ 256 ];
+    bool ok = true;
+    while ( fgets( line, sizeof( line ), fp ) ) {
+        line[ strcspn( line, "#\r\n" ) ] = 0; // strip comment and line end
+        char name[ 32 ], value[ 64 ];
+        if ( sscanf( line, " %31[^= \t] = %63s", name, value ) != 2 ) {
+            if ( strspn( line, " \t" ) != strlen( line ) ) { // not an empty line
+                fprintf( stderr, "%s: cannot parse '%s'\n", path, line );
+                ok = false;
+            }
+            continue;
+        }
+        bool found = false;
+        for ( auto &k : keys )
+            if ( !strcmp( name, k.name ) ) {
+                *k.value = parseValue( value );
+                found = true;
+            }
+        if ( !found ) {
+            fprintf( stderr, "%s: unknown parameter '%s'\n", path, name );
+            ok = false;
+        }
+    }
+    fclose( fp );
+    return ok;
+}
+
+
+LockTimeModel::LockTimeModel( const LoopFilter &filter, uint32_t refIn ) : filter{ filter }, refIn{ refIn } {}
+
+
+// Upper bound of the frequency error of a 2nd order type 2 loop after a frequency step,
+// relative to the step: E(s) = s / ( s^2 + 2 zeta wn s + wn^2 ).
+// zeta < 1: e^( -zeta wn t ) * min( 1 / sqrt( 1 - zeta^2 ), 1 + zeta wn t )
+// zeta > 1: max( e^( -p2 t ), ( k - 1 ) / 2 * e^( -p1 t ) ), poles p1 < p2, k = zeta / sqrt( zeta^2 - 1 )
+static double envelope( double wn, double zeta, double t ) {
+    double x = zeta * wn * t;
+    if ( zeta <= 1 ) {
+        double A = zeta < 1 ? 1 / std::sqrt( 1 - zeta * zeta ) : std::numeric_limits< double >::infinity();
+        return std::exp( -x ) * std::fmin( A, 1 + x );
+    }
+    double r = std::sqrt( zeta * zeta - 1 );
+    double p1 = wn * ( zeta - r ), p2 = wn * ( zeta + r );
+    return std::fmax( std::exp( -p2 * t ), ( zeta / r - 1 ) / 2 * std::exp( -p1 * t ) );
+}
+
+
+// time until the error envelope stays below delta, the envelope is monotonic
+static double settleTime( double wn, double zeta, double delta ) {
+    if ( delta >= 1 || wn <= 0 )
+        return 0;
+    double lo = 0, hi = 1 / wn;
+    while ( envelope( wn, zeta, hi ) > delta && hi < 1e3 )
+        hi *= 2;
+    for ( int iii = 0; iii < 40; ++iii ) { // relative resolution < 1e-9 of hi
+        double mid = ( lo + hi ) / 2;
+        if ( envelope( wn, zeta, mid ) > delta )
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+
+// RF divider select for the output frequency, VCO = f * 2^RFDiv >= 2.2 GHz
+static unsigned rfDiv( double f ) {
+    unsigned d = 0;
+    while ( d < 6 && f * ( 1 << d ) < 2.2e9 )
+        ++d;
+    return d;
+}
+
+
+static double pfd( const uint32_t reg[ 6 ], uint32_t refIn ) {
+    uint32_t R = ( reg[ 2 ] >> 14 ) & 0x3FF;
+    if ( !R )
+        return 0;
+    return double( refIn ) * ( 1 + ( ( reg[ 2 ] >> 25 ) & 1 ) ) / ( R * ( 1 + ( ( reg[ 2 ] >> 24 ) & 1 ) ) );
+}
+
+
+static double nValue( const uint32_t reg[ 6 ] ) {
+    uint32_t MOD = ( reg[ 1 ] >> 3 ) & 0xFFF;
+    uint32_t FRAC = ( reg[ 0 ] >> 3 ) & 0xFFF;
+    return ( ( reg[ 0 ] >> 15 ) & 0xFFFF ) + ( MOD ? double( FRAC ) / MOD : 0 );
+}
+
+
+double LockTimeModel::frequency( const uint32_t reg[ 6 ] ) const {
+    double f = nValue( reg ) * pfd( reg, refIn );
+    if ( ( reg[ 4 ] >> 23 ) & 1 ) // fundamental feedback, N counts the VCO
+        f /= 1 << ( ( reg[ 4 ] >> 20 ) & 7 );
+    return f;
+}
+
+
+LockTime LockTimeModel::predict( const uint32_t reg[ 6 ], uint64_t from_Hz ) const {
+    LockTime lt;
+    const double fPFD = pfd( reg, refIn );
+    const double N = nValue( reg );
+    if ( fPFD <= 0 || N <= 0 )
+        return lt;
+    const unsigned RFDiv = ( reg[ 4 ] >> 20 ) & 7;
+    const bool fundamental = ( reg[ 4 ] >> 23 ) & 1;
+    const double f = frequency( reg );
+
+    // band select on every R0 write
+    uint32_t bandSelClkDiv = ( reg[ 4 ] >> 12 ) & 0xFF;
+    lt.bandSelect_s = BAND_SELECT_CYCLES * ( bandSelClkDiv ? bandSelClkDiv : 1 ) / fPFD;
+
+    // residual VCO step after band select, the tolerance relative to it
+    const double vco = f * ( 1 << RFDiv );
+    double step = filter.vcoBand / 2;
+    if ( from_Hz )
+        step = std::fmin( step, std::fabs( vco - double( from_Hz ) * ( 1 << rfDiv( double( from_Hz ) ) ) ) );
+    const double delta = step > 0 ? filter.tol_Hz * ( 1 << RFDiv ) / step : 1;
+
+    // loop dynamics with the normal and the fast lock CP current
+    const double Kvco = filter.Kvco * 2 * M_PI / ( fundamental ? 1 : 1 << RFDiv ); // rad/s/V at the feedback
+    const double C = filter.C1 + filter.C2;
+    const double Icp = ( ( ( reg[ 2 ] >> 9 ) & 0xF ) + 1 ) * CP_CURRENT_LSB;
+    const double wn = std::sqrt( Icp / ( 2 * M_PI ) * Kvco / ( N * C ) );
+    const double zeta = filter.R2 * filter.C2 * wn / 2;
+    lt.loopBW_Hz = wn / ( 2 * M_PI );
+    lt.damping = zeta;
+
+    const uint32_t clkDivMode = ( reg[ 3 ] >> 15 ) & 3;
+    const double fastTime = ( ( reg[ 3 ] >> 3 ) & 0xFFF ) / fPFD;
+    if ( clkDivMode == 1 && fastTime > 0 ) { // fast lock
+        const double IcpFast = 16 * CP_CURRENT_LSB;
+        const double R2fast = filter.R2fast > 0 ? filter.R2fast : filter.R2 * std::sqrt( Icp / IcpFast );
+        const double wnFast = wn * std::sqrt( IcpFast / Icp );
+        const double zetaFast = R2fast * filter.C2 * wnFast / 2;
+        const double tFast = settleTime( wnFast, zetaFast, delta );
+        if ( tFast <= fastTime )
+            lt.settle_s = tFast;
+        else // continue with the normal loop from the remaining error
+            lt.settle_s = fastTime + settleTime( wn, zeta, delta / envelope( wnFast, zetaFast, fastTime ) );
+    } else
+        lt.settle_s = settleTime( wn, zeta, delta );
+
+    const bool LDF_INT = ( reg[ 2 ] >> 8 ) & 1;
+    lt.lockDetect_s = ( LDF_INT ? 5 : 40 ) / fPFD;
+    lt.total_s = lt.bandSelect_s + lt.settle_s + lt.lockDetect_s;
+    return lt;
+}
+
+
+std::vector< LockTime > LockTimeModel::predict( const std::vector< LockHop > &hops ) const {
+    std::vector< LockTime > result( hops.size() );
+    for ( size_t iii = 0; iii < hops.size(); ++iii )
+        result[ iii ] = predict( hops[ iii ].reg, hops[ iii ].from_Hz );
+    return result;
+}
+
+
+std::vector< LockTime > LockTimeModel::tune( std::vector< LockHop > &hops, unsigned nThreads ) const {
+    std::vector< LockTime > result( hops.size() );
+    ThreadPool pool( nThreads );
+    pool.parallelFor( 0, hops.size(), 64, [ & ]( size_t first, size_t last ) {
+        for ( size_t iii = first; iii < last; ++iii )
+            result[ iii ] = tune( hops[ iii ].reg, hops[ iii ].from_Hz );
+    } );
+    return result;
+}
+
+
+LockTime LockTimeModel::tune( uint32_t reg[ 6 ], uint64_t from_Hz ) const {
+    const double fPFD = pfd( reg, refIn );
+    if ( fPFD <= 0 )
+        return LockTime();
+    // band select clock settings: mode low <= 125 kHz, mode high <= 500 kHz
+    uint32_t bsDiv[ 2 ] = { uint32_t( std::ceil( fPFD / BAND_SELECT_CLK_MAX ) ),
+                            uint32_t( std::ceil( fPFD / BAND_SELECT_CLK_MAX_HIGH ) ) };
+    uint32_t best[ 16 ][ 6 ];
+    LockTime bestTime[ 16 ];
+    double fastest = std::numeric_limits< double >::infinity();
+    for ( uint32_t cp = 0; cp < 16; ++cp ) {
+        bestTime[ cp ].total_s = std::numeric_limits< double >::infinity();
+        uint32_t r[ 6 ];
+        memcpy( r, reg, sizeof( r ) );
+        r[ 2 ] = ( r[ 2 ] & ~( 0xFUL << 9 ) ) | cp << 9;
+        for ( int high = 0; high <= 1; ++high ) {
+            if ( bsDiv[ high ] > 255 )
+                continue;
+            if ( bsDiv[ high ] < 1 )
+                bsDiv[ high ] = 1;
+            r[ 4 ] = ( r[ 4 ] & ~( 0xFFUL << 12 ) ) | bsDiv[ high ] << 12;
+            for ( int fast = 0; fast <= 1; ++fast ) {
+                r[ 3 ] = ( reg[ 3 ] & ~( 1UL << 23 ) ) | uint32_t( high ) << 23;
+                if ( fast ) // stay in fast lock mode until the loop has settled there
+                    r[ 3 ] = ( r[ 3 ] & ~( 3UL << 15 ) ) | 1UL << 15 | 0xFFFUL << 3;
+                else if ( ( ( r[ 3 ] >> 15 ) & 3 ) == 1 ) // fast lock off, keep resync mode
+                    r[ 3 ] &= ~( 3UL << 15 );
+                if ( fast ) {
+                    LockTime lt = predict( r, from_Hz );
+                    uint32_t clkDiv = uint32_t( std::ceil( lt.settle_s * fPFD ) );
+                    r[ 3 ] = ( r[ 3 ] & ~( 0xFFFUL << 3 ) ) | ( clkDiv < 1 ? 1 : clkDiv > 4095 ? 4095 : clkDiv ) << 3;
+                }
+                LockTime lt = predict( r, from_Hz );
+                if ( lt.total_s < bestTime[ cp ].total_s ) {
+                    bestTime[ cp ] = lt;
+                    memcpy( best[ cp ], r, sizeof( r ) );
+                }
+            }
+        }
+        if ( bestTime[ cp ].total_s < fastest )
+            fastest = bestTime[ cp ].total_s;
+    }
+    for ( uint32_t cp = 0; cp < 16; ++cp )
+        if ( bestTime[ cp ].total_s <= fastest * 1.01 ) {
+            memcpy( reg, best[ cp ], sizeof( best[ cp ] ) );
+            return bestTime[ cp ];
+        }
+    return LockTime();
+}
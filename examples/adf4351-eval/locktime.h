@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Passive 2nd order loop filter between CP and VTUNE: C1 || ( R2 + C2 ).
+// A third pole (R3, C3) is usually far outside the loop bandwidth and is neglected.
+// The default values are an example for ~20 kHz bandwidth at 2.5 mA and N = 128.
+struct LoopFilter {
+    double C1 = 3.9e-9;    // F
+    double C2 = 47e-9;     // F
+    double R2 = 240;       // Ohm
+    double R2fast = 0;     // R2 while SW is closed in fast lock mode, 0: R2 * sqrt( Icp / 5 mA ) keeps the damping
+    double Kvco = 40e6;    // VCO sensitivity in Hz/V
+    double vcoBand = 20e6; // VCO band spacing, the residual step after band select is at most half of it
+    double tol_Hz = 1e3;   // settled when the output frequency error is below tol_Hz
+
+    // read "name = value" lines, value may have a suffix p, n, u, m, k, M, G; '#' starts a comment
+    bool load( const char *path );
+};
+
+
+struct LockTime {
+    double bandSelect_s = 0; // VCO band selection
+    double settle_s = 0;     // loop settling to LoopFilter::tol_Hz
+    double lockDetect_s = 0; // consecutive PFD cycles until lock detect
+    double total_s = 0;
+    double loopBW_Hz = 0; // natural frequency of the loop with the normal CP current
+    double damping = 0;
+};
+
+
+// one hop from the frequency from_Hz to the frequency programmed by reg
+struct LockHop {
+    uint32_t reg[ 6 ];
+    uint64_t from_Hz;
+};
+
+
+// Lock time prediction from a register set and the hop size.
+// The loop is approximated as 2nd order type 2 system with
+//   wn = sqrt( Icp * Kvco / ( N * ( C1 + C2 ) ) ), damping = R2 * C2 * wn / 2
+// with Icp from the CP current setting (RSET = 5.1 kOhm), N = INT + FRAC / MOD and Kvco
+// divided by the RF divider with divided feedback.
+// - band select: 10 cycles of fPFD / band select clock divider on every R0 write,
+//   VTUNE starts from mid rail, the residual step is min( VCO step, vcoBand / 2 )
+// - settling: envelope of the step response until the error is below tol_Hz,
+//   in fast lock mode (CLK_DIV_MODE 1) the first clkDiv / fPFD seconds run with
+//   maximum CP current (5 mA) and R2fast
+// - lock detect: 40 PFD cycles (LDF FRAC) or 5 PFD cycles (LDF INT)
+// ABP and CSR are not modelled, they act on the dead zone and cycle slips, not on the loop dynamics.
+class LockTimeModel {
+  public:
+    LockTimeModel( const LoopFilter &filter = LoopFilter(), uint32_t refIn = 25000000 );
+
+    LockTime predict( const uint32_t reg[ 6 ], uint64_t from_Hz ) const;
+    std::vector< LockTime > predict( const std::vector< LockHop > &hops ) const;
+    // modify CP current, fast lock timer and band select clock in reg for the shortest lock time,
+    // keeps the lowest CP current within 1 % of the best time
+    LockTime tune( uint32_t reg[ 6 ], uint64_t from_Hz ) const;
+    // tune all hops on a thread pool (nThreads = 0: all cores)
+    std::vector< LockTime > tune( std::vector< LockHop > &hops, unsigned nThreads = 0 ) const;
+
+    // output frequency programmed by reg
+    double frequency( const uint32_t reg[ 6 ] ) const;
+    const LoopFilter &getFilter() const { return filter; };
+
+    static constexpr double BAND_SELECT_CYCLES = 10;
+    static constexpr double BAND_SELECT_CLK_MAX = 125e3;      // band select clock mode low
+    static constexpr double BAND_SELECT_CLK_MAX_HIGH = 500e3; // band select clock mode high
+    static constexpr double CP_CURRENT_LSB = 0.3125e-3;       // A, RSET = 5.1 kOhm
+
+  private:
+    LoopFilter filter;
+    uint32_t refIn;
+};
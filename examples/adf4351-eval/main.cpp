@@ -4,24 +4,125 @@
 // Copyright (c) Martin Homuth-Rosemann 2024
 //
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <ctype.h>
+#include <memory>
+#include <string>
 #include <unistd.h>
+#include <vector>
 
 #include "adf4351.h"
+#include "adf435x.h"
 #include "eval.h"
+#include "shard.h"
+#include "trace.h"
+
+
+static ShardedSweep *runningSweep = nullptr;
+// points of a host sweep or '-V', their registers are calculated in advance (32 byte per point)
+static const size_t HOST_POINTS_MAX = 1000000;
+
+static void stopSweep( int ) {
+    if ( runningSweep )
+        runningSweep->stop();
+}
+
+
+// '-V': tune every point with MUXOUT = N divider output and let the FX2 FW count it,
+// locked and settled it runs at the PFD frequency, a wrong band or a missing lock shows up
+static int verifyPoints( EVAL &eval, ADF4351 &adf, const std::vector< double > &freqs, unsigned gate_ms,
+                         uint32_t dwell_us, int verbose ) {
+    const uint32_t muxMask = 7u << 26, muxNdiv = 4u << 26, muxLock = 6u << 26;
+    adf435x_transport board = eval.transport();
+    uint32_t last[ 6 ] = { 0, 0, 0, 0, 0, 0 };
+    unsigned failed = 0;
+    // refuse points that the counter cannot follow instead of reporting false mismatches
+    for ( double freq : freqs ) {
+        adf.calculateFreq( freq );
+        uint32_t reg[ 6 ];
+        for ( int r = 0; r < 6; ++r )
+            reg[ r ] = adf.getReg( r );
+        adf435x_params p;
+        adf435x_output o;
+        adf435x_decode( adf.getRefIn(), reg, &p, &o );
+        if ( o.pfd_hz > EVAL::COUNT_MAX_HZ ) {
+            fprintf( stderr, "%.6f MHz: PFD %.3f kHz is above the MUXOUT counter limit of %.0f kHz\n", freq / 1e6,
+                     o.pfd_hz / 1e3, EVAL::COUNT_MAX_HZ / 1e3 );
+            return 1;
+        }
+    }
+    const uint64_t start = Trace::now();
+    for ( size_t iii = 0; iii < freqs.size(); ++iii ) {
+        adf.calculateFreq( freqs[ iii ] );
+        uint32_t reg[ 6 ];
+        for ( int r = 0; r < 6; ++r )
+            reg[ r ] = adf.getReg( r );
+        reg[ 2 ] = ( reg[ 2 ] & ~muxMask ) | muxNdiv;
+        const uint8_t mask = iii ? ( adf435x_changed( last, reg ) | 1 ) : 0x3F;
+        if ( adf435x_write_regs( &board, reg, mask ) != ADF435X_OK ) {
+            fprintf( stderr, "error writing the registers\n" );
+            return 1;
+        }
+        memcpy( last, reg, sizeof( last ) );
+        usleep( dwell_us );
+        adf435x_params p;
+        adf435x_output o;
+        adf435x_decode( adf.getRefIn(), reg, &p, &o );
+        double counted;
+        if ( !eval.countMux( gate_ms, counted ) ) {
+            fprintf( stderr, "MUXOUT counter not available (FX2 FW 0.4.6 or later required)\n" );
+            return 1;
+        }
+        // +-1 count at each end of the gate, at least 0.1 %
+        const double tolerance = std::max( 1e-3 * o.pfd_hz, 2e3 / gate_ms );
+        const bool ok = fabs( counted - o.pfd_hz ) <= tolerance;
+        if ( !ok )
+            ++failed;
+        if ( !ok || verbose )
+            printf( "%.6f MHz: N divider %.3f kHz, expected %.3f kHz%s\n", freqs[ iii ] / 1e6, counted / 1e3,
+                    o.pfd_hz / 1e3, ok ? "" : " MISMATCH" );
+    }
+    // back to lock detect, so that '-l' and the lock events work again
+    last[ 2 ] = ( last[ 2 ] & ~muxMask ) | muxLock;
+    if ( adf435x_write_regs( &board, last, 0x05 ) != ADF435X_OK ) {
+        fprintf( stderr, "error writing the registers\n" );
+        return 1;
+    }
+    printf( "%zu points verified in %.3f s, %u mismatch%s\n", freqs.size(), ( Trace::now() - start ) / 1e9, failed,
+            failed == 1 ? "" : "es" );
+    return failed ? 2 : 0;
+}
 
 
 int main( int argc, char *argv[] ) {
 
     bool useEvalboard = true;
+    bool writeAll = false;
+    bool queryState = false;
     int verbose = 0;
     bool reportLock = false;
+    bool onDevice = false;
     char *rarg = nullptr;
     char *farg = nullptr;
+    char *sarg = nullptr;
+    char *traceFile = nullptr;
+    bool traceSummary = false;
+    char *pointFile = nullptr;
+    bool realtime = false;
+    int cpu = -1;
+    std::vector< unsigned > devices;
+    ShardedSweep::Mode shardMode = ShardedSweep::INTERLEAVE;
+    char *recordFile = nullptr;
+    uint32_t dwell_us = 1000;
+    unsigned verifyGate = 0;
+    uint16_t repeat = 0;
     uint32_t regValue;
     uint32_t regs[ 6 ] = { 7, 7, 7, 7, 7, 7 };
     int regnum = 0;
@@ -30,17 +131,45 @@ int main( int argc, char *argv[] ) {
 
     ADF4351 adf;
 
-    while ( ( c = getopt( argc, argv, "df:hlr:v" ) ) != -1 )
+    while ( ( c = getopt( argc, argv, "Ac:dD:f:Fhj:ln:oqr:R:s:S:tT:vV:w:" ) ) != -1 )
         switch ( c ) {
+        case 'A': // write all registers
+            writeAll = true;
+            break;
+        case 'c': // pin host sweep to CPU
+            cpu = strtol( optarg, nullptr, 0 );
+            break;
         case 'd': // dry run
             useEvalboard = false;
             break;
+        case 'D': { // device index or list
+            char *next = optarg;
+            do
+                devices.push_back( strtoul( next, &next, 0 ) );
+            while ( *next++ == ',' );
+            break;
+        }
         case 'f': // set frequency
             farg = optarg;
             break;
+        case 'F': // host sweep with SCHED_FIFO
+            realtime = true;
+            break;
+        case 'j': // host sweep timestamps
+            pointFile = optarg;
+            break;
         case 'l': // report lock detect status
             reportLock = true;
             break;
+        case 'n': // number of sweeps
+            repeat = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'o': // calculate on device
+            onDevice = true;
+            break;
+        case 'q': // query device state
+            queryState = true;
+            break;
         case 'r': // set individual register
             rarg = optarg;
             if ( regnum >= 6 ) {
@@ -54,23 +183,83 @@ int main( int argc, char *argv[] ) {
             }
             regs[ regnum++ ] = regValue;
             break;
+        case 'R': // record register stream
+            recordFile = optarg;
+            break;
+        case 's': // sweep
+            sarg = optarg;
+            break;
+        case 'S': // shard mode
+            if ( !strcmp( optarg, "band" ) )
+                shardMode = ShardedSweep::BAND;
+            else if ( !strcmp( optarg, "interleave" ) )
+                shardMode = ShardedSweep::INTERLEAVE;
+            else {
+                fprintf( stderr, "unknown shard mode '%s'\n", optarg );
+                return 1;
+            }
+            break;
+        case 't': // USB latency summary
+            traceSummary = true;
+            break;
+        case 'T': // USB trace events
+            traceFile = optarg;
+            break;
         case 'v': // increase verbosity
             ++verbose;
             break;
+        case 'V': // verify the points with the MUXOUT counter
+            verifyGate = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'w': // sweep dwell time
+            dwell_us = strtoul( optarg, nullptr, 0 );
+            break;
         case 'h': // help
-            puts( "adf4351eval [-f FREQ] [-h] [-v]\n"
+            puts( "adf4351eval [-A] [-c CPU] [-d] [-D DEV,...] [-f FREQ] [-F] [-h] [-j FILE] [-l] [-n COUNT] [-o] [-q]\n"
+                  "            [-r REG] [-R FILE] [-s START,STOP,STEP] [-S MODE] [-t] [-T FILE] [-v] [-V GATE]\n"
+                  "            [-w DWELL]\n"
+                  "  -A      : '-f' writes all registers, also those the device state reports as unchanged\n"
+                  "  -c CPU  : host sweep: pin to CPU (board n to CPU + n)\n"
                   "  -d      : dry run, do not set adf4351 register\n"
+                  "  -D DEV  : use eval board number DEV if more than one is connected (default 0),\n"
+                  "            host sweep: a list DEV,DEV,... shares the sweep between the boards\n"
                   "  -f FREQ : set frequency (float value with optional suffix 'k', 'M', 'G')\n"
+                  "  -F      : host sweep: real time scheduling (SCHED_FIFO)\n"
                   "  -h      : show this help\n"
+                  "  -j FILE : host sweep: write planned and actual time of every point to FILE,\n"
+                  "            all boards in time order with board and frequency, the last 2^20 per board\n"
                   "  -l      : report lock detect status\n"
+                  "  -n COUNT: number of sweeps, 0 = endless (default)\n"
+                  "  -o      : calculate the registers on the device (STM32 firmware)\n"
+                  "  -q      : show the device state: registers, init type, lock status, counters (FX2 FW 0.4.3)\n"
                   "  -r REG  : set register hex value (can be repeated up to 6 times)\n"
-                  "  -v      : increase verbosity" );
+                  "  -R FILE : record all register writes to FILE for adf4351-replay (FILE.DEV per board)\n"
+                  "  -s START,STOP,STEP : sweep, frequencies like '-f', generated by the device with '-o',\n"
+                  "            the host sweep and '-V' calculate all points in advance, at most 1000000\n"
+                  "  -S MODE : host sweep on several boards: 'interleave' (default) every n-th point per board,\n"
+                  "            'band' a contiguous part per board; a new point every DWELL / boards\n"
+                  "  -t      : show USB latency summary at exit\n"
+                  "  -T FILE : write all USB transfers with timestamps to FILE\n"
+                  "  -v      : increase verbosity\n"
+                  "  -V GATE : verify '-f' or every '-s' point: MUXOUT = N divider is counted by the FX2 FW\n"
+                  "            for GATE ms (1 .. 1000) after DWELL and compared to the PFD (FX2 FW 0.4.6),\n"
+                  "            the FW polls MUXOUT, PFD up to 250 kHz (R counter 250: 100 kHz), higher is refused,\n"
+                  "            MUXOUT is set back to lock detect at the end, exit code 2 on a mismatch\n"
+                  "  -w DWELL: sweep dwell time per step and board in us (default 1000)" );
             return 1;
         case '?':
-            if ( optopt == 'f' )
-                fprintf( stderr, "option '-f' requires a frequency argument.\n" );
-            if ( optopt == 'r' )
+            if ( optopt == 'c' || optopt == 'D' )
+                fprintf( stderr, "option '-%c' requires a number.\n", optopt );
+            else if ( optopt == 'S' )
+                fprintf( stderr, "option '-S' requires 'interleave' or 'band'.\n" );
+            else if ( optopt == 'f' || optopt == 's' )
+                fprintf( stderr, "option '-%c' requires a frequency argument.\n", optopt );
+            else if ( optopt == 'n' || optopt == 'w' || optopt == 'V' )
+                fprintf( stderr, "option '-%c' requires a numeric argument.\n", optopt );
+            else if ( optopt == 'r' )
                 fprintf( stderr, "option '-r' requires a register argument.\n" );
+            else if ( optopt == 'T' || optopt == 'j' || optopt == 'R' )
+                fprintf( stderr, "option '-%c' requires a file argument.\n", optopt );
             else if ( isprint( optopt ) )
                 fprintf( stderr, "unknown option '-%c'.\n", optopt );
             else
@@ -80,27 +269,26 @@ int main( int argc, char *argv[] ) {
             return 1;
         }
 
+    if ( ( traceSummary || traceFile ) && !Trace::enabled )
+        fprintf( stderr, "USB tracing not compiled in, ignoring '-t' and '-T'\n" );
+    if ( traceFile && !Trace::tracer().startDump( traceFile ) )
+        return 1;
+    // stop the trace dump and show the summary on every return path
+    struct TraceReport {
+        bool summary;
+        ~TraceReport() {
+            Trace::tracer().stopDump();
+            if ( summary && Trace::enabled )
+                Trace::tracer().summary( stderr );
+        }
+    } traceReport{ traceSummary };
+
+    double freq = 0;
     if ( rarg && farg ) // register overrides frequency
         fprintf( stderr, "register value(s) given, ignoring frequency argument '-f%s'\n", farg );
     else if ( farg ) {
         // argument -f frequency (double value with optional suffix 'k', 'M', 'G')
-        double freq = 0;
-        char *suffix;
-        freq = strtod( farg, &suffix );
-        if ( freq ) {
-            if ( *suffix == 'k' )
-                freq *= 1e3;
-            else if ( *suffix == 'M' )
-                freq *= 1e6;
-            else if ( *suffix == 'G' )
-                freq *= 1e9;
-            else if ( freq <= 5 ) // GHz
-                freq *= 1e9;
-            else if ( freq <= 5000 ) // MHz
-                freq *= 1e6;
-            else if ( freq < 5000000 ) // kHz
-                freq *= 1e3;
-        }
+        freq = ADF4351::parseFreq( farg );
 
         if ( verbose )
             printf( "f = %g MHz\n", freq / 1e6 );
@@ -121,16 +309,159 @@ int main( int argc, char *argv[] ) {
         regnum = 6; // transfer all 6 register to the eval board
     }
 
-    // USB interface to the ADF4351 eval board registers
-    EVAL eval{};
-    if ( useEvalboard )
-        useEvalboard = eval.init();
+    // argument -s start,stop,step
+    double sweep[ 3 ] = { 0, 0, 0 };
+    if ( sarg ) {
+        char *next = sarg;
+        for ( int iii = 0; iii < 3; ++iii ) {
+            sweep[ iii ] = ADF4351::parseFreq( next, &next );
+            if ( iii < 2 && *next++ != ',' )
+                break;
+        }
+        if ( sweep[ 0 ] < 33000000 || sweep[ 1 ] > 4500000000 || sweep[ 0 ] > sweep[ 1 ] || sweep[ 2 ] < 1 ) {
+            fprintf( stderr, "bad sweep argument '-s%s'\n", sarg );
+            return 1;
+        }
+        if ( verbose )
+            printf( "sweep %g MHz ... %g MHz, step %g kHz, dwell %u us\n", sweep[ 0 ] / 1e6, sweep[ 1 ] / 1e6,
+                    sweep[ 2 ] / 1e3, dwell_us );
+        regnum = 0;
+    }
+
+    if ( devices.empty() )
+        devices.push_back( 0 );
+    const bool hostSweep = sarg && !onDevice;
+    const double nSweep = sarg ? std::floor( ( sweep[ 1 ] - sweep[ 0 ] ) / sweep[ 2 ] ) + 1 : 0;
+    if ( ( hostSweep || verifyGate ) && nSweep > HOST_POINTS_MAX ) {
+        fprintf( stderr, "%.0f sweep points, the host sweep and '-V' allow %zu, use a larger step or '-o'\n", nSweep,
+                 HOST_POINTS_MAX );
+        return 1;
+    }
+    const size_t nPoints = size_t( nSweep );
+    if ( devices.size() > 1 && !hostSweep ) {
+        fprintf( stderr, "several boards are used by the host sweep only, using board %u\n", devices[ 0 ] );
+        devices.resize( 1 );
+    }
+
+    // USB interface to the ADF4351 eval board registers, the first one for all but the host sweep
+    std::vector< std::unique_ptr< EVAL > > evals;
+    for ( unsigned index : devices ) {
+        evals.emplace_back( new EVAL );
+        if ( !useEvalboard )
+            continue;
+        if ( !evals.back()->init( index ) ) {
+            if ( devices.size() > 1 ) // no dry run fallback for a sharded sweep
+                return 1;
+            useEvalboard = false;
+            break;
+        }
+        if ( recordFile ) {
+            std::string path = devices.size() > 1 ? std::string( recordFile ) + "." + std::to_string( index ) : recordFile;
+            if ( !evals.back()->record( path.c_str() ) )
+                return 1;
+        }
+    }
+    EVAL &eval = *evals[ 0 ];
+
+    if ( verifyGate ) {
+        if ( ( !sarg && !farg ) || rarg || verifyGate > 1000 || ( farg && !sarg && !freq ) ) {
+            fprintf( stderr, "'-V' verifies '-f' or '-s' with a gate time of 1 .. 1000 ms\n" );
+            return 1;
+        }
+        if ( !useEvalboard ) {
+            fprintf( stderr, "'-V' needs the eval board\n" );
+            return 1;
+        }
+        std::vector< double > freqs;
+        if ( sarg ) {
+            for ( size_t iii = 0; iii < nPoints; ++iii )
+                freqs.push_back( sweep[ 0 ] + iii * sweep[ 2 ] );
+        } else if ( freq )
+            freqs.push_back( freq );
+        return verifyPoints( eval, adf, freqs, verifyGate, dwell_us, verbose );
+    }
+
+    if ( hostSweep ) { // host sweep, one retune per dwell time and board
+        // registers of all points are calculated before the sweep starts
+        std::vector< std::array< uint32_t, 6 > > plan( nPoints );
+        std::vector< double > freqs( nPoints );
+        for ( size_t iii = 0; iii < nPoints; ++iii ) {
+            freqs[ iii ] = sweep[ 0 ] + iii * sweep[ 2 ];
+            adf.calculateFreq( freqs[ iii ] );
+            for ( int reg = 0; reg < 6; ++reg )
+                plan[ iii ][ reg ] = adf.getReg( reg );
+        }
+        std::vector< adf435x_transport > boards;
+        for ( auto &board : evals )
+            if ( useEvalboard )
+                boards.push_back( board->transport() );
+            else { // dry run, the writes take no time
+                adf435x_transport dry = { nullptr, []( void *, uint32_t ) { return 0; }, nullptr };
+                boards.push_back( dry );
+            }
+        ShardedSweep sharded( boards, plan, freqs, shardMode, uint64_t( dwell_us ) * 1000 );
+        if ( cpu >= 0 )
+            sharded.pinCPU( cpu );
+        if ( realtime )
+            sharded.realtime();
+        sharded.keepPoints( pointFile != nullptr );
+        runningSweep = &sharded;
+        signal( SIGINT, stopSweep );
+        bool ok = sharded.run( repeat );
+        signal( SIGINT, SIG_DFL );
+        runningSweep = nullptr;
+        sharded.summary( stdout );
+        if ( pointFile && !sharded.writePoints( pointFile ) )
+            return 1;
+        return ok ? 0 : 1;
+    }
+
+    if ( sarg ) {
+        if ( useEvalboard && !eval.startSweep( uint64_t( sweep[ 0 ] + 0.5 ), uint64_t( sweep[ 1 ] + 0.5 ),
+                                               uint32_t( sweep[ 2 ] + 0.5 ), dwell_us, repeat ) ) {
+            fprintf( stderr, "error starting sweep on device\n" );
+            return 1;
+        }
+        return 0;
+    }
+
+    if ( onDevice && farg && !rarg ) { // let the device do the calculation
+        if ( useEvalboard && !eval.setFreq( uint64_t( freq + 0.5 ) ) ) {
+            fprintf( stderr, "error setting frequency on device\n" );
+            return 1;
+        }
+        regnum = 0; // nothing left to transfer
+    }
+
+    // the device state tells which registers the chip runs already, '-f' sends only the changed ones
+    // and R0, as it latches the double buffered fields; older FW stalls the request, all are sent
+    DeviceState state;
+    bool stateRead = useEvalboard && ( queryState || ( farg && !rarg && !writeAll ) ) && eval.getState( state );
+    uint8_t unchanged = 0;
+    if ( stateRead && farg && !rarg && !writeAll && regnum == 6 && state.regsKnown() ) {
+        for ( int iii = 0; iii < 6; ++iii )
+            if ( state.reg[ regs[ iii ] & 0b111 ] == regs[ iii ] )
+                unchanged |= 1 << ( regs[ iii ] & 0b111 );
+        if ( unchanged != 0x3F )
+            unchanged &= ~1;
+        if ( verbose )
+            printf( "device state: %d of 6 registers unchanged\n", __builtin_popcount( unchanged ) );
+    }
+
+    // '-l': drop the status messages from before the writes (FX2 FW 0.4.4)
+    const bool lockDetect = reportLock && useEvalboard && adf.getReg( 2, 3, 26 ) == 6; // muxout = digital lock detect
+    StatusMessage status;
+    if ( lockDetect )
+        while ( eval.waitStatus( status, 1 ) )
+            ;
 
     uint32_t *rp = regs;
     while ( regnum-- ) {
         regValue = *rp++;
         int ctrl = regValue & 0b111; // ctrl bits = n -> Rn
         if ( ctrl < 6 ) {            // register value is valid R0..R5
+            if ( unchanged & ( 1 << ctrl ) )
+                continue;
             if ( useEvalboard && 4 != eval.sendReg( regValue ) ) {
                 fprintf( stderr, "error writing register R%d\n", ctrl );
                 break;
@@ -140,11 +471,41 @@ int main( int argc, char *argv[] ) {
         }
     }
 
+    // argument "-q" -> show the state before the writes above
+    if ( queryState ) {
+        if ( !stateRead ) {
+            fprintf( stderr, "device state not available (FX2 FW 0.4.3 or later required)\n" );
+            return 1;
+        }
+        static const char *initName[] = { "never", "stand-alone", "always" };
+        for ( int reg = 0; reg < 6; ++reg )
+            printf( "R%d: 0x%08X%s\n", reg, state.reg[ reg ],
+                    state.written & ( 1 << reg ) ? "" : " (not written since power-on)" );
+        printf( "init type: %s\n", state.initType < 3 ? initName[ state.initType ] : "?" );
+        printf( "MUXOUT: %u, lock events: %u\n", state.mux, state.events );
+        printf( "register writes: %u, R0 writes: %u, FW time: %.6f s\n", state.regWrites, state.r0Writes,
+                state.ticks / 4e6 );
+    }
+
     // argument "-l" -> show lock status
-    if ( reportLock && useEvalboard && adf.getReg( 2, 3, 26 ) == 6 ) { // muxout = digital lock detect
-        // sleep for 20 ms before reading digital lock detect status
-        nanosleep( ( const struct timespec[] ){ { 0, 20000000L } }, nullptr );
-        if ( eval.getMux() ) {
+    if ( lockDetect ) {
+        bool locked = false;
+        if ( eval.hasStatus() ) { // the FW reports the unlock after R0 and the lock as they happen
+            const uint64_t deadline = Trace::now() + 20000000;
+            bool unlocked = false;
+            uint64_t now;
+            while ( !locked && ( now = Trace::now() ) < deadline &&
+                    eval.waitStatus( status, unsigned( ( deadline - now ) / 1000000 ) + 1 ) ) {
+                if ( status.flags & StatusMessage::RELOCK && verbose )
+                    printf( "R0 rewritten by the lock supervisor\n" );
+                if ( status.flags & StatusMessage::MUX ) {
+                    unlocked |= !status.mux;
+                    locked = unlocked && status.mux;
+                }
+            }
+        } else // sleep for 20 ms before reading digital lock detect status
+            nanosleep( ( const struct timespec[] ){ { 0, 20000000L } }, nullptr );
+        if ( locked || eval.getMux() ) {
             puts( "LOCKED" );
             return 0;
         } else {
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include "regindex.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char MAGIC[ 8 ] = { 'A', 'D', 'F', '4', '3', '5', '1', 'I' };
+
+
+bool RegIndex::less( const RegIndexKey &a, const RegIndexKey &b ) {
+    if ( a.refIn != b.refIn )
+        return a.refIn < b.refIn;
+    if ( a.config != b.config )
+        return a.config < b.config;
+    return a.freq_Hz < b.freq_Hz;
+}
+
+
+bool RegIndex::equal( const RegIndexKey &a, const RegIndexKey &b ) {
+    return a.refIn == b.refIn && a.config == b.config && a.freq_Hz == b.freq_Hz;
+}
+
+
+bool RegIndex::open( const char *fileName, bool rw ) {
+    close();
+    path = fileName;
+    writable = rw;
+    fd = ::open( fileName, rw ? O_RDWR | O_CREAT : O_RDONLY, 0644 );
+    if ( fd < 0 ) {
+        fprintf( stderr, "RegIndex open %s: %s\n", fileName, strerror( errno ) );
+        return false;
+    }
+    if ( rw ) { // initialise a new file
+        flock( fd, LOCK_EX );
+        struct stat st;
+        if ( fstat( fd, &st ) == 0 && st.st_size == 0 ) {
+            Header h{};
+            memcpy( h.magic, MAGIC, sizeof( MAGIC ) );
+            h.version = VERSION;
+            h.entrySize = sizeof( RegIndexEntry );
+            if ( pwrite( fd, &h, sizeof( h ), 0 ) != sizeof( h ) ) {
+                fprintf( stderr, "RegIndex init %s: %s\n", fileName, strerror( errno ) );
+                flock( fd, LOCK_UN );
+                close();
+                return false;
+            }
+        }
+        flock( fd, LOCK_UN );
+    }
+    if ( !remap() ) {
+        close();
+        return false;
+    }
+    const Header *h = header();
+    if ( memcmp( h->magic, MAGIC, sizeof( MAGIC ) ) || h->version != VERSION || h->entrySize != sizeof( RegIndexEntry ) ) {
+        fprintf( stderr, "RegIndex %s: not an index file of this version\n", fileName );
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void RegIndex::close() {
+    if ( map )
+        munmap( map, mapLen );
+    map = nullptr;
+    mapLen = 0;
+    if ( fd >= 0 )
+        ::close( fd );
+    fd = -1;
+}
+
+
+// map the whole file, it grows by appends of this or other processes
+bool RegIndex::remap() {
+    struct stat st;
+    if ( fstat( fd, &st ) || size_t( st.st_size ) < sizeof( Header ) ) {
+        fprintf( stderr, "RegIndex %s: file too short\n", path.c_str() );
+        return false;
+    }
+    if ( map )
+        munmap( map, mapLen );
+    mapLen = st.st_size;
+    map = mmap( nullptr, mapLen, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( map == MAP_FAILED ) {
+        fprintf( stderr, "RegIndex mmap %s: %s\n", path.c_str(), strerror( errno ) );
+        map = nullptr;
+        mapLen = 0;
+        return false;
+    }
+    return true;
+}
+
+
+size_t RegIndex::size() const { return map ? header()->total : 0; }
+
+
+size_t RegIndex::sortedSize() const { return map ? header()->sorted : 0; }
+
+
+const RegIndexEntry *RegIndex::find( uint32_t refIn, uint32_t config, uint64_t freq_Hz ) {
+    if ( !map )
+        return nullptr;
+    // the header is shared, remap if another process appended entries
+    if ( sizeof( Header ) + header()->total * sizeof( RegIndexEntry ) > mapLen && !remap() )
+        return nullptr;
+    const RegIndexKey key{ refIn, config, freq_Hz };
+    const RegIndexEntry *first = entries();
+    const RegIndexEntry *sortedEnd = first + header()->sorted;
+    // newest entries first
+    for ( const RegIndexEntry *e = first + header()->total; e-- > sortedEnd; )
+        if ( equal( e->key, key ) )
+            return e;
+    const RegIndexEntry *e = std::lower_bound( first, sortedEnd, key, []( const RegIndexEntry &a, const RegIndexKey &k ) {
+        return less( a.key, k );
+    } );
+    if ( e != sortedEnd && equal( e->key, key ) )
+        return e;
+    return nullptr;
+}
+
+
+bool RegIndex::lockCurrent() {
+    flock( fd, LOCK_EX );
+    struct stat stFd, stPath; // reopen if another process has compacted the file
+    while ( fstat( fd, &stFd ) || stat( path.c_str(), &stPath ) || stFd.st_ino != stPath.st_ino ) {
+        flock( fd, LOCK_UN );
+        std::string p = path;
+        if ( !open( p.c_str(), true ) )
+            return false;
+        flock( fd, LOCK_EX );
+    }
+    return true;
+}
+
+
+bool RegIndex::append( const RegIndexEntry *newEntries, size_t n ) {
+    if ( !writable || fd < 0 )
+        return false;
+    if ( !n )
+        return true;
+    if ( !lockCurrent() )
+        return false;
+    Header h;
+    bool ok = pread( fd, &h, sizeof( h ), 0 ) == sizeof( h );
+    size_t bytes = n * sizeof( RegIndexEntry );
+    off_t pos = sizeof( Header ) + h.total * sizeof( RegIndexEntry );
+    ok = ok && pwrite( fd, newEntries, bytes, pos ) == ssize_t( bytes );
+    if ( ok ) { // entries are complete before they are counted
+        h.total += n;
+        ok = pwrite( fd, &h, sizeof( h ), 0 ) == sizeof( h );
+    }
+    flock( fd, LOCK_UN );
+    if ( !ok ) {
+        fprintf( stderr, "RegIndex append %s: %s\n", path.c_str(), strerror( errno ) );
+        return false;
+    }
+    return remap();
+}
+
+
+bool RegIndex::compact() {
+    if ( !writable || fd < 0 )
+        return false;
+    if ( !lockCurrent() )
+        return false;
+    if ( !remap() ) {
+        flock( fd, LOCK_UN );
+        return false;
+    }
+    Header h = *header();
+    if ( h.sorted == h.total ) { // nothing to do
+        flock( fd, LOCK_UN );
+        return true;
+    }
+    std::vector< RegIndexEntry > all( entries(), entries() + h.total );
+    // stable sort keeps the order of equal keys, the last one is the newest
+    std::stable_sort( all.begin(), all.end(),
+                      []( const RegIndexEntry &a, const RegIndexEntry &b ) { return less( a.key, b.key ); } );
+    std::vector< RegIndexEntry > unique;
+    unique.reserve( all.size() );
+    for ( size_t iii = 0; iii < all.size(); ++iii )
+        if ( iii + 1 == all.size() || !equal( all[ iii ].key, all[ iii + 1 ].key ) )
+            unique.push_back( all[ iii ] );
+    h.sorted = h.total = unique.size();
+
+    // write a new file and replace the old one, readers keep their old mapping
+    std::string tmp = path + ".tmp";
+    int tfd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    size_t bytes = unique.size() * sizeof( RegIndexEntry );
+    bool ok = tfd >= 0 && write( tfd, &h, sizeof( h ) ) == sizeof( h ) &&
+              write( tfd, unique.data(), bytes ) == ssize_t( bytes ) && fsync( tfd ) == 0;
+    if ( tfd >= 0 )
+        ::close( tfd );
+    ok = ok && rename( tmp.c_str(), path.c_str() ) == 0;
+    if ( !ok ) {
+        fprintf( stderr, "RegIndex compact %s: %s\n", path.c_str(), strerror( errno ) );
+        unlink( tmp.c_str() );
+        flock( fd, LOCK_UN );
+        return false;
+    }
+    flock( fd, LOCK_UN );
+    std::string p = path;
+    return open( p.c_str(), true );
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// key of one index entry, entries are sorted by refIn, config, freq_Hz
+struct RegIndexKey {
+    uint32_t refIn;   // reference frequency in Hz
+    uint32_t config;  // how the registers were solved, see RegIndex::configFixed() and CONFIG_SEARCH
+    uint64_t freq_Hz; // target frequency
+};
+
+
+struct RegIndexEntry {
+    RegIndexKey key;
+    uint32_t reg[ 6 ]; // R0..R5
+    double error_Hz;   // achieved - target
+};
+
+
+// Persistent frequency -> register index in a memory mapped file.
+// The file starts with a sorted section (binary search) followed by an unsorted tail
+// of appended entries (linear search, newest first). compact() merges the tail into
+// the sorted section and replaces the file atomically, so other processes can keep
+// reading their mapping of the old file. Appends are serialised with flock().
+class RegIndex {
+  public:
+    // best solution of PLLSearch, the low bits may describe the ranking (adf4351-search: loop bandwidth in Hz)
+    static const uint32_t CONFIG_SEARCH = 0x80000000;
+    // registers from ADF4351::calculateFreq() or any other fixed reference path
+    static uint32_t configFixed( uint16_t Rcounter, bool refDoubler = false, bool refDiv2 = false ) {
+        return ( Rcounter & 0x3FF ) | uint32_t( refDoubler ) << 10 | uint32_t( refDiv2 ) << 11;
+    }
+
+    RegIndex() = default;
+    ~RegIndex() { close(); }
+    RegIndex( const RegIndex & ) = delete;
+    RegIndex &operator=( const RegIndex & ) = delete;
+
+    bool open( const char *path, bool writable = false ); // a writable index is created if missing
+    void close();
+    bool isOpen() const { return fd >= 0; }
+
+    // nullptr if not in the index; the entry points into the mapping and is invalid
+    // after the next find(), append(), compact() or close()
+    const RegIndexEntry *find( uint32_t refIn, uint32_t config, uint64_t freq_Hz );
+    bool append( const RegIndexEntry &entry ) { return append( &entry, 1 ); }
+    bool append( const RegIndexEntry *entries, size_t n );
+    // sort the tail into the sorted section, duplicate keys keep the newest entry
+    bool compact();
+
+    size_t size() const;       // all entries
+    size_t sortedSize() const; // entries in the sorted section
+
+  private:
+    struct Header {
+        char magic[ 8 ];     // "ADF4351I"
+        uint32_t version;    // 1
+        uint32_t entrySize;  // sizeof( RegIndexEntry )
+        uint64_t sorted;     // entries in the sorted section
+        uint64_t total;      // all entries
+        uint8_t reserved[ 32 ];
+    };
+    static const uint32_t VERSION = 1;
+
+    std::string path;
+    bool writable = false;
+    int fd = -1;
+    void *map = nullptr;
+    size_t mapLen = 0;
+
+    const Header *header() const { return static_cast< const Header * >( map ); }
+    const RegIndexEntry *entries() const {
+        return reinterpret_cast< const RegIndexEntry * >( static_cast< const char * >( map ) + sizeof( Header ) );
+    }
+    bool remap();
+    bool lockCurrent(); // flock() the file that is at path now, reopen it after a compact() of another process
+    static bool less( const RegIndexKey &a, const RegIndexKey &b );
+    static bool equal( const RegIndexKey &a, const RegIndexKey &b );
+};
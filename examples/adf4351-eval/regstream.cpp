@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "regstream.h"
+
+
+const char RegStreamReader::MAGIC[ 8 ] = { 'A', 'D', 'F', 'R', 'E', 'G', 'S', 0 };
+
+
+static uint64_t clockNs( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return uint64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+
+static void putLE( uint8_t *p, uint64_t value, int bytes ) {
+    for ( int iii = 0; iii < bytes; ++iii )
+        p[ iii ] = value >> ( 8 * iii );
+}
+
+
+static uint64_t getLE( const uint8_t *p, int bytes ) {
+    uint64_t value = 0;
+    for ( int iii = 0; iii < bytes; ++iii )
+        value |= uint64_t( p[ iii ] ) << ( 8 * iii );
+    return value;
+}
+
+
+bool RegStreamWriter::open( const char *path ) {
+    close();
+    fp = fopen( path, "wb" );
+    if ( !fp ) {
+        perror( path );
+        return false;
+    }
+    uint8_t header[ RegStreamReader::HEADER_SIZE ] = { 0 };
+    memcpy( header, RegStreamReader::MAGIC, sizeof( RegStreamReader::MAGIC ) );
+    putLE( header + 8, RegStreamReader::VERSION, 2 );
+    putLE( header + 16, clockNs( CLOCK_REALTIME ), 8 );
+    last_ns = clockNs( CLOCK_MONOTONIC );
+    for ( uint32_t reg = 0; reg < 8; ++reg )
+        last[ reg ] = reg;
+    if ( fwrite( header, sizeof( header ), 1, fp ) != 1 ) {
+        perror( path );
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void RegStreamWriter::append( uint32_t word ) { append( word, clockNs( CLOCK_MONOTONIC ) ); }
+
+
+void RegStreamWriter::append( uint32_t word, uint64_t time_ns ) {
+    if ( !fp )
+        return;
+    uint8_t buf[ 16 ];
+    uint8_t *p = buf;
+    uint64_t value = time_ns > last_ns ? time_ns - last_ns : 0;
+    last_ns += value;
+    for ( int iii = 0; iii < 2; ++iii ) {
+        do {
+            *p = value & 0x7F;
+            value >>= 7;
+            *p++ |= value ? 0x80 : 0;
+        } while ( value );
+        const uint32_t reg = word & 0b111;
+        value = ( word ^ last[ reg ] ) | reg;
+        last[ reg ] = word;
+    }
+    fwrite( buf, p - buf, 1, fp );
+}
+
+
+bool RegStreamWriter::close() {
+    if ( !fp )
+        return true;
+    bool ok = fclose( fp ) == 0;
+    fp = nullptr;
+    return ok;
+}
+
+
+bool RegStreamReader::open( const char *path ) {
+    close();
+    int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 ) {
+        perror( path );
+        return false;
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) || size_t( st.st_size ) < HEADER_SIZE ) {
+        fprintf( stderr, "%s: not a register stream\n", path );
+        ::close( fd );
+        return false;
+    }
+    void *map = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( map == MAP_FAILED ) {
+        perror( path );
+        return false;
+    }
+    data = static_cast< const uint8_t * >( map );
+    len = st.st_size;
+    if ( memcmp( data, MAGIC, sizeof( MAGIC ) ) || getLE( data + 8, 2 ) != VERSION ) {
+        fprintf( stderr, "%s: not a register stream version %u\n", path, VERSION );
+        close();
+        return false;
+    }
+    madvise( map, len, MADV_SEQUENTIAL );
+    start_ns = getLE( data + 16, 8 );
+    rewind();
+    return true;
+}
+
+
+void RegStreamReader::close() {
+    if ( data )
+        munmap( const_cast< uint8_t * >( data ), len );
+    data = nullptr;
+    len = pos = 0;
+}
+
+
+void RegStreamReader::rewind() {
+    pos = HEADER_SIZE;
+    time_ns = 0;
+    for ( uint32_t reg = 0; reg < 8; ++reg )
+        last[ reg ] = reg;
+}
+
+
+bool RegStreamReader::varint( const uint8_t *&p, const uint8_t *end, uint64_t &value ) {
+    value = 0;
+    for ( int shift = 0; p < end && shift < 64; shift += 7 ) {
+        uint8_t b = *p++;
+        value |= uint64_t( b & 0x7F ) << shift;
+        if ( !( b & 0x80 ) )
+            return true;
+    }
+    return false;
+}
+
+
+bool RegStreamReader::next( RegRecord &record ) {
+    if ( !data )
+        return false;
+    const uint8_t *p = data + pos;
+    const uint8_t *end = data + len;
+    uint64_t dt, value;
+    if ( !varint( p, end, dt ) || !varint( p, end, value ) || value > UINT32_MAX )
+        return false;
+    const uint32_t reg = value & 0b111;
+    record.word = ( ( uint32_t( value ) ^ last[ reg ] ) & ~0b111u ) | reg;
+    last[ reg ] = record.word;
+    time_ns += dt;
+    record.time_ns = time_ns;
+    pos = p - data;
+    return true;
+}
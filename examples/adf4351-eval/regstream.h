@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+
+// Binary stream of register words as they were sent to the chip.
+// Header (24 byte, little endian):
+//   "ADFREGS" 0, uint16 version (1), uint16 reserved, uint32 reserved, uint64 start time (CLOCK_REALTIME ns)
+// Records, two LEB128 varints each:
+//   dt   : ns since the previous record (since the start time for the first one)
+//   word : register word XOR the previous word of the same register, the control bits 2..0
+//          are not XORed and select the register (R0..R5, 6 and 7 are reserved).
+//          The previous word of every register starts as its register number.
+// A retune that changes INT/FRAC needs 4..8 byte instead of 12 byte raw.
+// A truncated last record (e.g. after a crash) is ignored by the reader.
+class RegStreamWriter {
+  public:
+    RegStreamWriter() = default;
+    ~RegStreamWriter() { close(); };
+    RegStreamWriter( const RegStreamWriter & ) = delete;
+    RegStreamWriter &operator=( const RegStreamWriter & ) = delete;
+
+    bool open( const char *path ); // truncates path
+    bool isOpen() const { return fp != nullptr; };
+    void append( uint32_t word );  // timestamp now
+    void append( uint32_t word, uint64_t time_ns ); // CLOCK_MONOTONIC ns, not decreasing
+    bool close();
+
+  private:
+    FILE *fp = nullptr;
+    uint64_t last_ns = 0;
+    uint32_t last[ 8 ];
+};
+
+
+struct RegRecord {
+    uint64_t time_ns; // since the start of the recording
+    uint32_t word;
+};
+
+
+// memory mapped stream
+class RegStreamReader {
+  public:
+    RegStreamReader() = default;
+    ~RegStreamReader() { close(); };
+    RegStreamReader( const RegStreamReader & ) = delete;
+    RegStreamReader &operator=( const RegStreamReader & ) = delete;
+
+    bool open( const char *path );
+    void close();
+    void rewind();
+    bool next( RegRecord &record ); // false at the end of the stream
+    uint64_t startTime() const { return start_ns; }; // CLOCK_REALTIME ns
+    size_t size() const { return len; };
+
+    static const char MAGIC[ 8 ];
+    static constexpr size_t HEADER_SIZE = 24;
+    static constexpr uint16_t VERSION = 1;
+
+  private:
+    static bool varint( const uint8_t *&p, const uint8_t *end, uint64_t &value );
+    const uint8_t *data = nullptr;
+    size_t len = 0;
+    size_t pos = 0;
+    uint64_t start_ns = 0;
+    uint64_t time_ns = 0;
+    uint32_t last[ 8 ];
+};
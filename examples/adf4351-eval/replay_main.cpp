@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Replay a register stream recorded with "adf4351-eval -R FILE" or "adf435xgui --record FILE"
+//
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <ctype.h>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+#include "eval.h"
+#include "regstream.h"
+#include "sweep.h"
+
+
+static DwellScheduler *runningReplay = nullptr;
+
+static void stopReplay( int ) {
+    if ( runningReplay )
+        runningReplay->stop();
+}
+
+
+int main( int argc, char *argv[] ) {
+    bool useEvalboard = true;
+    int verbose = 0;
+    double speed = 1;
+    unsigned repeat = 1;
+    bool realtime = false;
+    int cpu = -1;
+    const char *pointFile = nullptr;
+    std::vector< unsigned > devices;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "c:dD:Fhj:n:s:v" ) ) != -1 )
+        switch ( c ) {
+        case 'c': // pin to CPU
+            cpu = strtol( optarg, nullptr, 0 );
+            break;
+        case 'd': // dry run
+            useEvalboard = false;
+            break;
+        case 'D': { // device list
+            char *next = optarg;
+            do
+                devices.push_back( strtoul( next, &next, 0 ) );
+            while ( *next++ == ',' );
+            break;
+        }
+        case 'F': // SCHED_FIFO
+            realtime = true;
+            break;
+        case 'j': // timestamps
+            pointFile = optarg;
+            break;
+        case 'n': // number of replays
+            repeat = strtoul( optarg, nullptr, 0 );
+            break;
+        case 's': // timing factor
+            speed = strtod( optarg, nullptr );
+            break;
+        case 'v': // increase verbosity
+            ++verbose;
+            break;
+        case 'h': // help
+            puts( "adf4351-replay [-c CPU] [-d] [-D DEV,...] [-F] [-h] [-j FILE] [-n COUNT] [-s SPEED] [-v] FILE\n"
+                  "  -c CPU  : pin to CPU\n"
+                  "  -d      : dry run, do not open the eval boards\n"
+                  "  -D DEV,...: send to these eval boards, 0 = first (default)\n"
+                  "  -F      : real time scheduling (SCHED_FIFO)\n"
+                  "  -h      : show this help\n"
+                  "  -j FILE : write planned and actual time of every register to FILE\n"
+                  "  -n COUNT: number of replays, 0 = endless (default 1)\n"
+                  "  -s SPEED: timing factor, 1 = recorded timing (default), 10 = ten times faster,\n"
+                  "            0 = full speed\n"
+                  "  -v      : increase verbosity" );
+            return 1;
+        case '?':
+            if ( optopt == 'c' || optopt == 'n' || optopt == 's' )
+                fprintf( stderr, "option '-%c' requires a numeric argument.\n", optopt );
+            else if ( optopt == 'D' )
+                fprintf( stderr, "option '-D' requires a device list.\n" );
+            else if ( optopt == 'j' )
+                fprintf( stderr, "option '-j' requires a file argument.\n" );
+            else if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c'.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+
+    if ( optind != argc - 1 ) {
+        fprintf( stderr, "adf4351-replay: one register stream file required, '-h' shows the usage\n" );
+        return 1;
+    }
+    if ( speed < 0 ) {
+        fprintf( stderr, "bad timing factor '%g'\n", speed );
+        return 1;
+    }
+
+    RegStreamReader stream;
+    if ( !stream.open( argv[ optind ] ) )
+        return 1;
+    RegRecord record;
+    size_t nRecords = 0;
+    uint64_t duration_ns = 0;
+    while ( stream.next( record ) ) {
+        ++nRecords;
+        duration_ns = record.time_ns;
+    }
+    stream.rewind();
+    if ( verbose ) {
+        time_t start = stream.startTime() / 1000000000;
+        printf( "%s: %zu registers in %zu byte, %.3f s, recorded %s", argv[ optind ], nRecords, stream.size(),
+                duration_ns / 1e9, ctime( &start ) );
+    }
+    if ( !nRecords )
+        return 0;
+
+    if ( devices.empty() )
+        devices.push_back( 0 );
+    std::vector< std::unique_ptr< EVAL > > evals;
+    if ( useEvalboard )
+        for ( unsigned index : devices ) {
+            evals.emplace_back( new EVAL );
+            if ( !evals.back()->init( index ) )
+                return 1;
+        }
+
+    bool error = false;
+    auto send = [ & ]( uint32_t word ) -> bool {
+        if ( verbose > 1 )
+            printf( "%10.6f R%d: 0x%08X\n", record.time_ns / 1e9, word & 0b111, word );
+        for ( auto &eval : evals )
+            if ( 4 != eval->sendReg( word ) ) {
+                error = true;
+                return false;
+            }
+        return true;
+    };
+
+    if ( speed == 0 ) { // full speed
+        uint64_t t0 = Trace::now();
+        size_t n = 0;
+        for ( unsigned rrr = 0; ( !repeat || rrr < repeat ) && !error; ++rrr ) {
+            stream.rewind();
+            while ( stream.next( record ) && send( record.word ) )
+                ++n;
+        }
+        double dt = ( Trace::now() - t0 ) / 1e9;
+        printf( "%zu registers in %.3f s, %.0f registers/s\n", n, dt, n / dt );
+        return error ? 1 : 0;
+    }
+
+    DwellScheduler scheduler;
+    if ( cpu >= 0 && !scheduler.pinCPU( cpu ) )
+        return 1;
+    if ( realtime && !scheduler.realtime() )
+        return 1;
+    scheduler.keepPoints( pointFile != nullptr );
+    // offset() is called once per index in order, it reads the next record
+    uint64_t base_ns = 0;
+    auto offset = [ & ]( size_t index ) -> uint64_t {
+        if ( index && index % nRecords == 0 ) { // next replay starts one dwell after the end
+            base_ns += duration_ns + duration_ns / nRecords;
+            stream.rewind();
+        }
+        stream.next( record );
+        return uint64_t( ( base_ns + record.time_ns ) / speed );
+    };
+    runningReplay = &scheduler;
+    signal( SIGINT, stopReplay );
+    scheduler.run( repeat * nRecords, offset, [ & ]( size_t ) { return send( record.word ); } );
+    signal( SIGINT, SIG_DFL );
+    runningReplay = nullptr;
+    scheduler.summary( stdout );
+    if ( pointFile && !scheduler.writePoints( pointFile ) )
+        return 1;
+    return error ? 1 : 0;
+}
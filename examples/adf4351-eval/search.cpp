@@ -0,0 +1,428 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+
+#include "adf435x.h"
+#include "search.h"
+#include "threadpool.h"
+
+
+// binary GCD, a lot faster than the division loop
+static uint64_t getGCD( uint64_t a, uint64_t b ) {
+    if ( !a || !b )
+        return a | b;
+    int shift = __builtin_ctzll( a | b );
+    a >>= __builtin_ctzll( a );
+    do {
+        b >>= __builtin_ctzll( b );
+        if ( a > b ) {
+            uint64_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while ( b );
+    return a << shift;
+}
+
+
+// best approximation p/q <= maxDen of num/den (num < den) using continued fractions
+static void bestRational( uint64_t num, uint64_t den, uint64_t maxDen, uint64_t &p, uint64_t &q ) {
+    uint64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0; // convergents
+    uint64_t n = num, d = den;
+    while ( d ) {
+        uint64_t a = n / d;
+        if ( q0 + a * q1 > maxDen ) { // semiconvergent with the largest allowed denominator
+            uint64_t k = ( maxDen - q0 ) / q1;
+            uint64_t pk = p0 + k * p1, qk = q0 + k * q1;
+            // choose the closer one of the semiconvergent and the last convergent
+            long double e1 = std::fabs( (long double)pk / qk - (long double)num / den );
+            long double e2 = std::fabs( (long double)p1 / q1 - (long double)num / den );
+            if ( e1 < e2 ) {
+                p = pk;
+                q = qk;
+            } else {
+                p = p1;
+                q = q1;
+            }
+            return;
+        }
+        uint64_t p2 = p0 + a * p1, q2 = q0 + a * q1;
+        p0 = p1;
+        q0 = q1;
+        p1 = p2;
+        q1 = q2;
+        uint64_t t = n % d;
+        n = d;
+        d = t;
+    }
+    p = p1;
+    q = q1;
+}
+
+
+PLLSearch::PLLSearch( uint32_t refIn, float loopBW_Hz )
+    : refIn{ refIn }, spur{ loopBW_Hz > 0 ? loopBW_Hz : 1 }, spurRank{ loopBW_Hz > 0 } {
+    // prime factors of 2 * refIn, the numerator of every PFD divides it
+    uint64_t m = 2 * uint64_t( refIn );
+    for ( uint64_t p = 2; m > 1; ++p ) {
+        if ( p * p > m )
+            p = m;
+        if ( m % p )
+            continue;
+        primes[ nPrimes ] = p;
+        expMax[ nPrimes ] = 0;
+        primePow[ nPrimes ][ 0 ] = 1;
+        while ( m % p == 0 ) {
+            m /= p;
+            ++expMax[ nPrimes ];
+            primePow[ nPrimes ][ expMax[ nPrimes ] ] = primePow[ nPrimes ][ expMax[ nPrimes ] - 1 ] * p;
+        }
+        ++nPrimes;
+    }
+    // collect one reference path per distinct PFD = refIn * ( 1 + D ) / ( R * ( 1 + T ) )
+    std::map< std::pair< uint64_t, uint64_t >, RefPath > unique;
+    for ( int D = 0; D <= 1; ++D ) {
+        if ( D && refIn > REF_DOUBLER_MAX )
+            continue;
+        for ( int T = 0; T <= 1; ++T )
+            for ( uint32_t R = 1; R <= 1023; ++R ) {
+                uint64_t num = uint64_t( refIn ) * ( 1 + D );
+                uint64_t den = uint64_t( R ) * ( 1 + T );
+                uint64_t g = getGCD( num, den );
+                num /= g;
+                den /= g;
+                double fPFD = double( num ) / den;
+                if ( fPFD > PFD_MAX_INT )
+                    continue;
+                RefPath path;
+                path.cfg.Rcounter = R;
+                path.cfg.refDoubler = D;
+                path.cfg.refDiv2 = T;
+                path.num = num;
+                path.den = den;
+                path.fPFD = fPFD;
+                unique.emplace( std::make_pair( num, den ), path ); // keeps the first = simplest setting
+            }
+    }
+    std::map< uint64_t, uint32_t > numIndex;
+    for ( auto &u : unique ) {
+        RefPath &path = u.second;
+        auto n = numIndex.emplace( path.num, uint32_t( nums.size() ) );
+        if ( n.second ) {
+            nums.push_back( path.num );
+            numExp.emplace_back();
+            factorExp( path.num, numExp.back().data() );
+        }
+        path.numIndex = n.first->second;
+        paths.push_back( path );
+    }
+    std::sort( paths.begin(), paths.end(), []( const RefPath &a, const RefPath &b ) { return a.fPFD > b.fPFD; } );
+}
+
+
+bool PLLSearch::better( const PLLSolution &a, const PLLSolution &b ) {
+    if ( a.valid != b.valid )
+        return a.valid;
+    double ea = std::fabs( a.error_Hz ), eb = std::fabs( b.error_Hz );
+    if ( std::fabs( ea - eb ) > 1e-6 )
+        return ea < eb;
+    if ( a.spurPower > b.spurPower * SPUR_TOL || b.spurPower > a.spurPower * SPUR_TOL )
+        return a.spurPower < b.spurPower;
+    if ( a.intMode() != b.intMode() )
+        return a.intMode();
+    if ( a.fPFD != b.fPFD )
+        return a.fPFD > b.fPFD;
+    if ( a.cfg.fundamental != b.cfg.fundamental )
+        return a.cfg.fundamental;
+    if ( a.MOD != b.MOD )
+        return a.MOD < b.MOD;
+    return a.cfg.prescaler89 && !b.cfg.prescaler89;
+}
+
+
+// exponents of the primes of 2 * refIn in x, at most those of 2 * refIn
+void PLLSearch::factorExp( uint64_t x, uint8_t *exp ) const {
+    for ( int k = 0; k < nPrimes; ++k ) {
+        exp[ k ] = 0;
+        while ( exp[ k ] < expMax[ k ] && x % primes[ k ] == 0 ) {
+            x /= primes[ k ];
+            ++exp[ k ];
+        }
+    }
+}
+
+
+// With num and den coprime the reduced MOD = num / g and the fractional spur offset fPFD / MOD = g / den
+// follow from g = gcd( fFB, num ), the minimum of the prime exponents; the same for all paths with this num.
+// scale[ numIndex ] = g for an exact FRAC mode solution, +inf for INT mode (g = num), -inf if MOD > MOD_MAX
+void PLLSearch::fracScale( uint64_t fFB, double *scale ) const {
+    uint8_t fbExp[ PRIMES_MAX ];
+    factorExp( fFB, fbExp );
+    for ( size_t iii = 0; iii < nums.size(); ++iii ) {
+        uint64_t g = 1;
+        for ( int k = 0; k < nPrimes; ++k )
+            g *= primePow[ k ][ std::min( fbExp[ k ], numExp[ iii ][ k ] ) ];
+        if ( g == nums[ iii ] )
+            scale[ iii ] = INFINITY;
+        else if ( nums[ iii ] > g * MOD_MAX )
+            scale[ iii ] = -INFINITY;
+        else
+            scale[ iii ] = double( g );
+    }
+}
+
+
+// Prefilter once the list is full of exact solutions, without a division: can a candidate of this path
+// and feedback (scale from fracScale()) beat the last one? INT mode is always tried, an inexact FRAC mode
+// candidate never, an exact one only if its fractional spur offset is above fracLimit
+// (SpurModel::fracLimit() of the last one, FLT_MAX without spur ranking)
+// and its lowest spur estimate can be lower by SPUR_TOL.
+inline bool PLLSearch::candidate( const RefPath &path, const double *scale, float gain, float fracLimit,
+                                  const PLLSolution &last ) const {
+    const double s = scale[ path.numIndex ];
+    if ( !( s > double( fracLimit ) * path.den ) )
+        return false;
+    if ( s == INFINITY )
+        return true;
+    if ( path.fPFD > PFD_MAX_FRAC )
+        return false;
+    // 0.1 % margin for the rounding of the float estimate
+    return 0.999f * SPUR_TOL * spur.lowerBound( float( s / path.den ), float( path.fPFD ), gain ) < last.spurPower;
+}
+
+
+// calculate INT/FRAC/MOD for one reference path and feedback select, false if there is no valid candidate
+// exactOnly: the list is already full of exact solutions, skip the candidate if it is not exact
+bool PLLSearch::evaluate( const RefPath &path, uint64_t freq_Hz, uint8_t RFDiv, bool fundamental, bool exactOnly,
+                          PLLSolution &sol ) const {
+    // N = fFB / fPFD = fFB * den / num, fFB = VCO (fundamental) or output frequency (divided)
+    const uint64_t fFB = fundamental ? freq_Hz << RFDiv : freq_Hz;
+    const uint64_t nNum = fFB * path.den;
+    uint64_t INT = nNum / path.num;
+    uint64_t rem = nNum % path.num;
+    uint64_t FRAC = 0, MOD = 2;
+    bool exact = true;
+    if ( rem ) {
+        uint64_t g = getGCD( rem, path.num );
+        FRAC = rem / g;
+        MOD = path.num / g;
+        if ( MOD > MOD_MAX ) { // no exact solution, use the closest fraction
+            if ( exactOnly )
+                return false;
+            exact = false;
+            bestRational( rem, path.num, MOD_MAX, FRAC, MOD );
+            if ( FRAC == MOD ) { // rounded up to the next integer
+                ++INT;
+                FRAC = 0;
+            }
+            if ( FRAC == 0 )
+                MOD = 2;
+            else if ( MOD < 2 ) // 1/1 handled above, 0/1 -> INT mode
+                MOD = 2;
+        }
+    }
+    if ( FRAC && path.fPFD > PFD_MAX_FRAC )
+        return false;
+    if ( INT > 65535 )
+        return false;
+    const double vco = double( freq_Hz << RFDiv );
+    sol = PLLSolution();
+    sol.cfg = path.cfg;
+    sol.cfg.fundamental = fundamental;
+    sol.freq_Hz = freq_Hz;
+    sol.fPFD = path.fPFD;
+    sol.INT = INT;
+    sol.FRAC = FRAC;
+    sol.MOD = MOD;
+    sol.RFDiv = RFDiv;
+    sol.exact = exact;
+    sol.valid = true;
+    if ( exact )
+        sol.error_Hz = 0;
+    else { // achieved = ( INT + FRAC / MOD ) * fPFD ( / divider )
+        long double achieved = ( (long double)INT * MOD + FRAC ) * path.num / ( (long double)MOD * path.den );
+        if ( fundamental )
+            achieved /= ( 1 << RFDiv );
+        sol.error_Hz = double( achieved - freq_Hz );
+    }
+    sol.bandSelClkHigh = path.fPFD > 255 * 125e3;
+    sol.bandSelClkDiv = uint8_t( std::ceil( path.fPFD / ( sol.bandSelClkHigh ? 500e3 : 125e3 ) ) );
+
+    // prescaler 8/9 for N >= 75, else 4/5 for N >= 23 and VCO <= 3.6 GHz
+    if ( INT >= 75 )
+        sol.cfg.prescaler89 = true;
+    else if ( INT >= 23 && vco <= PRESCALER_45_MAX )
+        sol.cfg.prescaler89 = false;
+    else
+        return false;
+    return true;
+}
+
+
+// insert into the topK list
+void PLLSearch::insert( const PLLSolution &sol, PLLSolution *best, int topK ) {
+    if ( !better( sol, best[ topK - 1 ] ) )
+        return;
+    int pos = topK - 1; // insertion sort into the short list
+    while ( pos > 0 && better( sol, best[ pos - 1 ] ) ) {
+        best[ pos ] = best[ pos - 1 ];
+        --pos;
+    }
+    best[ pos ] = sol;
+}
+
+
+// spur gain of the feedback path, spurs created at the VCO are reduced by the RF divider
+static inline float spurGain( const PLLSolution &sol ) {
+    return sol.cfg.fundamental ? 1.0f / float( 1U << ( 2 * sol.RFDiv ) ) : 1.0f;
+}
+
+
+void PLLSearch::scoreSpur( PLLSolution &sol ) const {
+    if ( !spurRank || !sol.valid )
+        return;
+    float fPFD = sol.fPFD, gain = spurGain( sol );
+    spur.scoreScalar( 1, &sol.FRAC, &sol.MOD, &fPFD, &gain, &sol.ibsOffset_Hz, &sol.fracOffset_Hz, &sol.spurPower );
+}
+
+
+std::vector< PLLSolution > PLLSearch::solve( uint64_t freq_Hz, int topK ) const {
+    if ( topK < 1 )
+        topK = 1;
+    std::vector< PLLSolution > best( topK );
+    for ( auto &b : best )
+        b.freq_Hz = freq_Hz;
+    if ( freq_Hz < VCO_MIN / 64 || freq_Hz > VCO_MAX )
+        return best;
+    uint8_t RFDiv = 0; // VCO = freq * 2^RFDiv within 2.2 .. 4.4 GHz
+    while ( double( freq_Hz << RFDiv ) < VCO_MIN )
+        ++RFDiv;
+    const float fundGain = 1.0f / float( 1U << ( 2 * RFDiv ) ); // fundamental feedback
+    std::vector< double > scale( 2 * nums.size() ); // fracScale() of both feedback paths
+    const double *fundScale = scale.data(), *divdScale = scale.data() + nums.size();
+    fracScale( freq_Hz << RFDiv, scale.data() );
+    fracScale( freq_Hz, scale.data() + nums.size() );
+    // candidates of CHUNK reference paths as structure of arrays for the spur scoring
+    constexpr size_t CHUNK = 16;
+    PLLSolution cand[ 2 * CHUNK ];
+    uint32_t FRAC[ 2 * CHUNK ], MOD[ 2 * CHUNK ];
+    float fPFD[ 2 * CHUNK ], gain[ 2 * CHUNK ], ibsOffset[ 2 * CHUNK ], fracOffset[ 2 * CHUNK ], power[ 2 * CHUNK ];
+
+    // the paths are sorted by falling PFD, so a lower PFD can only win by a smaller error,
+    // a lower spur estimate or as INT mode solution against FRAC mode
+    const PLLSolution &last = best[ topK - 1 ];
+    float limitFund = FLT_MAX, limitDivd = FLT_MAX, limitPower = -1;
+    for ( size_t first = 0; first < paths.size(); first += CHUNK ) {
+        // a FRAC mode candidate has to beat the last one by SPUR_TOL, 0.1 % margin for the rounding
+        if ( spurRank && last.exact && last.spurPower != limitPower ) {
+            limitPower = last.spurPower;
+            limitFund = spur.fracLimit( limitPower / ( 0.999f * SPUR_TOL ), fundGain );
+            limitDivd = spur.fracLimit( limitPower / ( 0.999f * SPUR_TOL ), 1.0f );
+        }
+        size_t n = 0;
+        for ( size_t iii = first; iii < first + CHUNK && iii < paths.size(); ++iii ) {
+            const RefPath &path = paths[ iii ];
+            if ( last.exact && last.intMode() ) // nothing left to improve
+                break;
+            if ( ( !last.exact || candidate( path, fundScale, fundGain, limitFund, last ) ) &&
+                 evaluate( path, freq_Hz, RFDiv, true, last.exact, cand[ n ] ) )
+                ++n;
+            // with divider 1 both feedback paths are the same
+            if ( RFDiv && ( !last.exact || candidate( path, divdScale, 1.0f, limitDivd, last ) ) &&
+                 evaluate( path, freq_Hz, RFDiv, false, last.exact, cand[ n ] ) )
+                ++n;
+            if ( !spurRank ) { // nothing to score, rank now to keep the pruning tight
+                for ( size_t jjj = 0; jjj < n; ++jjj )
+                    insert( cand[ jjj ], best.data(), topK );
+                n = 0;
+            }
+        }
+        if ( n ) {
+            for ( size_t jjj = 0; jjj < n; ++jjj ) {
+                FRAC[ jjj ] = cand[ jjj ].FRAC;
+                MOD[ jjj ] = cand[ jjj ].MOD;
+                fPFD[ jjj ] = cand[ jjj ].fPFD;
+                gain[ jjj ] = spurGain( cand[ jjj ] );
+            }
+            spur.score( n, FRAC, MOD, fPFD, gain, ibsOffset, fracOffset, power );
+            for ( size_t jjj = 0; jjj < n; ++jjj ) {
+                cand[ jjj ].ibsOffset_Hz = ibsOffset[ jjj ];
+                cand[ jjj ].fracOffset_Hz = fracOffset[ jjj ];
+                cand[ jjj ].spurPower = power[ jjj ];
+                insert( cand[ jjj ], best.data(), topK );
+            }
+        }
+        if ( last.exact && last.intMode() )
+            break;
+    }
+    return best;
+}
+
+
+std::vector< PLLSolution > PLLSearch::solve( const std::vector< uint64_t > &freqs, int topK, unsigned nThreads ) const {
+    if ( topK < 1 )
+        topK = 1;
+    std::vector< PLLSolution > result( freqs.size() * topK );
+    ThreadPool pool( nThreads );
+    pool.parallelFor( 0, freqs.size(), 16, [ & ]( size_t first, size_t last ) {
+        for ( size_t iii = first; iii < last; ++iii ) {
+            std::vector< PLLSolution > best = solve( freqs[ iii ], topK );
+            std::copy( best.begin(), best.end(), result.begin() + iii * topK );
+        }
+    } );
+    return result;
+}
+
+
+void PLLSearch::buildRegs( const PLLSolution &sol, uint32_t reg[ 6 ] ) {
+    adf435x_params p;
+    adf435x_params_default( &p );
+    p.INT = sol.INT;
+    p.FRAC = sol.FRAC;
+    p.MOD = sol.MOD;
+    p.prescaler_8_9 = sol.cfg.prescaler89;
+    p.ref_doubler = sol.cfg.refDoubler;
+    p.ref_div2 = sol.cfg.refDiv2;
+    p.r_counter = sol.cfg.Rcounter;
+    p.ldf = p.ldp = sol.intMode(); // LDF INT, LDP 6 ns
+    p.band_select_clock_mode = sol.bandSelClkHigh;
+    p.feedback_fundamental = sol.cfg.fundamental;
+    p.rf_div_select = sol.RFDiv;
+    p.band_select_clock_divider = sol.bandSelClkDiv;
+    adf435x_pack( &p, reg );
+}
+
+
+PLLSolution PLLSearch::fromRegs( uint32_t refIn, uint64_t freq_Hz, const uint32_t reg[ 6 ], double error_Hz ) {
+    PLLSolution sol;
+    sol.freq_Hz = freq_Hz;
+    sol.error_Hz = error_Hz;
+    sol.exact = error_Hz == 0;
+    adf435x_params p;
+    if ( adf435x_unpack( reg, &p ) != ADF435X_OK )
+        return sol;
+    sol.INT = p.INT;
+    sol.FRAC = p.FRAC;
+    sol.MOD = p.MOD;
+    sol.cfg.prescaler89 = p.prescaler_8_9;
+    sol.cfg.Rcounter = p.r_counter;
+    sol.cfg.refDiv2 = p.ref_div2;
+    sol.cfg.refDoubler = p.ref_doubler;
+    sol.bandSelClkHigh = p.band_select_clock_mode;
+    sol.bandSelClkDiv = p.band_select_clock_divider;
+    sol.RFDiv = p.rf_div_select;
+    sol.cfg.fundamental = p.feedback_fundamental;
+    if ( sol.cfg.Rcounter )
+        sol.fPFD = double( refIn ) * ( 1 + sol.cfg.refDoubler ) / ( sol.cfg.Rcounter * ( 1 + sol.cfg.refDiv2 ) );
+    sol.valid = sol.cfg.Rcounter && sol.INT;
+    return sol;
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spur.h"
+
+// one setting of the reference path and the feedback loop
+struct PLLConfig {
+    uint16_t Rcounter = 250; // 1..1023
+    bool refDoubler = false;
+    bool refDiv2 = false;
+    bool fundamental = true; // feedback from the VCO, else from the output divider
+    bool prescaler89 = true; // 8/9, else 4/5
+};
+
+
+struct PLLSolution {
+    PLLConfig cfg;
+    uint64_t freq_Hz = 0; // target frequency
+    double fPFD = 0;
+    double error_Hz = 0; // achieved - target
+    uint32_t INT = 0;
+    uint32_t FRAC = 0;
+    uint32_t MOD = 2;
+    uint8_t RFDiv = 0;        // RF divider select, divider = 1 << RFDiv
+    float spurPower = 0;      // spur estimate relative to the carrier, see SpurModel
+    float ibsOffset_Hz = 0;   // distance to the integer boundary
+    float fracOffset_Hz = 0;  // fractional spur offset
+    uint8_t bandSelClkDiv = 1;
+    bool bandSelClkHigh = false; // band select clock mode high (PFD above 31.875 MHz)
+    bool exact = false;          // error_Hz is exactly 0
+    bool valid = false;
+    bool intMode() const { return FRAC == 0; };
+};
+
+
+// Exhaustive search over R counter 1..1023, doubler, div2, feedback select and prescaler
+// for the configuration that hits a target frequency with the smallest error.
+// Candidates are ranked by |error|, then by the spur estimate (differences below 1 dB
+// do not count), then INT before FRAC mode, higher PFD, fundamental feedback and smaller MOD.
+// The spur estimate is calculated in batches of candidates (SpurModel::score()),
+// loopBW_Hz = 0 ranks without spur estimate.
+// Reference paths with the same PFD give the same results, the search evaluates
+// each PFD only once with the simplest setting (no doubler/div2, smallest R).
+// The prescaler is 8/9 if N allows it, else 4/5.
+// Exact N = fFB / fPFD is a rational number, MOD = denominator if it fits into 12 bit,
+// else the closest fraction with MOD <= 4095 is used.
+class PLLSearch {
+  public:
+    PLLSearch( uint32_t refIn = 25000000, float loopBW_Hz = 20e3 );
+
+    // the topK best solutions for one frequency, best first
+    std::vector< PLLSolution > solve( uint64_t freq_Hz, int topK = 1 ) const;
+    // solve all frequencies on a work-stealing thread pool (nThreads = 0: all cores),
+    // result[ i * topK + k ] is the k-th best solution of freqs[ i ]
+    std::vector< PLLSolution > solve( const std::vector< uint64_t > &freqs, int topK = 1, unsigned nThreads = 0 ) const;
+
+    // register set R0..R5 for a solution, other settings like ADF4351::calculateFreq()
+    static void buildRegs( const PLLSolution &sol, uint32_t reg[ 6 ] );
+    // solution described by a register set, e.g. from RegIndex
+    static PLLSolution fromRegs( uint32_t refIn, uint64_t freq_Hz, const uint32_t reg[ 6 ], double error_Hz );
+    // spur estimate of a single solution, e.g. after fromRegs()
+    void scoreSpur( PLLSolution &sol ) const;
+    // true if a is ranked before b
+    static bool better( const PLLSolution &a, const PLLSolution &b );
+
+    size_t numRefPaths() const { return paths.size(); }; // distinct PFD values
+    uint32_t getRefIn() const { return refIn; };
+    bool spurRanking() const { return spurRank; };
+
+    static constexpr double VCO_MIN = 2.2e9;
+    static constexpr double VCO_MAX = 4.4e9;
+    static constexpr double PFD_MAX_FRAC = 32e6;
+    static constexpr double PFD_MAX_INT = 45e6;
+    static constexpr double PRESCALER_45_MAX = 3.6e9; // VCO limit of the 4/5 prescaler
+    static constexpr double REF_DOUBLER_MAX = 30e6;   // reference input limit of the doubler
+    static constexpr uint32_t MOD_MAX = 4095;
+    static constexpr float SPUR_TOL = 1.26f; // 1 dB
+
+  private:
+    static constexpr int PRIMES_MAX = 10; // distinct primes of 2 * refIn, 2 * 3 * ... * 29 > 2^33
+    static constexpr int EXP_MAX = 34;    // 2^33 > 2 * refIn
+    struct RefPath {
+        PLLConfig cfg;
+        uint64_t num; // fPFD = num / den
+        uint64_t den;
+        double fPFD;
+        uint32_t numIndex; // into nums
+    };
+    uint32_t refIn;
+    std::vector< RefPath > paths; // sorted by falling PFD
+    SpurModel spur;
+    bool spurRank;
+    // prime factors of 2 * refIn, every num divides it
+    int nPrimes = 0;
+    uint64_t primes[ PRIMES_MAX ];
+    uint8_t expMax[ PRIMES_MAX ];
+    uint64_t primePow[ PRIMES_MAX ][ EXP_MAX ];
+    // the distinct num of all paths with their prime exponents
+    std::vector< uint64_t > nums;
+    std::vector< std::array< uint8_t, PRIMES_MAX > > numExp;
+
+    void factorExp( uint64_t x, uint8_t *exp ) const;
+    void fracScale( uint64_t fFB, double *scale ) const;
+    bool candidate( const RefPath &path, const double *scale, float gain, float fracLimit,
+                    const PLLSolution &last ) const;
+    bool evaluate( const RefPath &path, uint64_t freq_Hz, uint8_t RFDiv, bool fundamental, bool exactOnly,
+                   PLLSolution &sol ) const;
+    static void insert( const PLLSolution &sol, PLLSolution *best, int topK );
+};
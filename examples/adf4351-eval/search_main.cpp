@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Search the best reference path and feedback configuration for a list of frequencies
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctype.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "adf4351.h"
+#include "locktime.h"
+#include "regindex.h"
+#include "search.h"
+
+
+int main( int argc, char *argv[] ) {
+    uint32_t refIn = 25000000;
+    float loopBW = 20e3;
+    int topK = 1;
+    unsigned nThreads = 0;
+    bool showRegs = false;
+    bool quiet = false;
+    const char *indexFile = nullptr;
+    const char *filterFile = nullptr;
+    std::vector< uint64_t > freqs;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "b:F:hI:j:k:L:qr:Rs:" ) ) != -1 )
+        switch ( c ) {
+        case 'b': // loop bandwidth for the spur estimate
+            loopBW = float( ADF4351::parseFreq( optarg ) );
+            break;
+        case 'F': { // file with one frequency per line
+            FILE *fp = fopen( optarg, "r" );
+            if ( !fp ) {
+                perror( optarg );
+                return 1;
+            }
+            char line[ 80 ];
+            while ( fgets( line, sizeof( line ), fp ) )
+                if ( isdigit( *line ) || *line == '.' )
+                    freqs.push_back( uint64_t( ADF4351::parseFreq( line ) + 0.5 ) );
+            fclose( fp );
+            break;
+        }
+        case 'I': // register index file
+            indexFile = optarg;
+            break;
+        case 'j': // number of threads
+            nThreads = strtoul( optarg, nullptr, 0 );
+            break;
+        case 'k': // number of solutions per frequency
+            topK = atoi( optarg );
+            break;
+        case 'L': // loop filter description for the lock time
+            filterFile = optarg;
+            break;
+        case 'q': // only the summary
+            quiet = true;
+            break;
+        case 'r': // reference frequency
+            refIn = uint32_t( ADF4351::parseFreq( optarg ) + 0.5 );
+            break;
+        case 'R': // show registers
+            showRegs = true;
+            break;
+        case 's': { // start,stop,step
+            char *next = optarg;
+            double start = ADF4351::parseFreq( next, &next );
+            double stop = *next == ',' ? ADF4351::parseFreq( next + 1, &next ) : start;
+            double step = *next == ',' ? ADF4351::parseFreq( next + 1, &next ) : 0;
+            if ( step <= 0 || stop < start ) {
+                fprintf( stderr, "bad sweep argument '-s%s'\n", optarg );
+                return 1;
+            }
+            for ( double f = start; f <= stop + step / 2; f += step )
+                freqs.push_back( uint64_t( f + 0.5 ) );
+            break;
+        }
+        case 'h': // help
+            puts( "adf4351-search [-b BW] [-F FILE] [-h] [-I INDEX] [-j THREADS] [-k COUNT] [-L FILTER] [-q] [-r REF] [-R] [-s START,STOP,STEP] [FREQ ...]\n"
+                  "  -b BW    : loop bandwidth of the spur estimate (default 20k), 0: rank without spur estimate\n"
+                  "  -F FILE  : read frequencies from FILE, one per line\n"
+                  "  -h       : show this help\n"
+                  "  -I INDEX : look up the best solutions in the register index file INDEX first,\n"
+                  "             new solutions are added to it (only with '-k 1')\n"
+                  "  -j N     : number of threads (default: all cores)\n"
+                  "  -k COUNT : show the COUNT best solutions per frequency (default 1)\n"
+                  "  -L FILTER: predict the lock time of each hop with the loop filter description FILTER,\n"
+                  "             and tune CP current, fast lock and band select clock for the shortest time\n"
+                  "  -q       : show only the summary\n"
+                  "  -r REF   : reference frequency (default 25 MHz)\n"
+                  "  -R       : show the register values R0..R5\n"
+                  "  -s START,STOP,STEP : frequency grid\n"
+                  "  frequencies: float value with optional suffix 'k', 'M', 'G' like adf4351-eval -f" );
+            return 1;
+        case '?':
+            if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c' or missing argument.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+    for ( int iii = optind; iii < argc; ++iii )
+        freqs.push_back( uint64_t( ADF4351::parseFreq( argv[ iii ] ) + 0.5 ) );
+    if ( freqs.empty() ) {
+        fprintf( stderr, "no frequency given, see '-h'\n" );
+        return 1;
+    }
+    if ( topK < 1 )
+        topK = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    PLLSearch search( refIn, loopBW );
+    // index entries depend on the ranking, the low bits hold the loop bandwidth of the spur estimate
+    const uint32_t config = RegIndex::CONFIG_SEARCH | ( uint32_t( std::max( loopBW, 0.0f ) ) & 0x7FFFFFFF );
+    std::vector< PLLSolution > result;
+    RegIndex index;
+    size_t hits = 0;
+    if ( indexFile && topK == 1 && index.open( indexFile, true ) ) {
+        // solve only the frequencies that are not yet in the index
+        std::vector< uint64_t > missing;
+        std::vector< size_t > miss; // position of missing[ k ] in freqs
+        result.resize( freqs.size() );
+        for ( size_t iii = 0; iii < freqs.size(); ++iii ) {
+            const RegIndexEntry *e = index.find( refIn, config, freqs[ iii ] );
+            if ( e ) {
+                result[ iii ] = PLLSearch::fromRegs( refIn, freqs[ iii ], e->reg, e->error_Hz );
+                search.scoreSpur( result[ iii ] );
+                ++hits;
+            } else {
+                missing.push_back( freqs[ iii ] );
+                miss.push_back( iii );
+            }
+        }
+        std::vector< PLLSolution > solved = search.solve( missing, 1, nThreads );
+        std::vector< RegIndexEntry > add;
+        for ( size_t kkk = 0; kkk < miss.size(); ++kkk ) {
+            result[ miss[ kkk ] ] = solved[ kkk ];
+            if ( !solved[ kkk ].valid )
+                continue;
+            RegIndexEntry e{ { refIn, config, missing[ kkk ] }, {}, solved[ kkk ].error_Hz };
+            PLLSearch::buildRegs( solved[ kkk ], e.reg );
+            add.push_back( e );
+        }
+        index.append( add.data(), add.size() );
+        if ( index.size() - index.sortedSize() > index.sortedSize() / 4 ) // keep the linear tail short
+            index.compact();
+    } else {
+        if ( indexFile && topK != 1 )
+            fprintf( stderr, "index is used only with '-k 1'\n" );
+        result = search.solve( freqs, topK, nThreads );
+    }
+    std::chrono::duration< double > t = std::chrono::steady_clock::now() - start;
+
+    // lock time of the hops from one best solution to the next, default and tuned settings
+    std::vector< LockTime > lockTime, lockTuned;
+    std::vector< LockHop > hops;
+    double tLock = 0;
+    if ( filterFile ) {
+        LoopFilter filter;
+        if ( !filter.load( filterFile ) ) {
+            fprintf( stderr, "cannot read loop filter description '%s'\n", filterFile );
+            return 1;
+        }
+        auto lockStart = std::chrono::steady_clock::now();
+        LockTimeModel model( filter, refIn );
+        uint64_t from = 0;
+        for ( size_t iii = 0; iii < result.size(); iii += topK ) {
+            LockHop hop;
+            PLLSearch::buildRegs( result[ iii ], hop.reg );
+            hop.from_Hz = from;
+            hops.push_back( hop );
+            if ( result[ iii ].valid )
+                from = result[ iii ].freq_Hz;
+        }
+        lockTime = model.predict( hops );
+        lockTuned = model.tune( hops, nThreads );
+        std::chrono::duration< double > tl = std::chrono::steady_clock::now() - lockStart;
+        tLock = tl.count();
+    }
+
+    size_t exact = 0, invalid = 0;
+    double maxErr = 0, maxSpur = 0, sumLock = 0, sumTuned = 0;
+    for ( size_t iii = 0; iii < result.size(); ++iii ) {
+        const PLLSolution &s = result[ iii ];
+        if ( iii % topK == 0 ) { // statistics of the best solutions
+            if ( !s.valid )
+                ++invalid;
+            else if ( s.exact )
+                ++exact;
+            else if ( std::fabs( s.error_Hz ) > maxErr )
+                maxErr = std::fabs( s.error_Hz );
+            if ( s.valid && s.spurPower > maxSpur )
+                maxSpur = s.spurPower;
+            if ( s.valid && filterFile ) {
+                sumLock += lockTime[ iii / topK ].total_s;
+                sumTuned += lockTuned[ iii / topK ].total_s;
+            }
+        }
+        if ( quiet )
+            continue;
+        if ( !s.valid ) {
+            if ( iii % topK == 0 )
+                printf( "%12llu no solution\n", (unsigned long long)s.freq_Hz );
+            continue;
+        }
+        printf( "%12llu %+10.3f Hz  R %4u%s%s  PFD %12.3f  %s  P%s  INT %5u FRAC %4u MOD %4u  DIV %2u",
+                (unsigned long long)s.freq_Hz, s.error_Hz, s.cfg.Rcounter, s.cfg.refDoubler ? " x2" : "   ",
+                s.cfg.refDiv2 ? " /2" : "   ", s.fPFD, s.cfg.fundamental ? "FUND" : "DIVD", s.cfg.prescaler89 ? "8/9" : "4/5",
+                s.INT, s.FRAC, s.MOD, 1U << s.RFDiv );
+        if ( search.spurRanking() && !s.intMode() )
+            printf( "  IBS %9.0f FS %9.0f %6.1f dBc", s.ibsOffset_Hz, s.fracOffset_Hz, SpurModel::dBc( s.spurPower ) );
+        else if ( search.spurRanking() )
+            printf( "  %*s", 37, "" );
+        if ( filterFile && iii % topK == 0 )
+            printf( "  lock %7.1f us tuned %7.1f us", lockTime[ iii / topK ].total_s * 1e6,
+                    lockTuned[ iii / topK ].total_s * 1e6 );
+        if ( showRegs ) {
+            uint32_t reg[ 6 ];
+            PLLSearch::buildRegs( s, reg );
+            if ( filterFile && iii % topK == 0 ) // tuned registers
+                memcpy( reg, hops[ iii / topK ].reg, sizeof( reg ) );
+            for ( int r = 5; r >= 0; --r )
+                printf( " %08X", reg[ r ] );
+        }
+        putchar( '\n' );
+    }
+    unsigned threads = nThreads ? nThreads : std::thread::hardware_concurrency();
+    if ( index.isOpen() )
+        fprintf( stderr, "index: %zu of %zu frequencies found, %zu entries (%zu sorted)\n", hits, freqs.size(), index.size(),
+                 index.sortedSize() );
+    fprintf( stderr, "%zu frequencies, %zu exact, %zu without solution, max error %.3f Hz\n", freqs.size(), exact, invalid,
+             maxErr );
+    if ( search.spurRanking() )
+        fprintf( stderr, "worst spur estimate %.1f dBc (loop bandwidth %.0f Hz, %s)\n", SpurModel::dBc( maxSpur ), loopBW,
+                 SpurModel::hasAVX2() ? "AVX2" : "scalar" );
+    if ( filterFile )
+        fprintf( stderr, "sum of lock times %.3f ms, tuned %.3f ms (%zu hops in %.3f s)\n", sumLock * 1e3, sumTuned * 1e3,
+                 hops.size(), tLock );
+    fprintf( stderr, "%zu distinct PFD values, %.3f s on %u threads (%.0f frequencies/s)\n",
+             search.numRefPaths(), t.count(), threads, freqs.size() / t.count() );
+}
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "shard.h"
+
+
+ShardedSweep::ShardedSweep( const std::vector< adf435x_transport > &boards,
+                            const std::vector< std::array< uint32_t, 6 > > &plan, const std::vector< double > &freq_Hz,
+                            Mode mode, uint64_t dwell_ns )
+    : boards{ boards }, plan{ plan }, freq{ freq_Hz }, mode{ mode }, dwell_ns{ dwell_ns } {
+    const size_t n = boards.size();
+    for ( size_t bbb = 0; bbb < n; ++bbb )
+        schedulers.emplace_back( new DwellScheduler( dwell_ns ) );
+    for ( size_t bbb = 0; bbb <= n; ++bbb )
+        bandStart.push_back( bbb * plan.size() / n );
+}
+
+
+void ShardedSweep::keepPoints( bool keep ) {
+    for ( auto &scheduler : schedulers )
+        scheduler->keepPoints( keep );
+}
+
+
+size_t ShardedSweep::pointIndex( size_t board, size_t k ) const {
+    if ( mode == BAND )
+        return bandStart[ board ] + k % ( bandStart[ board + 1 ] - bandStart[ board ] );
+    return ( board + k * boards.size() ) % plan.size();
+}
+
+
+uint64_t ShardedSweep::offset( size_t board, size_t k ) const {
+    const size_t n = boards.size();
+    if ( mode == BAND )
+        return k * dwell_ns + board * dwell_ns / n;
+    return ( board + k * n ) * dwell_ns / n;
+}
+
+
+void ShardedSweep::stop() {
+    for ( auto &scheduler : schedulers )
+        scheduler->stop();
+}
+
+
+bool ShardedSweep::run( unsigned repeat ) {
+    const size_t n = boards.size();
+    const size_t total = size_t( repeat ) * plan.size();
+    std::atomic< bool > error{ false };
+    std::vector< std::thread > threads;
+    t0 = Trace::now() + 1000000 + 100000 * n; // all threads are up and waiting
+    for ( size_t bbb = 0; bbb < n; ++bbb ) {
+        size_t count; // points of this board, 0: endless
+        if ( mode == BAND ) {
+            const size_t len = bandStart[ bbb + 1 ] - bandStart[ bbb ];
+            if ( !len ) // more boards than points
+                continue;
+            count = repeat * len;
+        } else {
+            if ( repeat && total <= bbb )
+                continue;
+            count = repeat ? ( total - bbb + n - 1 ) / n : 0;
+        }
+        threads.emplace_back( [ this, bbb, count, &error ]() {
+            DwellScheduler &scheduler = *schedulers[ bbb ];
+            if ( ( cpu_ >= 0 && !scheduler.pinCPU( cpu_ + bbb ) ) ||
+                 ( priority_ > 0 && !scheduler.realtime( priority_ ) ) ) {
+                error = true;
+                stop();
+                return;
+            }
+            const adf435x_transport &board = boards[ bbb ];
+            const uint32_t *last = nullptr;
+            // send the changed registers and R0, R0 last as it starts the VCO band selection
+            auto step = [ & ]( size_t k ) -> bool {
+                const uint32_t *r = plan[ pointIndex( bbb, k ) ].data();
+                const unsigned mask = last ? adf435x_changed( last, r ) | 1 : 0x3F;
+                if ( adf435x_write_regs( &board, r, mask ) != ADF435X_OK ) {
+                    error = true;
+                    stop();
+                    return false;
+                }
+                last = r;
+                return true;
+            };
+            scheduler.setStart( t0 );
+            scheduler.run( count, [ this, bbb ]( size_t k ) { return offset( bbb, k ); }, step );
+        } );
+    }
+    for ( auto &thread : threads )
+        thread.join();
+    end_ns = Trace::now();
+    return !error;
+}
+
+
+void ShardedSweep::summary( FILE *fp ) const {
+    const size_t n = boards.size();
+    if ( n == 1 ) {
+        schedulers[ 0 ]->summary( fp );
+        return;
+    }
+    uint64_t points = 0, retune = 0, median = 0;
+    for ( size_t bbb = 0; bbb < n; ++bbb ) {
+        fprintf( fp, "board %zu: ", bbb );
+        schedulers[ bbb ]->summary( fp );
+        points += schedulers[ bbb ]->lateness().count();
+        retune = std::max( retune, schedulers[ bbb ]->duration().percentile( 99 ) );
+        median = std::max( median, schedulers[ bbb ]->duration().percentile( 50 ) );
+    }
+    // the aggregate rate against one board that sweeps the same plan: every point takes the dwell time,
+    // or the retune time (USB transfers of the changed registers) measured in this run if that is longer
+    const double elapsed = ( end_ns > t0 ? end_ns - t0 : 1 ) / 1e9;
+    const double rate = points / elapsed;
+    const double single = 1e9 / std::max( dwell_ns, median );
+    fprintf( fp, "%zu boards %s: %llu points in %.3f s, %.1f points/s, 1 board (dwell %.1f us, retune p50 %.1f us) "
+                 "%.1f points/s, x %.2f\n",
+             n, name( mode ), (unsigned long long)points, elapsed, rate, dwell_ns / 1e3, median / 1e3, single,
+             rate / single );
+    if ( retune )
+        fprintf( fp, "retune p99 %.1f us: 1 board at most %.0f points/s, %zu boards %.0f points/s\n", retune / 1e3,
+                 1e9 / retune, n, n * 1e9 / retune );
+}
+
+
+bool ShardedSweep::writePoints( const char *path ) const {
+    const size_t n = boards.size();
+    if ( n == 1 )
+        return schedulers[ 0 ]->writePoints( path );
+    struct Merged {
+        SweepPoint p;
+        size_t board;
+        size_t k;
+    };
+    std::vector< Merged > merged;
+    uint64_t dropped = 0;
+    for ( size_t bbb = 0; bbb < n; ++bbb ) {
+        const DwellScheduler &scheduler = *schedulers[ bbb ];
+        for ( size_t iii = 0; iii < scheduler.pointCount(); ++iii )
+            merged.push_back( { scheduler.point( iii ), bbb, size_t( scheduler.point( iii ).index ) } );
+        dropped += scheduler.pointsDropped();
+    }
+    std::stable_sort( merged.begin(), merged.end(),
+                      []( const Merged &a, const Merged &b ) { return a.p.planned_ns < b.p.planned_ns; } );
+    FILE *fp = fopen( path, "w" );
+    if ( !fp ) {
+        perror( path );
+        return false;
+    }
+    fprintf( fp, "# index planned_ns start_ns done_ns late_ns board freq_Hz\n" );
+    if ( dropped )
+        fprintf( fp, "# %llu older points not kept\n", (unsigned long long)dropped );
+    for ( size_t iii = 0; iii < merged.size(); ++iii ) {
+        const SweepPoint &p = merged[ iii ].p;
+        fprintf( fp, "%zu %llu %llu %llu %llu %zu %.0f\n", iii, (unsigned long long)p.planned_ns,
+                 (unsigned long long)p.start_ns, (unsigned long long)p.done_ns,
+                 (unsigned long long)( p.start_ns > p.planned_ns ? p.start_ns - p.planned_ns : 0 ), merged[ iii ].board,
+                 freq[ pointIndex( merged[ iii ].board, merged[ iii ].k ) ] );
+    }
+    return fclose( fp ) == 0;
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "adf435x.h"
+#include "sweep.h"
+
+
+// One host sweep plan on several boards, e.g. synthesizers behind a switch matrix.
+// Every board has its own thread and DwellScheduler, all start at the same t0.
+// A board holds each of its points for the dwell time (retune and lock included), the boards
+// are staggered by dwell / N, so there is a new point every dwell / N while every board
+// still has the full dwell time: one board retunes while the others dwell.
+// - INTERLEAVE: board b takes the points b, b + N, b + 2N, ... of the plan, the merged stream
+//   is the plan in order
+// - BAND: board b takes the b-th contiguous part of the plan and sweeps it, small steps give
+//   short retunes (mostly R0 only) and lock times
+// With one board both are the plain host sweep.
+class ShardedSweep {
+  public:
+    enum Mode { INTERLEAVE, BAND };
+
+    // plan: registers R0..R5 of every point, freq_Hz: its frequency (for the point file)
+    ShardedSweep( const std::vector< adf435x_transport > &boards, const std::vector< std::array< uint32_t, 6 > > &plan,
+                  const std::vector< double > &freq_Hz, Mode mode, uint64_t dwell_ns );
+
+    void realtime( int priority = 80 ) { priority_ = priority; }; // SCHED_FIFO for the board threads
+    void pinCPU( int cpu ) { cpu_ = cpu; };                        // board b runs on cpu + b
+    void keepPoints( bool keep );
+
+    // repeat sweeps of the plan (0: until stop()), false if a transfer or the thread setup failed
+    bool run( unsigned repeat );
+    void stop(); // async-signal-safe
+
+    // per board jitter and the aggregate throughput compared to one board with the same dwell
+    // and the retune time measured in this run
+    void summary( FILE *fp ) const;
+    // the kept points (DwellScheduler::POINTS_MAX per board) of all boards ordered by their deadline, text lines
+    // "index planned_ns start_ns done_ns late_ns" and with more than one board "board freq_Hz"
+    bool writePoints( const char *path ) const;
+
+    static const char *name( Mode mode ) { return mode == BAND ? "band" : "interleave"; };
+
+  private:
+    size_t pointIndex( size_t board, size_t k ) const; // plan index of the k-th point of board
+    uint64_t offset( size_t board, size_t k ) const;    // deadline of the k-th point of board - t0
+
+    std::vector< adf435x_transport > boards;
+    const std::vector< std::array< uint32_t, 6 > > &plan;
+    const std::vector< double > &freq;
+    Mode mode;
+    uint64_t dwell_ns;
+    std::vector< std::unique_ptr< DwellScheduler > > schedulers;
+    std::vector< size_t > bandStart; // BAND: first plan index of every board, size N + 1
+    int cpu_ = -1;
+    int priority_ = 0;
+    uint64_t t0 = 0;
+    uint64_t end_ns = 0; // last point done
+};
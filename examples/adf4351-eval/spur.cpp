@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "spur.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define SPUR_AVX2
+#include <immintrin.h>
+#endif
+
+
+SpurModel::SpurModel( float loopBW_Hz, float ibsLevel_dBc, float fracLevel_dBc )
+    : loopBW_Hz{ loopBW_Hz }, invBW{ 1.0f / loopBW_Hz }, ibsPower{ float( std::pow( 10.0, ibsLevel_dBc / 10.0 ) ) },
+      fracPower{ float( std::pow( 10.0, fracLevel_dBc / 10.0 ) ) } {}
+
+
+// The vector code below does the same float operations in the same order,
+// do not reorder without changing both.
+void SpurModel::scoreScalar( size_t n, const uint32_t *FRAC, const uint32_t *MOD, const float *fPFD, const float *gain,
+                             float *ibsOffset_Hz, float *fracOffset_Hz, float *power ) const {
+    for ( size_t iii = 0; iii < n; ++iii ) {
+        float m = float( int32_t( MOD[ iii ] ) );
+        float x = float( int32_t( FRAC[ iii ] ) ) / m;
+        float d = std::min( x, 1.0f - x );
+        float ibs = fPFD[ iii ] * d;
+        float frac = fPFD[ iii ] / m;
+        float ri = ibs * invBW;
+        ri = ri * ri;
+        ri = ri * ri;
+        float rf = frac * invBW;
+        rf = rf * rf;
+        rf = rf * rf;
+        float p = gain[ iii ] * ( ibsPower / ( 1.0f + ri ) + fracPower / ( 1.0f + rf ) );
+        if ( FRAC[ iii ] == 0 )
+            ibs = frac = p = 0;
+        ibsOffset_Hz[ iii ] = ibs;
+        fracOffset_Hz[ iii ] = frac;
+        power[ iii ] = p;
+    }
+}
+
+
+#ifdef SPUR_AVX2
+// 8 candidates per step, the rest is done by scoreScalar()
+__attribute__( ( target( "avx2" ) ) ) static size_t scoreAVX2( size_t n, const uint32_t *FRAC, const uint32_t *MOD,
+                                                               const float *fPFD, const float *gain, float *ibsOffset_Hz,
+                                                               float *fracOffset_Hz, float *power, float invBW,
+                                                               float ibsPower, float fracPower ) {
+    const __m256 one = _mm256_set1_ps( 1.0f );
+    const __m256 vInvBW = _mm256_set1_ps( invBW );
+    const __m256 vIbsPower = _mm256_set1_ps( ibsPower );
+    const __m256 vFracPower = _mm256_set1_ps( fracPower );
+    size_t iii = 0;
+    for ( ; iii + 8 <= n; iii += 8 ) {
+        __m256i f = _mm256_loadu_si256( (const __m256i *)( FRAC + iii ) );
+        __m256 m = _mm256_cvtepi32_ps( _mm256_loadu_si256( (const __m256i *)( MOD + iii ) ) );
+        __m256 pfd = _mm256_loadu_ps( fPFD + iii );
+        __m256 x = _mm256_div_ps( _mm256_cvtepi32_ps( f ), m );
+        __m256 d = _mm256_min_ps( _mm256_sub_ps( one, x ), x ); // same operand order as std::min( x, 1 - x )
+        __m256 ibs = _mm256_mul_ps( pfd, d );
+        __m256 frac = _mm256_div_ps( pfd, m );
+        __m256 ri = _mm256_mul_ps( ibs, vInvBW );
+        ri = _mm256_mul_ps( ri, ri );
+        ri = _mm256_mul_ps( ri, ri );
+        __m256 rf = _mm256_mul_ps( frac, vInvBW );
+        rf = _mm256_mul_ps( rf, rf );
+        rf = _mm256_mul_ps( rf, rf );
+        __m256 p = _mm256_add_ps( _mm256_div_ps( vIbsPower, _mm256_add_ps( one, ri ) ),
+                                  _mm256_div_ps( vFracPower, _mm256_add_ps( one, rf ) ) );
+        p = _mm256_mul_ps( _mm256_loadu_ps( gain + iii ), p );
+        // INT mode: no spurs
+        __m256 intMode = _mm256_castsi256_ps( _mm256_cmpeq_epi32( f, _mm256_setzero_si256() ) );
+        _mm256_storeu_ps( ibsOffset_Hz + iii, _mm256_andnot_ps( intMode, ibs ) );
+        _mm256_storeu_ps( fracOffset_Hz + iii, _mm256_andnot_ps( intMode, frac ) );
+        _mm256_storeu_ps( power + iii, _mm256_andnot_ps( intMode, p ) );
+    }
+    return iii;
+}
+#endif
+
+
+bool SpurModel::hasAVX2() {
+#ifdef SPUR_AVX2
+    static const bool avx2 = __builtin_cpu_supports( "avx2" );
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+
+void SpurModel::score( size_t n, const uint32_t *FRAC, const uint32_t *MOD, const float *fPFD, const float *gain,
+                       float *ibsOffset_Hz, float *fracOffset_Hz, float *power ) const {
+    size_t done = 0;
+#ifdef SPUR_AVX2
+    if ( hasAVX2() )
+        done = scoreAVX2( n, FRAC, MOD, fPFD, gain, ibsOffset_Hz, fracOffset_Hz, power, invBW, ibsPower, fracPower );
+#endif
+    scoreScalar( n - done, FRAC + done, MOD + done, fPFD + done, gain + done, ibsOffset_Hz + done, fracOffset_Hz + done,
+                 power + done );
+}
+
+
+float SpurModel::fracLimit( float power, float gain ) const {
+    // power <= gain * fracPower / ( 1 + ( offset / BW )^4 ), solved for offset
+    float r = gain * fracPower / power - 1.0f;
+    if ( !( r >= 0 ) ) // also power = 0
+        return -1;
+    return loopBW_Hz * std::sqrt( std::sqrt( r ) );
+}
+
+
+float SpurModel::lowerBound( float fracOffset_Hz, float fPFD, float gain ) const {
+    float ri = 0.5f * fPFD * invBW;
+    ri = ri * ri;
+    ri = ri * ri;
+    float rf = fracOffset_Hz * invBW;
+    rf = rf * rf;
+    rf = rf * rf;
+    return gain * ( ibsPower / ( 1.0f + ri ) + fracPower / ( 1.0f + rf ) );
+}
+
+
+double SpurModel::dBc( float power ) {
+    return power > 0 ? 10 * std::log10( power ) : -999;
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Spur estimate for fractional-N settings, N = INT + FRAC / MOD (reduced fraction).
+// Two spur families are modelled, both vanish in INT mode (FRAC = 0):
+// - integer boundary spur at the distance of N to the next integer,
+//   offset = fPFD * min( FRAC / MOD, 1 - FRAC / MOD )
+// - fractional spur at the channel step, offset = fPFD / MOD
+// Inside the loop bandwidth the spurs pass with their base level, outside the loop
+// filter attenuates them with 40 dB/decade: att = 1 / ( 1 + ( offset / BW )^4 ).
+// With fundamental feedback the spurs are created at the VCO and reduced by the
+// RF divider (gain = 1 / divider^2), with divided feedback gain = 1.
+// The model is meant for ranking candidates, not as a prediction of absolute levels.
+class SpurModel {
+  public:
+    SpurModel( float loopBW_Hz = 20e3, float ibsLevel_dBc = -45, float fracLevel_dBc = -60 );
+
+    // Score n candidates given as structure of arrays. Results per candidate:
+    // ibsOffset_Hz: distance to the integer boundary, fracOffset_Hz: fractional spur offset,
+    // power: sum of both spurs relative to the carrier (linear, 0 in INT mode).
+    // Uses AVX2 if the CPU has it, the results are bit identical to scoreScalar().
+    void score( size_t n, const uint32_t *FRAC, const uint32_t *MOD, const float *fPFD, const float *gain,
+                float *ibsOffset_Hz, float *fracOffset_Hz, float *power ) const;
+    void scoreScalar( size_t n, const uint32_t *FRAC, const uint32_t *MOD, const float *fPFD, const float *gain,
+                      float *ibsOffset_Hz, float *fracOffset_Hz, float *power ) const;
+
+    // FRAC mode candidates with a fractional spur offset up to this limit have a spur estimate
+    // of at least power (the fractional spur alone); negative if there is no such offset
+    float fracLimit( float power, float gain ) const;
+    // lowest spur estimate of a FRAC mode candidate with the fractional spur offset fracOffset_Hz,
+    // its integer boundary offset is at most fPFD / 2
+    float lowerBound( float fracOffset_Hz, float fPFD, float gain ) const;
+
+    float getLoopBW() const { return loopBW_Hz; };
+    static bool hasAVX2();
+    static double dBc( float power ); // power as dBc, -999 for no spur
+
+  private:
+    float loopBW_Hz;
+    float invBW;     // 1 / loopBW_Hz
+    float ibsPower;  // base levels, linear
+    float fracPower;
+};
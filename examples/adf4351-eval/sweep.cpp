@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "sweep.h"
+
+
+DwellScheduler::DwellScheduler( uint64_t dwell_ns ) : dwell_ns{ dwell_ns } {}
+
+
+bool DwellScheduler::realtime( int priority ) {
+    struct sched_param param = {};
+    param.sched_priority = priority;
+    int rc = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+    if ( rc ) {
+        fprintf( stderr, "SCHED_FIFO priority %d: %s\n", priority, strerror( rc ) );
+        return false;
+    }
+    // no page faults during the sweep
+    if ( mlockall( MCL_CURRENT | MCL_FUTURE ) )
+        fprintf( stderr, "mlockall: %s\n", strerror( errno ) );
+    return true;
+}
+
+
+bool DwellScheduler::pinCPU( int cpu ) {
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    int rc = pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+    if ( rc ) {
+        fprintf( stderr, "pin to CPU %d: %s\n", cpu, strerror( rc ) );
+        return false;
+    }
+    return true;
+}
+
+
+size_t DwellScheduler::run( size_t n, const std::function< bool( size_t ) > &step ) {
+    const uint64_t dwell = dwell_ns;
+    return run( n, [ dwell ]( size_t index ) { return index * dwell; }, step );
+}
+
+
+size_t DwellScheduler::run( size_t n, const std::function< uint64_t( size_t ) > &offset_ns,
+                            const std::function< bool( size_t ) > &step ) {
+    stopping = false;
+    if ( keep_ ) // no allocation in the loop
+        points_.reserve( n ? std::min( points_.size() + n, keep_ ) : keep_ );
+    // start 1 ms from now if not set, on a deadline like all points
+    const uint64_t t0 = start_ns ? start_ns : Trace::now() + 1000000;
+    start_ns = 0;
+    size_t index = 0;
+    uint64_t planned = t0 + offset_ns( 0 );
+    for ( ; ( !n || index < n ) && !stopping; ++index ) {
+        SweepPoint p;
+        p.index = index;
+        p.planned_ns = planned;
+        struct timespec deadline = { time_t( p.planned_ns / 1000000000 ), long( p.planned_ns % 1000000000 ) };
+        while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr ) == EINTR )
+            if ( stopping )
+                return index;
+        p.start_ns = Trace::now();
+        bool more = step( index );
+        p.done_ns = Trace::now();
+        uint64_t lateNs = p.start_ns > p.planned_ns ? p.start_ns - p.planned_ns : 0;
+        late.record( lateNs );
+        busy.record( p.done_ns - p.start_ns );
+        if ( !n || index + 1 < n ) {
+            planned = t0 + offset_ns( index + 1 );
+            if ( p.start_ns >= planned )
+                ++overrun;
+        }
+        if ( points_.size() < keep_ )
+            points_.push_back( p );
+        else if ( keep_ ) {
+            points_[ oldest ] = p;
+            oldest = ( oldest + 1 ) % keep_;
+            ++dropped;
+        }
+        if ( !more ) {
+            ++index;
+            break;
+        }
+    }
+    return index;
+}
+
+
+void DwellScheduler::summary( FILE *fp ) const {
+    if ( dwell_ns )
+        fprintf( fp, "%llu points, dwell %g us, %llu overruns\n", (unsigned long long)late.count(), dwell_ns / 1e3,
+                 (unsigned long long)overrun );
+    else
+        fprintf( fp, "%llu points, %llu overruns\n", (unsigned long long)late.count(), (unsigned long long)overrun );
+    fprintf( fp, "           min us    p50 us    p90 us    p99 us  p99.9 us    max us\n" );
+    const Trace::Histogram *h[] = { &late, &busy };
+    const char *title[] = { "late  ", "retune" };
+    for ( int iii = 0; iii < 2; ++iii )
+        fprintf( fp, "%s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", title[ iii ], h[ iii ]->minimum() / 1e3,
+                 h[ iii ]->percentile( 50 ) / 1e3, h[ iii ]->percentile( 90 ) / 1e3, h[ iii ]->percentile( 99 ) / 1e3,
+                 h[ iii ]->percentile( 99.9 ) / 1e3, h[ iii ]->maximum() / 1e3 );
+}
+
+
+bool DwellScheduler::writePoints( const char *path ) const {
+    FILE *fp = fopen( path, "w" );
+    if ( !fp ) {
+        perror( path );
+        return false;
+    }
+    fprintf( fp, "# index planned_ns start_ns done_ns late_ns\n" );
+    if ( dropped )
+        fprintf( fp, "# %llu older points not kept\n", (unsigned long long)dropped );
+    for ( size_t iii = 0; iii < pointCount(); ++iii ) {
+        const SweepPoint &p = point( iii );
+        fprintf( fp, "%llu %llu %llu %llu %lld\n", (unsigned long long)p.index, (unsigned long long)p.planned_ns,
+                 (unsigned long long)p.start_ns, (unsigned long long)p.done_ns,
+                 (long long)( p.start_ns - p.planned_ns ) );
+    }
+    return fclose( fp ) == 0;
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "trace.h"
+
+
+// timestamps of one sweep point, CLOCK_MONOTONIC ns
+struct SweepPoint {
+    uint64_t index;      // point index of run()
+    uint64_t planned_ns; // deadline
+    uint64_t start_ns;   // step() called
+    uint64_t done_ns;    // step() returned
+};
+
+
+// Calls a step function at absolute deadlines t0 + index * dwell.
+// The thread sleeps with clock_nanosleep( TIMER_ABSTIME ) so the schedule does not drift,
+// a late point is issued at once and the following points keep their deadlines.
+// Lateness (start - planned) and step duration go into histograms for the jitter report.
+class DwellScheduler {
+  public:
+    explicit DwellScheduler( uint64_t dwell_ns = 0 );
+
+    // run the calling thread with SCHED_FIFO and lock its memory, needs CAP_SYS_NICE
+    bool realtime( int priority = 80 );
+    // pin the calling thread to one CPU
+    bool pinCPU( int cpu );
+    // keep the timestamps of the last max points for writePoints(), older ones are overwritten,
+    // an endless sweep does not grow without bound (32 byte per point)
+    static constexpr size_t POINTS_MAX = 1 << 20;
+    void keepPoints( bool keep, size_t max = POINTS_MAX ) { keep_ = keep ? max : 0; };
+    // t0 of the next run(), CLOCK_MONOTONIC ns, the same for several schedulers (one per board);
+    // 0 (default): 1 ms after run() is called
+    void setStart( uint64_t t0_ns ) { start_ns = t0_ns; };
+
+    // call step( index ) for index = 0 .. n - 1 (n = 0: until stop() or step() returns false),
+    // returns the number of points done
+    size_t run( size_t n, const std::function< bool( size_t ) > &step );
+    // same with the deadline t0 + offset_ns( index ) instead of t0 + index * dwell,
+    // offset_ns() must not decrease, it is called once per index in order before step( index )
+    size_t run( size_t n, const std::function< uint64_t( size_t ) > &offset_ns,
+                const std::function< bool( size_t ) > &step );
+    void stop() { stopping = true; }; // async-signal-safe
+
+    const Trace::Histogram &lateness() const { return late; };
+    const Trace::Histogram &duration() const { return busy; };
+    uint64_t overruns() const { return overrun; }; // points that started after the deadline of the next one
+    // kept points, oldest first
+    size_t pointCount() const { return points_.size(); };
+    const SweepPoint &point( size_t iii ) const { return points_[ ( oldest + iii ) % points_.size() ]; };
+    uint64_t pointsDropped() const { return dropped; }; // overwritten by newer points
+
+    void summary( FILE *fp ) const;
+    // text lines "index planned_ns start_ns done_ns late_ns"
+    bool writePoints( const char *path ) const;
+
+  private:
+    uint64_t dwell_ns;
+    size_t keep_ = 0; // ring size of points_, 0: off
+    uint64_t start_ns = 0;
+    std::atomic< bool > stopping{ false };
+    Trace::Histogram late;
+    Trace::Histogram busy;
+    uint64_t overrun = 0;
+    std::vector< SweepPoint > points_;
+    size_t oldest = 0; // ring position of the oldest point when full
+    uint64_t dropped = 0;
+};
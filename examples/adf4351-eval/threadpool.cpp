@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include "threadpool.h"
+
+
+// index of the pool worker running on this thread, -1 on other threads
+static thread_local int workerIndex = -1;
+static thread_local const ThreadPool *workerPool = nullptr;
+
+
+ThreadPool::ThreadPool( unsigned nThreads ) {
+    if ( !nThreads )
+        nThreads = std::thread::hardware_concurrency();
+    if ( !nThreads )
+        nThreads = 1;
+    for ( unsigned iii = 0; iii < nThreads; ++iii )
+        queues.emplace_back( new Queue );
+    for ( unsigned iii = 0; iii < nThreads; ++iii )
+        threads.emplace_back( &ThreadPool::worker, this, iii );
+}
+
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard< std::mutex > lock( m );
+        stop = true;
+    }
+    cvWork.notify_all();
+    for ( auto &t : threads )
+        t.join();
+}
+
+
+void ThreadPool::submit( std::function< void() > task ) {
+    unsigned q = ( workerPool == this ) ? workerIndex : nextQueue++ % queues.size();
+    ++pending;
+    {
+        std::lock_guard< std::mutex > lock( queues[ q ]->m );
+        queues[ q ]->tasks.push_back( std::move( task ) );
+    }
+    {
+        std::lock_guard< std::mutex > lock( m );
+        ++queued;
+    }
+    cvWork.notify_one();
+}
+
+
+// newest task of the own queue, else the oldest task of another queue
+bool ThreadPool::pop( unsigned self, std::function< void() > &task ) {
+    {
+        Queue &q = *queues[ self ];
+        std::lock_guard< std::mutex > lock( q.m );
+        if ( !q.tasks.empty() ) {
+            task = std::move( q.tasks.back() );
+            q.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for ( unsigned iii = 1; iii < queues.size(); ++iii ) {
+        Queue &q = *queues[ ( self + iii ) % queues.size() ];
+        std::lock_guard< std::mutex > lock( q.m );
+        if ( !q.tasks.empty() ) {
+            task = std::move( q.tasks.front() );
+            q.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPool::worker( unsigned self ) {
+    workerIndex = self;
+    workerPool = this;
+    std::function< void() > task;
+    while ( true ) {
+        if ( pop( self, task ) ) {
+            task();
+            task = nullptr;
+            if ( --pending == 0 ) {
+                std::lock_guard< std::mutex > lock( m );
+                cvDone.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock< std::mutex > lock( m );
+        cvWork.wait( lock, [ this ] { return stop || queued > 0; } );
+        if ( stop && queued == 0 )
+            return;
+    }
+}
+
+
+void ThreadPool::wait() {
+    std::unique_lock< std::mutex > lock( m );
+    cvDone.wait( lock, [ this ] { return pending == 0; } );
+}
+
+
+void ThreadPool::split( size_t begin, size_t end, size_t grain, const std::function< void( size_t, size_t ) > *fn ) {
+    while ( end - begin > grain ) { // keep the first half, offer the second half to thieves
+        size_t mid = begin + ( end - begin ) / 2;
+        submit( [ this, mid, end, grain, fn ] { split( mid, end, grain, fn ); } );
+        end = mid;
+    }
+    ( *fn )( begin, end );
+}
+
+
+void ThreadPool::parallelFor( size_t begin, size_t end, size_t grain, const std::function< void( size_t, size_t ) > &fn ) {
+    if ( begin >= end )
+        return;
+    if ( !grain )
+        grain = 1;
+    submit( [ this, begin, end, grain, &fn ] { split( begin, end, grain, &fn ); } );
+    wait();
+}
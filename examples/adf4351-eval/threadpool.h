@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Work-stealing thread pool
+// Every worker has its own task queue, it takes new work from the back of it
+// and steals from the front of the other queues when it runs empty.
+// Tasks submitted by a worker go to its own queue, other tasks round robin.
+class ThreadPool {
+  public:
+    explicit ThreadPool( unsigned nThreads = 0 ); // 0: one thread per core
+    ~ThreadPool();
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool &operator=( const ThreadPool & ) = delete;
+
+    unsigned size() const { return threads.size(); };
+    void submit( std::function< void() > task );
+    void wait(); // until all submitted tasks are done, not from inside a task
+    // call fn( first, last ) for chunks of at most grain elements of [ begin, end ),
+    // the range is split recursively so idle workers can steal the other halves
+    void parallelFor( size_t begin, size_t end, size_t grain, const std::function< void( size_t, size_t ) > &fn );
+
+  private:
+    struct Queue {
+        std::mutex m;
+        std::deque< std::function< void() > > tasks;
+    };
+    std::vector< std::unique_ptr< Queue > > queues;
+    std::vector< std::thread > threads;
+    std::mutex m;
+    std::condition_variable cvWork;
+    std::condition_variable cvDone;
+    std::atomic< size_t > queued{ 0 };  // tasks in the queues
+    std::atomic< size_t > pending{ 0 }; // tasks not yet finished
+    std::atomic< unsigned > nextQueue{ 0 };
+    bool stop = false;
+
+    bool pop( unsigned self, std::function< void() > &task );
+    void worker( unsigned self );
+    void split( size_t begin, size_t end, size_t grain, const std::function< void( size_t, size_t ) > *fn );
+};
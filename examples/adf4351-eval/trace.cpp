@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include <algorithm>
+#include <chrono>
+
+#include "trace.h"
+
+
+namespace Trace {
+
+const char *name( Request request ) {
+    static const char *names[ N_REQUEST ] = { "SET_REG", "GET_MUX", "EE_REGS", "SET_FREQ", "SWEEP", "GET_STATE", "KEY", "COUNT_MUX" };
+    return request < N_REQUEST ? names[ request ] : "?";
+}
+
+
+uint64_t Histogram::highestEquivalent( size_t idx ) {
+    if ( idx < ( 1 << SUB_BITS ) )
+        return idx;
+    int shift = int( idx >> ( SUB_BITS - 1 ) ) - 1;
+    uint64_t sub = idx - ( size_t( shift ) << ( SUB_BITS - 1 ) );
+    return ( ( sub + 1 ) << shift ) - 1;
+}
+
+
+uint64_t Histogram::percentile( double p ) const {
+    uint64_t n = count();
+    if ( !n )
+        return 0;
+    uint64_t target = uint64_t( p / 100 * n + 0.5 );
+    if ( target < 1 )
+        target = 1;
+    uint64_t sum = 0;
+    for ( size_t iii = 0; iii < N_BUCKET; ++iii ) {
+        sum += counts[ iii ].load( std::memory_order_relaxed );
+        if ( sum >= target )
+            return std::min( highestEquivalent( iii ), maximum() );
+    }
+    return maximum();
+}
+
+
+Tracer::Tracer( size_t ringSize ) {
+    size_t size = 1;
+    while ( size < ringSize )
+        size <<= 1;
+    ring.reset( new Slot[ size ] );
+    for ( size_t iii = 0; iii < size; ++iii )
+        ring[ iii ].seq.store( iii, std::memory_order_relaxed );
+    mask = size - 1;
+}
+
+
+Tracer::~Tracer() { stopDump(); }
+
+
+// stops at the first slot that is claimed but not yet filled, it comes with the next call
+size_t Tracer::drain( Event *out, size_t max ) {
+    size_t n = 0;
+    for ( ; n < max; ++n, ++tail ) {
+        Slot &slot = ring[ tail & mask ];
+        if ( slot.seq.load( std::memory_order_acquire ) != tail + 1 )
+            break;
+        out[ n ] = slot.event;
+        slot.seq.store( tail + mask + 1, std::memory_order_release );
+    }
+    return n;
+}
+
+
+bool Tracer::startDump( const char *path ) {
+    stopDump();
+    dumpFile = fopen( path, "w" );
+    if ( !dumpFile ) {
+        perror( path );
+        return false;
+    }
+    fprintf( dumpFile, "# start_ns request duration_ns rc value device\n" );
+    stopping = false;
+    dumping = true;
+    dumper = std::thread( &Tracer::dumpThread, this );
+    return true;
+}
+
+
+void Tracer::stopDump() {
+    if ( !dumper.joinable() )
+        return;
+    dumping = false;
+    stopping = true;
+    dumper.join();
+    if ( droppedCount() )
+        fprintf( dumpFile, "# %llu events dropped\n", (unsigned long long)droppedCount() );
+    fclose( dumpFile );
+    dumpFile = nullptr;
+}
+
+
+void Tracer::dumpThread() {
+    Event events[ 256 ];
+    while ( true ) {
+        bool last = stopping.load(); // drain once more after the producer has stopped
+        size_t n;
+        while ( ( n = drain( events, 256 ) ) )
+            for ( size_t iii = 0; iii < n; ++iii )
+                fprintf( dumpFile, "%llu %s %u %d 0x%08X %u\n", (unsigned long long)events[ iii ].start_ns,
+                         name( Request( events[ iii ].request ) ), events[ iii ].duration_ns, events[ iii ].rc,
+                         events[ iii ].value, events[ iii ].device );
+        if ( last )
+            break;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    }
+}
+
+
+void Tracer::summary( FILE *fp ) const {
+    fprintf( fp, "request      count errors    min us    p50 us    p90 us    p99 us  p99.9 us    max us\n" );
+    for ( int rrr = 0; rrr < N_REQUEST; ++rrr ) {
+        const Histogram &h = histograms[ rrr ];
+        if ( !h.count() )
+            continue;
+        fprintf( fp, "%-8s %9llu %6llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name( Request( rrr ) ),
+                 (unsigned long long)h.count(), (unsigned long long)errorCount( Request( rrr ) ), h.minimum() / 1e3,
+                 h.percentile( 50 ) / 1e3, h.percentile( 90 ) / 1e3, h.percentile( 99 ) / 1e3,
+                 h.percentile( 99.9 ) / 1e3, h.maximum() / 1e3 );
+    }
+    if ( droppedCount() )
+        fprintf( fp, "%llu trace events dropped\n", (unsigned long long)droppedCount() );
+}
+
+
+Tracer &tracer() {
+    static Tracer instance;
+    return instance;
+}
+
+} // namespace Trace
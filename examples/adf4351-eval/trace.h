@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+
+// Tracing of the USB control transfers to the eval board.
+// Every transfer is timed with the monotonic clock and recorded
+// - in a latency histogram per request type (always, a few ns),
+// - as event in a multi producer, single consumer ring buffer while a dump to file is running;
+//   a background thread drains the ring, events are dropped (and counted) if the ring is full.
+// Several threads (e.g. one per eval board) may record without a lock: the histograms count
+// with atomic increments, every ring slot carries a sequence number that tells producers
+// and the consumer whose turn it is.
+// Compile with -DADF_TRACE, without it the ADF_TRACE_* macros expand to nothing.
+namespace Trace {
+
+#ifdef ADF_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+enum Request : uint8_t {
+    SET_REG, // 0xDD
+    GET_MUX, // 0xDF
+    EE_REGS, // 0xDE
+    SET_FREQ, // 0xD0
+    SWEEP,    // 0xD1
+    GET_STATE, // 0xE2
+    KEY,       // 0xD2, 0xD3
+    COUNT_MUX, // 0xE4
+    N_REQUEST
+};
+
+const char *name( Request request );
+
+
+inline uint64_t now() { // monotonic ns
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return uint64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+
+struct Event {
+    uint64_t start_ns;    // monotonic clock
+    uint32_t duration_ns; // saturated
+    int16_t rc;           // return code of libusb_control_transfer()
+    uint8_t request;      // Request
+    uint8_t device;       // eval board index
+    uint32_t value; // request data, e.g. the register value
+};
+
+
+// HDR style histogram: log-linear buckets with 2^(SUB_BITS-1) sub-buckets per power of two,
+// the relative error of a recorded value is below 2^-(SUB_BITS-1) (1.6 %) from 1 ns to 1100 s.
+// Any number of writers and readers.
+class Histogram {
+  public:
+    static constexpr int SUB_BITS = 7;
+    static constexpr int MAX_MSB = 39; // larger values are counted in the last bucket
+    static constexpr size_t N_BUCKET = ( MAX_MSB - SUB_BITS + 3 ) << ( SUB_BITS - 1 );
+
+    void record( uint64_t value_ns ) {
+        counts[ index( value_ns ) ].fetch_add( 1, std::memory_order_relaxed );
+        total.fetch_add( 1, std::memory_order_relaxed );
+        uint64_t m = max.load( std::memory_order_relaxed );
+        while ( value_ns > m && !max.compare_exchange_weak( m, value_ns, std::memory_order_relaxed ) )
+            ;
+        m = min.load( std::memory_order_relaxed );
+        while ( value_ns < m && !min.compare_exchange_weak( m, value_ns, std::memory_order_relaxed ) )
+            ;
+    }
+    uint64_t count() const { return total.load( std::memory_order_relaxed ); }
+    uint64_t minimum() const { return count() ? min.load( std::memory_order_relaxed ) : 0; }
+    uint64_t maximum() const { return max.load( std::memory_order_relaxed ); }
+    // highest value equivalent to the bucket that contains the percentile (0...100)
+    uint64_t percentile( double p ) const;
+
+    static size_t index( uint64_t value ) {
+        if ( value < ( 1 << SUB_BITS ) )
+            return value;
+        int msb = 63 - __builtin_clzll( value );
+        if ( msb > MAX_MSB )
+            return N_BUCKET - 1;
+        int shift = msb - ( SUB_BITS - 1 );
+        return ( size_t( shift ) << ( SUB_BITS - 1 ) ) + ( value >> shift );
+    }
+    static uint64_t highestEquivalent( size_t idx ); // largest value with this index
+
+  private:
+    std::atomic< uint64_t > counts[ N_BUCKET ] = {};
+    std::atomic< uint64_t > total{ 0 };
+    std::atomic< uint64_t > max{ 0 };
+    std::atomic< uint64_t > min{ UINT64_MAX };
+};
+
+
+class Tracer {
+  public:
+    explicit Tracer( size_t ringSize = 1 << 16 ); // rounded up to a power of two
+    ~Tracer();
+
+    // producer side, any thread
+    void record( Request request, uint64_t start_ns, uint64_t end_ns, int rc, uint32_t value, uint8_t device = 0 ) {
+        uint64_t duration = end_ns - start_ns;
+        histograms[ request ].record( duration );
+        if ( rc < 0 )
+            errors[ request ].fetch_add( 1, std::memory_order_relaxed );
+        if ( dumping.load( std::memory_order_relaxed ) )
+            push( { start_ns, duration > UINT32_MAX ? UINT32_MAX : uint32_t( duration ), int16_t( rc ),
+                    uint8_t( request ), device, value } );
+    }
+
+    // consumer side
+    // write all events as text lines "start_ns request duration_ns rc value device" to path
+    // until stopDump(), the file is written by a background thread
+    bool startDump( const char *path );
+    void stopDump();
+    size_t drain( Event *out, size_t max ); // take up to max events from the ring
+    // latency table of all request types that were used
+    void summary( FILE *fp ) const;
+
+    const Histogram &histogram( Request request ) const { return histograms[ request ]; }
+    uint64_t errorCount( Request request ) const { return errors[ request ].load( std::memory_order_relaxed ); }
+    uint64_t droppedCount() const { return dropped.load( std::memory_order_relaxed ); }
+
+  private:
+    // slot seq == pos: free for the producer that claims pos,
+    // seq == pos + 1: filled for the consumer, which frees it for the next round with pos + size
+    struct Slot {
+        std::atomic< size_t > seq;
+        Event event;
+    };
+
+    bool push( const Event &event ) {
+        size_t pos = head.load( std::memory_order_relaxed );
+        Slot *slot;
+        while ( true ) {
+            slot = &ring[ pos & mask ];
+            const ptrdiff_t diff = ptrdiff_t( slot->seq.load( std::memory_order_acquire ) - pos );
+            if ( diff == 0 ) { // free, claim it (pos is reloaded if another producer was faster)
+                if ( head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
+            } else if ( diff < 0 ) { // not yet taken by the consumer: full
+                dropped.fetch_add( 1, std::memory_order_relaxed );
+                return false;
+            } else // claimed by another producer
+                pos = head.load( std::memory_order_relaxed );
+        }
+        slot->event = event;
+        slot->seq.store( pos + 1, std::memory_order_release );
+        return true;
+    }
+    void dumpThread();
+
+    Histogram histograms[ N_REQUEST ];
+    std::atomic< uint64_t > errors[ N_REQUEST ] = {};
+
+    std::unique_ptr< Slot[] > ring;
+    size_t mask;
+    alignas( 64 ) std::atomic< size_t > head{ 0 }; // next position claimed by a producer
+    std::atomic< uint64_t > dropped{ 0 };
+    alignas( 64 ) size_t tail = 0;                 // next position of the consumer
+
+    std::atomic< bool > dumping{ false };
+    std::atomic< bool > stopping{ false };
+    FILE *dumpFile = nullptr;
+    std::thread dumper;
+};
+
+
+// process wide tracer used by the ADF_TRACE_* macros
+Tracer &tracer();
+
+} // namespace Trace
+
+
+#ifdef ADF_TRACE
+// ADF_TRACE_START( t ); transfer; ADF_TRACE_STOP( t, SET_REG, rc, reg, device );
+#define ADF_TRACE_START( t ) const uint64_t t = Trace::now()
+#define ADF_TRACE_STOP( t, request, rc, value, device ) \
+    Trace::tracer().record( Trace::request, t, Trace::now(), rc, value, device )
+#else
+#define ADF_TRACE_START( t ) \
+    do {                     \
+    } while ( 0 )
+#define ADF_TRACE_STOP( t, request, rc, value, device ) \
+    do {                                                \
+    } while ( 0 )
+#endif
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+# compare freq_make_regs_array() (libadf435x via adf435x._core) with calculate_regs() and make_regs():
+# time for 1M frequencies and the register words that differ, counted per difference
+# build the extension with "python3 setup.py build_ext --inplace"
+
+from array import array
+from collections import Counter
+import sys
+import time
+
+from adf435x import core
+
+N = int(sys.argv[1]) if len(sys.argv) > 1 else 1000000
+f_min, f_max = 35.0, 4400.0
+freqs = array('d', (f_min + (f_max - f_min) * iii / (N - 1) for iii in range(N)))
+
+
+def python_regs(freq):
+    INT, MOD, FRAC, output_divider, band_select_clock_divider = core.calculate_regs(freq=freq)
+    return core.make_regs(INT=INT, MOD=MOD, FRAC=FRAC, output_divider=output_divider,
+            band_select_clock_divider=band_select_clock_divider, mux_out=core.MuxOut.DigitalLockDetect)
+
+
+t0 = time.perf_counter()
+regs_py = array('I')
+for freq in freqs:
+    regs_py.extend(python_regs(freq))
+t1 = time.perf_counter()
+regs_lib = core.freq_make_regs_array(freqs)
+t2 = time.perf_counter()
+
+print('%d frequencies %.3f ... %.3f MHz' % (N, f_min, f_max))
+print('python:     %8.3f s  %10.0f freq/s' % (t1 - t0, N / (t1 - t0)))
+print('libadf435x: %8.3f s  %10.0f freq/s  (x %.0f)' % (t2 - t1, N / (t2 - t1), (t1 - t0) / (t2 - t1)))
+
+# make_regs() sets LDF (R2 DB8) for FRAC != 0, libadf435x sets LDF and LDP (DB7) for INT-N as in the
+# datasheet; FRAC rounded up to MOD is INT + 1 in libadf435x, calculate_regs() reduces it to
+# FRAC / MOD = 1 / 2 (INT + 0.5)
+R2_LD = 3 << 7
+diffs = Counter()
+first = {}
+for iii in range(N):
+    py, lib = regs_py[6 * iii:6 * iii + 6], regs_lib[6 * iii:6 * iii + 6]
+    if py == lib:
+        continue
+    if py[0] != lib[0] or py[1] != lib[1]:
+        kind = 'R0/R1 (INT, FRAC, MOD)'
+    elif py[2] & ~R2_LD == lib[2] & ~R2_LD and py[3:] == lib[3:]:
+        kind = 'R2 LDF/LDP only'
+    else:
+        kind = 'R%d' % next(r for r in range(2, 6) if py[r] != lib[r])
+    diffs[kind] += 1
+    first.setdefault(kind, iii)
+for kind, count in sorted(diffs.items()):
+    iii = first[kind]
+    print('%-24s %8d  first at %r MHz: %s != %s' % (kind, count, freqs[iii],
+            [hex(r) for r in regs_py[6 * iii:6 * iii + 6]], [hex(r) for r in regs_lib[6 * iii:6 * iii + 6]]))
+if not diffs:
+    print('register words identical')
+
+# configurations that must be rejected
+cases = [
+    ([30.0], {}),
+    ([4600], {}),
+    ([100.0], {'device_type': core.DeviceType.ADF4350}),
+    ([float('nan')], {}),
+    ([100.0], {'r_counter': 0}),
+    ([100.0], {'r_counter': 1}),
+    ([100.0], {'r_counter': 2000}),
+]
+for freqs, kwargs in cases:
+    try:
+        result = 'accepted'
+        core.freq_make_regs_array(freqs, **kwargs)
+    except ValueError as e:
+        result = 'ValueError: %s' % e
+    print('%r %r -> %s' % (freqs, kwargs, result))
@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.5 or later
+# map the FW timer and the USB frame numbers to the host CLOCK_MONOTONIC and
+# print the lock events on the host timeline, e.g. to merge them with the log
+# of another instrument that uses the same host clock
+# MUXOUT must be set to digital lock detect (default of freq_make_regs)
+
+from adf435x.interfaces import FX2, ClockSync, EVENT_UNLOCK, EVENT_LOCK, EVENT_R0, EVENT_RELOCK
+import sys
+import time
+
+interval = float( sys.argv[1] ) if len( sys.argv ) > 1 else 1.0 # poll interval in s, < 2 s
+
+intf = FX2()
+clock = ClockSync( intf )
+clock.sample( 64 )
+print( f'{"full" if clock.full_speed else "high"} speed, host {clock.host_drift_ppm():+.1f} ppm, '
+       f'FX2 {clock.device_drift_ppm():+.1f} ppm against the USB bus, fit rms {clock.rms_ns / 1e3:.1f} us' )
+
+names = { EVENT_UNLOCK: 'unlocked', EVENT_LOCK: 'locked', EVENT_R0: 'R0 written', EVENT_RELOCK: 'supervisor re-lock' }
+while True:
+    lost, events = intf.get_lock_events( frames=True )
+    clock.sample( 4 ) # after the events, their frame numbers are unwrapped against it
+    if lost:
+        print( f'{lost} events lost' )
+    for ( typ, hop, ticks, frame ), ( ns, err ) in zip( events, clock.place_events( events ) ):
+        print( f'{ns / 1e9:17.6f} s +- {err / 1e3:6.1f} us  hop {hop:3d}: {names.get( typ, typ )}' )
+    sys.stdout.flush()
+    time.sleep( interval )
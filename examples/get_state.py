@@ -0,0 +1,21 @@
+#!/usr/bin/env python
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.3 or later
+# read the device state with one transfer: the registers as last written,
+# init type, lock status and write counters, instead of XRAM at a fixed address
+
+from adf435x.interfaces import FX2, EVENT_TICK_US
+
+intf = FX2()
+
+state = intf.get_state()
+
+for reg_num in range( 6 ):
+    known = "" if state[ 'written' ] & ( 1 << reg_num ) else " (not written since power-on)"
+    print( f"r{reg_num} = 0x{state[ 'regs' ][ reg_num ]:08x}{known}" )
+print( "init type:      ", ( "never", "stand-alone", "always" )[ state[ 'init_type' ] ] if state[ 'init_type' ] < 3 else state[ 'init_type' ] )
+print( "MUXOUT:         ", state[ 'mux' ] )
+print( "lock events:    ", state[ 'events' ] )
+print( "register writes:", state[ 'reg_writes' ] )
+print( "R0 writes:      ", state[ 'r0_writes' ] )
+print( "uptime:         ", f"{state[ 'ticks' ] * EVENT_TICK_US / 1e6:.3f} s (timer wraps after 1074 s)" )
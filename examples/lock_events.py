@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.1 or later
+# read the lock event log periodically and print lock times and unlock events
+# MUXOUT must be set to digital lock detect (default of freq_make_regs)
+
+from adf435x.interfaces import FX2, EVENT_UNLOCK, EVENT_LOCK, EVENT_R0, EVENT_RELOCK, EVENT_TICK_US
+import sys
+import time
+
+interval = float( sys.argv[1] ) if len( sys.argv ) > 1 else 1.0 # poll interval in s
+
+intf = FX2()
+
+while True:
+    lost, events = intf.get_lock_events()
+    if lost:
+        print( f'{lost} events lost' )
+    for typ, hop, ticks in events:
+        us = ticks * EVENT_TICK_US
+        if typ == EVENT_R0:
+            print( f'hop {hop:3d}: R0 written, {us / 1000:10.3f} ms after previous R0' )
+        elif typ == EVENT_LOCK:
+            print( f'hop {hop:3d}: locked   {us:10.1f} us after R0' )
+        elif typ == EVENT_UNLOCK:
+            print( f'hop {hop:3d}: unlocked {us:10.1f} us after R0' )
+        elif typ == EVENT_RELOCK:
+            print( f'hop {hop:3d}: R0 rewritten by the supervisor {us:10.1f} us after R0' )
+    sys.stdout.flush()
+    time.sleep( interval )
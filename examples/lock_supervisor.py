@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.7 or later
+# configure the lock supervisor and show its counters:
+# with MUXOUT = digital lock detect the FW rewrites R0 (VCO band selection) by itself
+# when the lock is lost for longer than the unlock time, without the host
+# usage: lock_supervisor.py [UNLOCK_US [RETRIES]], 0 switches it off, no argument shows the state
+# 'set_startup-stand-alone.py' or 'set_startup-always.py' store the setting in EEPROM
+
+from adf435x.interfaces import FX2, EVENT_TICK_US, SV_UNSUPERVISED
+import sys
+
+intf = FX2()
+
+if len( sys.argv ) > 1:
+    intf.set_supervisor( int( sys.argv[1] ), int( sys.argv[2] ) if len( sys.argv ) > 2 else 0 )
+
+sv = intf.get_supervisor()
+if sv[ 'unlock_us' ]:
+    print( f"unlock time:     {sv[ 'unlock_us' ]} us, rewrites per lock loss:",
+           sv[ 'retry_max' ] if sv[ 'retry_max' ] else "no limit" )
+else:
+    print( "supervisor:      off" )
+if sv[ 'state' ] == SV_UNSUPERVISED:
+    print( "not supervisable: MUXOUT is not digital lock detect" )
+print( "lock losses:    ", sv[ 'losses' ], "(unlocked without R0 write)" )
+print( "R0 rewrites:    ", sv[ 'relocks' ], f"(last at {sv[ 'ticks' ] * EVENT_TICK_US / 1e6:.6f} s)" if sv[ 'relocks' ] else "" )
+print( "recovered:      ", sv[ 'recovered' ] )
+if sv[ 'retries' ]:
+    print( "not locked after", sv[ 'retries' ], "rewrites" )
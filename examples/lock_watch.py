@@ -0,0 +1,23 @@
+#!/usr/bin/env python3
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.4 or later
+# wait for status messages of the interrupt endpoint and print every MUXOUT change,
+# no polling: the FW sends a message when MUXOUT changes or a request is done
+# MUXOUT must be set to digital lock detect (default of freq_make_regs)
+
+from adf435x.interfaces import FX2, STATUS_MUX, STATUS_DONE, STATUS_RELOCK, EVENT_TICK_US
+import sys
+
+intf = FX2()
+
+print( 'MUXOUT', intf.get_mux()[0] )
+while True:
+    status = intf.get_status( timeout=0 ) # wait forever
+    us = status[ 'ticks' ] * EVENT_TICK_US
+    if status[ 'flags' ] & STATUS_MUX:
+        print( f'{us / 1e6:12.6f} s: hop {status[ "hop" ]:3d} {"locked" if status[ "mux" ] else "unlocked"}' )
+    if status[ 'flags' ] & STATUS_RELOCK:
+        print( f'{us / 1e6:12.6f} s: hop {status[ "hop" ]:3d} R0 rewritten by the lock supervisor' )
+    if status[ 'flags' ] & STATUS_DONE:
+        print( f'{us / 1e6:12.6f} s: request 0x{status[ "request" ]:02X} done' )
+    sys.stdout.flush()
@@ -2,6 +2,8 @@
 #include <cstdio>
 #include <libusb-1.0/libusb.h>
 
+#include "adf4351.h"
+
 #define VID 0x0456
 #define PID 0xb40d
 
@@ -14,7 +16,6 @@ static int send_reg( uint32_t reg ) { return libusb_control_transfer( dev_handle
 
 int main() {
     libusb_context *context = NULL;
-    libusb_device *dev;
 
     int rc = 0;
 
@@ -30,8 +31,8 @@ int main() {
 
     // printf( "Device opened succesfully!\n" );
 
-    // register values for f = 100 MHz
-    uint32_t reg[] = { 0x3E800000, 0x08008011, 0x183EAFC2, 0x000004B3, 0x00D0043C, 0x00580005 };
+    // register values for f = 100 MHz, calculated at compile time
+    constexpr auto reg = ADF4351::Plan< 25000000, 250 >::regs< 100000000 >();
 
     for ( int r = 5; r >= 0; --r ) {
         rc = send_reg( reg[ r ] );
@@ -1,14 +1,20 @@
 #!/usr/bin/env python3
 
 from adf435x.interfaces import FX2
-from adf435x.core import freq_make_regs
+from adf435x.core import freq_make_regs_array
 import time
 
 intf = FX2()
 
+dwell = 0.1
+freqs = range(50, 100)
+# the registers of the whole sweep with one call, R0..R5 of every frequency
+regs = freq_make_regs_array(freqs)
+deadline = time.monotonic()
 while True:
-    for freq in range(50, 100):
-        regs = freq_make_regs(freq)
-        intf.set_regs(regs[::-1])
+    for iii, freq in enumerate(freqs):
+        # sleep until the absolute deadline, the USB time does not add up
+        deadline += dwell
+        time.sleep(max(0, deadline - time.monotonic()))
+        intf.set_regs(regs[6 * iii:6 * iii + 6][::-1])
         print('%0.1f MHz' % freq)
-        time.sleep(0.1)
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+// Compare the retune rate of the tinyADF ASCII and binary frame protocol
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "adf4351.h"
+#include "tinyadf.h"
+
+
+static const int nFreq = 16;
+static uint32_t regs[ nFreq ][ 6 ]; // R5..R0 for each test frequency
+
+
+// send count retunes with one protocol, return retunes per second or 0 on error
+template < typename F > static double measure( const char *name, int count, int bytes, F retune ) {
+    auto start = std::chrono::steady_clock::now();
+    for ( int iii = 0; iii < count; ++iii )
+        if ( !retune( regs[ iii % nFreq ] ) ) {
+            fprintf( stderr, "%s: retune %d failed\n", name, iii );
+            return 0;
+        }
+    std::chrono::duration< double > t = std::chrono::steady_clock::now() - start;
+    double rate = count / t.count();
+    printf( "%-16s %8.1f retunes/s  %6.2f ms/retune  %3d bytes/retune\n", name, rate, 1e3 / rate, bytes );
+    return rate;
+}
+
+
+int main( int argc, char *argv[] ) {
+    const char *device = "/dev/ttyACM0";
+    int count = 100;
+    int c;
+    opterr = 0;
+
+    while ( ( c = getopt( argc, argv, "D:hn:" ) ) != -1 )
+        switch ( c ) {
+        case 'D': // serial device
+            device = optarg;
+            break;
+        case 'n': // number of retunes per protocol
+            count = atoi( optarg );
+            break;
+        case 'h': // help
+            puts( "tinyadf-bench [-D DEVICE] [-h] [-n COUNT]\n"
+                  "  -D DEVICE : tinyADF serial device (default /dev/ttyACM0)\n"
+                  "  -h        : show this help\n"
+                  "  -n COUNT  : number of retunes per protocol (default 100)" );
+            return 1;
+        case '?':
+            if ( optopt == 'D' || optopt == 'n' )
+                fprintf( stderr, "option '-%c' requires an argument.\n", optopt );
+            else if ( isprint( optopt ) )
+                fprintf( stderr, "unknown option '-%c'.\n", optopt );
+            else
+                fprintf( stderr, "unknown option character '\\x%x'.\n", optopt );
+            return 1;
+        default:
+            return 1;
+        }
+    if ( count < 1 )
+        count = 1;
+
+    ADF4351 adf;
+    for ( int fff = 0; fff < nFreq; ++fff ) { // 100 MHz ... 1600 MHz
+        adf.calculateFreq( 100e6 * ( fff + 1 ) );
+        for ( int r = 0; r < 6; ++r )
+            regs[ fff ][ r ] = adf.getReg( 5 - r );
+    }
+
+    TINYADF tiny( device );
+    if ( !tiny.init() )
+        return 1;
+
+    printf( "%d retunes of all 6 registers\n", count );
+
+    // ASCII, as adf435x.interfaces.tinyADF does it: 9 chars out, 11 back per register
+    tiny.setEcho( true );
+    measure( "ASCII echo", count, 6 * ( 9 + 11 ), [ & ]( const uint32_t *r ) {
+        for ( int iii = 0; iii < 6; ++iii )
+            if ( !tiny.sendRegAscii( r[ iii ] ) )
+                return false;
+        return true;
+    } );
+
+    // one frame per retune: len, type, 6 * 4 byte, ACK
+    if ( !tiny.setBinary( true ) )
+        return 1;
+    measure( "binary", count, 2 + 24 + 1, [ & ]( const uint32_t *r ) { return tiny.sendRegs( r, 6 ); } );
+    tiny.useCRC = true;
+    measure( "binary CRC", count, 2 + 24 + 1 + 1, [ & ]( const uint32_t *r ) { return tiny.sendRegs( r, 6 ); } );
+    tiny.useCRC = false;
+    measure( "binary 6 frames", count, 6 * ( 2 + 4 + 1 ), [ & ]( const uint32_t *r ) {
+        for ( int iii = 0; iii < 6; ++iii )
+            if ( !tiny.sendReg( r[ iii ] ) )
+                return false;
+        return true;
+    } );
+    tiny.setBinary( false );
+}
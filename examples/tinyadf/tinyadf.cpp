@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#include "tinyadf.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+bool TINYADF::init() {
+    fd = open( device, O_RDWR | O_NOCTTY );
+    if ( fd < 0 ) {
+        fprintf( stderr, "Error: Could not open tinyADF device %s: %s\n", device, strerror( errno ) );
+        return false;
+    }
+    struct termios tio;
+    if ( tcgetattr( fd, &tio ) == 0 ) {
+        cfmakeraw( &tio );
+        tio.c_cc[ VMIN ] = 0;
+        tio.c_cc[ VTIME ] = 0;
+        tcsetattr( fd, TCSANOW, &tio );
+    }
+    // leave a binary mode of an earlier session, the ASCII parser ignores these control bytes
+    const uint8_t exitFrame[] = { 1, FRAME_EXIT };
+    write( exitFrame, sizeof( exitFrame ) );
+    usleep( 50000 );
+    tcflush( fd, TCIFLUSH );
+    return true;
+}
+
+
+TINYADF::~TINYADF() {
+    if ( fd >= 0 ) {
+        if ( binary )
+            setBinary( false );
+        close( fd );
+    }
+}
+
+
+bool TINYADF::write( const void *buf, size_t len ) {
+    const uint8_t *p = static_cast< const uint8_t * >( buf );
+    while ( len ) {
+        ssize_t n = ::write( fd, p, len );
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            fprintf( stderr, "tinyADF write: %s\n", strerror( errno ) );
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+int TINYADF::readByte() {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    uint8_t c;
+    if ( poll( &pfd, 1, timeout_ms ) <= 0 || ::read( fd, &c, 1 ) != 1 )
+        return -1;
+    return c;
+}
+
+
+// skip input until c was received
+bool TINYADF::waitFor( uint8_t c ) {
+    int r;
+    while ( ( r = readByte() ) >= 0 )
+        if ( r == c )
+            return true;
+    return false;
+}
+
+
+bool TINYADF::setEcho( bool on ) {
+    if ( binary )
+        return false;
+    if ( !write( on ? "1T" : "0T", 2 ) )
+        return false;
+    if ( echo ) // echo of the command was on
+        waitFor( 'T' );
+    echo = on;
+    usleep( 10000 );
+    tcflush( fd, TCIFLUSH ); // drop the newline
+    return true;
+}
+
+
+bool TINYADF::sendRegAscii( uint32_t reg ) {
+    char cmd[ 10 ];
+    snprintf( cmd, sizeof( cmd ), "%08XR", reg );
+    if ( binary || !write( cmd, 9 ) )
+        return false;
+    // without echo there is no feedback, with echo wait until the 'R' is back
+    return !echo || waitFor( 'R' );
+}
+
+
+bool TINYADF::setBinary( bool on ) {
+    if ( on == binary )
+        return true;
+    if ( on ) {
+        if ( !write( "X", 1 ) || !waitFor( ACK ) ) {
+            fprintf( stderr, "tinyADF: no binary mode\n" );
+            return false;
+        }
+        binary = true;
+        return true;
+    }
+    if ( !sendFrame( FRAME_EXIT, nullptr, 0 ) )
+        return false;
+    binary = false;
+    return true;
+}
+
+
+uint8_t TINYADF::crc8( uint8_t crc, uint8_t data ) { // polynomial 0x07, same as the firmware
+    crc ^= data;
+    for ( int iii = 0; iii < 8; ++iii )
+        crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x07 : crc << 1;
+    return crc;
+}
+
+
+bool TINYADF::sendFrame( uint8_t type, const uint8_t *payload, uint8_t len, uint8_t *reply ) {
+    uint8_t frame[ 32 ];
+    if ( !binary || len > 24 )
+        return false;
+    if ( useCRC )
+        type |= FRAME_CRC;
+    uint8_t n = 0;
+    frame[ n++ ] = 1 + len + ( useCRC ? 1 : 0 );
+    frame[ n++ ] = type;
+    if ( len )
+        memcpy( frame + n, payload, len );
+    n += len;
+    if ( useCRC ) {
+        uint8_t crc = 0;
+        for ( int iii = 0; iii < n; ++iii )
+            crc = crc8( crc, frame[ iii ] );
+        frame[ n++ ] = crc;
+    }
+    if ( !write( frame, n ) )
+        return false;
+    int r = readByte();
+    if ( r != ACK ) {
+        fprintf( stderr, "tinyADF frame 0x%02X: %s\n", type, r == NAK ? "NAK" : "timeout" );
+        return false;
+    }
+    if ( reply ) {
+        if ( ( r = readByte() ) < 0 )
+            return false;
+        *reply = r;
+    }
+    return true;
+}
+
+
+bool TINYADF::sendReg( uint32_t reg ) {
+    const uint8_t payload[ 4 ] = { uint8_t( reg ), uint8_t( reg >> 8 ), uint8_t( reg >> 16 ), uint8_t( reg >> 24 ) };
+    return sendFrame( FRAME_REG, payload, sizeof( payload ) );
+}
+
+
+bool TINYADF::sendRegs( const uint32_t *regs, int n ) {
+    uint8_t payload[ 24 ];
+    if ( n < 1 || n > 6 )
+        return false;
+    for ( int iii = 0; iii < 4 * n; ++iii )
+        payload[ iii ] = regs[ iii / 4 ] >> ( 8 * ( iii % 4 ) );
+    return sendFrame( FRAME_REGS, payload, 4 * n );
+}
+
+
+int TINYADF::getMux() {
+    uint8_t mux;
+    if ( !sendFrame( FRAME_MUX, nullptr, 0, &mux ) )
+        return -1;
+    return mux;
+}
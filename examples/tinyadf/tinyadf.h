@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Simple interface program for ADF4351 HF generator chip
+// Copyright (c) Martin Homuth-Rosemann 2024
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// serial interface to the tinyADF firmware (firmware/tinyADF)
+// either as ASCII commands "<hex>R" or as binary frames [len][type][payload][crc]
+class TINYADF {
+  public:
+    TINYADF( const char *device = "/dev/ttyACM0" ) : device{ device } {};
+    ~TINYADF();
+    bool init();
+    // ASCII protocol, waits for the echo of each register if echo is on
+    bool setEcho( bool on );
+    bool sendRegAscii( uint32_t reg );
+    // binary protocol, every frame is acknowledged by the device
+    bool setBinary( bool on );
+    bool sendReg( uint32_t reg );                  // one register
+    bool sendRegs( const uint32_t *regs, int n ); // 1..6 registers in one frame, sent in the given order
+    int getMux();                                  // 0 or 1, -1 on error, MUX_UNKNOWN without mux pin
+    bool useCRC = false;                           // append a CRC-8 to every frame
+    static const int MUX_UNKNOWN = 0xFF;
+
+  private:
+    const char *device;
+    int fd = -1;
+    bool echo = true;
+    bool binary = false;
+    const int timeout_ms = 200;
+    static const uint8_t FRAME_EXIT = 0x00;
+    static const uint8_t FRAME_REG = 0x01;
+    static const uint8_t FRAME_REGS = 0x02;
+    static const uint8_t FRAME_MUX = 0x03;
+    static const uint8_t FRAME_CRC = 0x80;
+    static const uint8_t ACK = 0x06;
+    static const uint8_t NAK = 0x15;
+    bool write( const void *buf, size_t len );
+    int readByte(); // -1 on timeout
+    bool waitFor( uint8_t c );
+    bool sendFrame( uint8_t type, const uint8_t *payload, uint8_t len, uint8_t *reply = nullptr );
+    static uint8_t crc8( uint8_t crc, uint8_t data );
+};
@@ -0,0 +1,25 @@
+#!/usr/bin/python
+
+# requires the new fx2 firmware (based on libfx2) version 0.4.2 or later
+# write eeprom.bin (e.g. from read_eeprom.py) back into the EEPROM and verify it by CRC32
+# with '-s' pages with unchanged content are skipped (FW 0.4.8), reprogramming the same image is fast
+
+from adf435x.interfaces import FX2
+import sys
+import time
+
+args = sys.argv[1:]
+skip_same = '-s' in args
+if skip_same:
+    args.remove( '-s' )
+name = args[0] if args else "eeprom.bin"
+
+adf = FX2()
+
+with open( name, "rb" ) as f:
+    image = f.read()
+
+start = time.monotonic()
+ok = adf.program_eeprom( image, skip_same=skip_same )
+print( f'{len( image )} byte in {time.monotonic() - start:.2f} s, CRC32 {"ok" if ok else "MISMATCH"}' )
+sys.exit( 0 if ok else 1 )
@@ -2,6 +2,8 @@
 
 #include <fx2delay.h>
 #include <fx2eeprom.h>
+#include <fx2i2c.h>
+#include <fx2ints.h>
 #include <fx2lib.h>
 #include <fx2usb.h>
 
@@ -37,6 +39,7 @@
 #define EEPROM_I2C_PAGE_EXP 5
 #define EEPROM_I2C_DOUBLE_BYTE true
 #define EEPROM_I2C_TIMEOUT 166
+#define EEPROM_I2C_POLL 1000 // ACK polls of ~25 us at 400 kHz, write cycle max. 5 ms
 // 1 eeprom page (=32 bytes) to store 6 32bit registers (=24 byte) + checksum
 #define REG_SET_SIZE 32
 // store at top af address space
@@ -54,7 +57,7 @@ usb_desc_device_c usb_device = {
     .bMaxPacketSize0 = 64,
     .idVendor = 0x0456,
     .idProduct = 0xb40d,
-    .bcdDevice = 0x0040, // FW version 0.4.0
+    .bcdDevice = 0x0048, // FW version 0.4.8
     .iManufacturer = 1,  // 1 = usb_strings[0]
     .iProduct = 2,       // 2 = usb_strings[1]
     .iSerialNumber = 3,  // 3 = usb_strings[2] if exist
@@ -66,13 +69,23 @@ usb_desc_interface_c usb_interface = {
     .bDescriptorType = USB_DESC_INTERFACE,
     .bInterfaceNumber = 0,
     .bAlternateSetting = 0,
-    .bNumEndpoints = 0,
+    .bNumEndpoints = 1,
     .bInterfaceClass = USB_IFACE_CLASS_VENDOR,
     .bInterfaceSubClass = USB_IFACE_SUBCLASS_VENDOR,
     .bInterfaceProtocol = USB_IFACE_PROTOCOL_VENDOR,
     .iInterface = 0,
 };
 
+// status messages, the host controller polls every (micro)frame and gets a NAK until there is one
+usb_desc_endpoint_c usb_endpoint_ep1_in = {
+    .bLength = sizeof( struct usb_desc_endpoint ),
+    .bDescriptorType = USB_DESC_ENDPOINT,
+    .bEndpointAddress = 1 | USB_DIR_IN,
+    .bmAttributes = USB_XFER_INTERRUPT,
+    .wMaxPacketSize = 8,
+    .bInterval = 1, // full speed 1 ms, high speed 125 us
+};
+
 usb_configuration_c usb_config = { {
                                        .bLength = sizeof( struct usb_desc_configuration ),
                                        .bDescriptorType = USB_DESC_CONFIGURATION,
@@ -82,7 +95,7 @@ usb_configuration_c usb_config = { {
                                        .bmAttributes = USB_ATTR_RESERVED_1,
                                        .bMaxPower = 100, // 200 mA
                                    },
-                                   { { .interface = &usb_interface }, { 0 } } };
+                                   { { .interface = &usb_interface }, { .endpoint = &usb_endpoint_ep1_in }, { 0 } } };
 
 // check for "earlier than 3.5", but version macros shipped in 3.6
 #if !defined( __SDCC_VERSION_MAJOR )
@@ -119,8 +132,20 @@ enum {
     USB_REQ_SET_REG = 0xDD,            // send one 32bit register
     USB_REQ_EE_REGS = 0xDE,            // store or clear default setting in EEPROM
     USB_REQ_GET_MUX = 0xDF,            // get status of the MUX pin
+    USB_REQ_GET_EVENTS = 0xE0,         // read and remove entries from the lock event log
+    USB_REQ_CRC32 = 0xE1,              // CRC32 of an EEPROM or XRAM range
+    USB_REQ_GET_STATE = 0xE2,          // registers, init type, lock status and counters in one transfer
+    USB_REQ_GET_CLOCK = 0xE3,          // timer ticks at the next USB (micro)frame start
+    USB_REQ_COUNT_MUX = 0xE4,          // count MUXOUT edges in a gate time
+    USB_REQ_SUPERVISOR = 0xE5,         // configure (OUT) or read (IN) the lock supervisor
 };
 
+// USB_REQ_CRC32 wIndex: length, this bit selects XRAM instead of the large EEPROM
+#define CRC32_XRAM 0x8000
+
+// USB_REQ_CYPRESS_EEPROM_SB/DB write wIndex: read every page first and skip it if it holds the data already
+#define EE_SKIP_SAME 0x0001
+
 // init type
 enum {
     INIT_NEVER,
@@ -129,9 +154,113 @@ enum {
 };
 
 // register and checksum setup storage
-// 6 x 32 bit register + 6 byte reserved + 1 byte init_type + 1 byte checksum
+// 6 x 32 bit register + 2 byte supervisor unlock time + 1 byte supervisor retries + 3 byte reserved
+// + 1 byte init_type + 1 byte checksum
 __xdata uint8_t reg_set[ REG_SET_SIZE ];
 
+// Lock detect event log
+// MUXOUT edges and R0 latches are timestamped with the timer 2 time base
+// (CLKOUT/12 = 4 MHz, 0.25 us per tick) relative to the last R0 latch
+// and with the USB frame number, which places them on the host timeline.
+// MUXOUT is polled in the main loop, the resolution is the loop latency.
+// keep all new xdata behind reg_set, its address is used by the host tools
+enum {
+    EVENT_UNLOCK, // MUXOUT high -> low
+    EVENT_LOCK,   // MUXOUT low -> high
+    EVENT_R0,     // R0 written, ticks = time since the previous R0
+    EVENT_RELOCK, // the supervisor rewrites R0 after a lasting unlock, an EVENT_R0 follows
+};
+
+struct lock_event {
+    uint8_t type;      // EVENT_xxx
+    uint8_t hop;       // number of R0 latches, low byte
+    uint16_t frame;    // USB frame << 3 | microframe at the event
+    uint32_t ticks;    // timer ticks since the last R0 latch
+};
+
+#define EVENT_LOG_SIZE 64   // entries, power of 2
+#define EVENT_PER_REQUEST 7 // 2 byte header + 7 x 8 byte entries fit into one EP0 packet
+__xdata struct lock_event event_log[ EVENT_LOG_SIZE ];
+
+// reply of USB_REQ_GET_STATE, little endian as the host
+struct fw_state {
+    uint32_t reg[ 6 ];   // R0..R5 as last written, from USB or the EEPROM init
+    uint8_t init_type;   // INIT_xxx stored in EEPROM
+    uint8_t mux;         // MUXOUT pin
+    uint8_t written;     // bit n: Rn written to the chip since power-on
+    uint8_t events;      // entries in the lock event log
+    uint32_t reg_writes; // register writes since power-on
+    uint32_t r0_writes;  // R0 writes since power-on
+    uint32_t ticks;      // timer 2 time base now
+};
+
+// EP1 IN status message, sent when MUXOUT changes or an OUT request is done
+// flags collect all reasons until the host has taken the previous message
+enum {
+    STATUS_MUX = 0x01,  // MUXOUT changed
+    STATUS_DONE = 0x02, // OUT request done, e.g. register written, EEPROM programmed
+    STATUS_RELOCK = 0x04, // the supervisor rewrote R0
+};
+
+struct status_msg {
+    uint8_t flags;   // STATUS_xxx since the previous message
+    uint8_t mux;     // MUXOUT pin
+    uint8_t request; // last OUT request done (STATUS_DONE)
+    uint8_t hop;     // number of R0 latches, low byte
+    uint32_t ticks;  // timer 2 time base
+};
+
+// reply of USB_REQ_GET_CLOCK
+struct fw_clock {
+    uint32_t ticks; // timer 2 time base at the start of frame
+    uint16_t frame; // USB frame << 3 | microframe that started
+    uint16_t wait;  // ticks from handling the request to the start of frame
+};
+
+// polls of the frame registers, more than 2 ms without start of frame: bus suspended
+#define CLOCK_SPIN_MAX 20000
+
+// reply of USB_REQ_COUNT_MUX
+struct fw_count {
+    uint32_t edges; // rising MUXOUT edges
+    uint32_t ticks; // gate time measured with the timer 2 time base
+};
+
+// USB_REQ_COUNT_MUX wValue: gate time in ms
+#define COUNT_GATE_MAX 1000
+
+// R2 MUXOUT field, the only lock detect mode with a level that can be polled
+#define MUX_DIGITAL_LOCK 6
+
+// Lock supervisor
+// With MUXOUT = digital lock detect the main loop rewrites R0 from reg_set when the lock
+// is lost for longer than the unlock time, the R0 latch restarts the VCO band selection.
+// The unlock time starts at the unlock edge or at the last R0, whichever is later,
+// so it must be longer than the normal lock time after a frequency change.
+// USB_REQ_SUPERVISOR OUT: wValue unlock time in us (0: off), wIndex rewrites before it gives up
+// until the next lock or register write (0: no limit); stored in EEPROM with USB_REQ_EE_REGS
+struct fw_supervisor {
+    uint16_t unlock_us; // unlock time, 0: off
+    uint8_t retry_max;  // R0 rewrites per lock loss, 0: no limit
+    uint8_t retries;    // R0 rewrites since the last lock
+    uint32_t losses;    // lock lost without an R0 write
+    uint32_t relocks;   // R0 rewrites
+    uint32_t recovered; // locks after an R0 rewrite
+    uint32_t ticks;     // timer 2 time base at the last R0 rewrite
+    uint8_t state;      // SV_xxx when read
+};
+
+enum {
+    SV_OFF,          // unlock time 0
+    SV_ACTIVE,       // watching digital lock detect (or R2 not yet written)
+    SV_UNSUPERVISED, // MUXOUT is not digital lock detect, not supervisable
+};
+
+#define SV_CFG_OFFSET 24 // unlock time (little endian) and retries in reg_set
+
+// EEPROM page compare and CRC32 read buffer
+__xdata uint8_t ee_buf[ EP0BUFF_SIZE ];
+
 // EZ-USB® FX2LP™ Unique ID Registers – KBA89285
 // Question:
 // Is there a die ID or a unique ID on each EZ-USB® FX2LP™ chip
@@ -163,6 +292,154 @@ static void prepare_unique_serial_number() {
 }
 
 
+// 32 bit time base, timer 2 counts the low 16 bit, the ISR the high 16 bit
+volatile uint16_t timer_overflows = 0;
+
+void isr_TF2() __interrupt( _INT_TF2 ) {
+    TF2 = 0;
+    ++timer_overflows;
+}
+
+
+static void timer_init() {
+    CKCON &= ~_T2M; // CLKOUT/12
+    T2CON = 0;      // 16 bit auto reload from RCAP2 = 0
+    RCAP2H = 0;
+    RCAP2L = 0;
+    TH2 = 0;
+    TL2 = 0;
+    ET2 = 1;
+    TR2 = 1;
+    EA = 1;
+}
+
+
+static uint32_t timer_ticks() {
+    uint8_t hi, lo;
+    uint16_t ovf;
+    ET2 = 0;
+    do {
+        hi = TH2;
+        lo = TL2;
+    } while ( hi != TH2 ); // TL2 overflowed into TH2 between the reads
+    ovf = timer_overflows;
+    if ( TF2 && !( hi & 0x80 ) ) // overflow not yet counted by the ISR
+        ++ovf;
+    ET2 = 1;
+    return (uint32_t)ovf << 16 | (uint16_t)hi << 8 | lo;
+}
+
+
+// 11 bit frame and 3 bit microframe counted by the SOF packets of the host controller,
+// the microframe is 0 at full speed, the number wraps after 2.048 s
+static uint16_t usb_frame() {
+    uint8_t hi, lo, micro;
+    do {
+        micro = MICROFRAME;
+        lo = USBFRAMEL;
+        hi = USBFRAMEH;
+    } while ( micro != MICROFRAME || lo != USBFRAMEL ); // next SOF between the reads
+    return (uint16_t)( hi & 0x07 ) << 11 | (uint16_t)lo << 3 | ( micro & 0x07 );
+}
+
+
+static uint8_t event_head = 0;
+static uint8_t event_tail = 0;
+static uint8_t event_lost = 0; // events dropped because the log was full
+static uint8_t r0_count = 0;
+static uint32_t r0_ticks = 0;
+static uint8_t mux_last = 0;
+static uint8_t init_type = INIT_NEVER; // stored in EEPROM
+static uint8_t reg_written = 0;        // bit n: Rn written since power-on
+static uint32_t reg_writes = 0;
+static uint32_t r0_writes = 0;
+static uint8_t status_flags = 0; // STATUS_xxx not yet sent
+static uint8_t status_request = 0;
+static bool out_done = false; // set by the handler of a completed OUT request, stalled or unknown ones do not count
+static __xdata struct fw_supervisor sv;
+static uint32_t sv_unlock_ticks = 0; // sv.unlock_us in timer ticks
+static uint32_t sv_since = 0;        // unlock edge or R0, whichever is later
+static bool sv_r0_since_lock = false; // an unlock after this is caused by the R0
+
+
+static void log_event( uint8_t type, uint32_t now ) {
+    uint8_t next = ( event_head + 1 ) & ( EVENT_LOG_SIZE - 1 );
+    if ( next == event_tail ) { // full, keep the oldest events
+        if ( event_lost < 0xFF )
+            ++event_lost;
+        return;
+    }
+    __xdata struct lock_event *ev = event_log + event_head;
+    ev->type = type;
+    ev->hop = r0_count;
+    ev->frame = usb_frame();
+    ev->ticks = now - r0_ticks;
+    event_head = next;
+}
+
+
+// MUXOUT shows digital lock detect, or R2 is not known; analog lock detect is a pulse train
+// while unlocked, the R counter and N divider outputs toggle at the PFD rate,
+// all would flood the event log and the status endpoint
+static bool mux_is_lock() {
+    uint8_t mux = reg_set[ 4 * 2 + 3 ] >> 2 & 0x07; // R2 bits 26..28
+    return !( reg_written & 1 << 2 ) || mux == MUX_DIGITAL_LOCK;
+}
+
+
+// called from the main loop, log every change of MUXOUT
+static void poll_muxout() {
+    if ( !mux_is_lock() )
+        return;
+    uint8_t mux = IOB & MUXOUT_IO;
+    if ( mux != mux_last ) {
+        uint32_t now = timer_ticks();
+        mux_last = mux;
+        log_event( mux ? EVENT_LOCK : EVENT_UNLOCK, now );
+        status_flags |= STATUS_MUX;
+        if ( mux ) {
+            if ( sv.retries )
+                ++sv.recovered;
+            sv.retries = 0;
+            sv_r0_since_lock = false;
+        } else {
+            if ( !sv_r0_since_lock )
+                ++sv.losses;
+            sv_since = now;
+        }
+    }
+}
+
+
+static void sv_configure( uint16_t unlock_us, uint8_t retry_max ) {
+    sv.unlock_us = unlock_us;
+    sv.retry_max = retry_max;
+    sv.retries = 0;
+    sv_unlock_ticks = (uint32_t)unlock_us * 4; // 0.25 us ticks
+}
+
+
+static void ep1_init() {
+    EP1INCFG = _VALID | _TYPE1 | _TYPE0; // interrupt
+    SYNCDELAY;
+}
+
+
+// called from the main loop, arm EP1 IN with the current status if the previous one was taken
+static void send_status() {
+    if ( !status_flags || ( EP1INCS & _BUSY ) )
+        return;
+    __xdata struct status_msg *msg = (__xdata struct status_msg *)EP1INBUF;
+    msg->flags = status_flags;
+    msg->mux = IOB & MUXOUT_IO;
+    msg->request = status_request;
+    msg->hop = r0_count;
+    msg->ticks = timer_ticks();
+    status_flags = 0;
+    EP1INBC = sizeof( struct status_msg );
+}
+
+
 // send register value (4 bytes) to ADF4351
 static void adf_set_reg( const uint8_t *reg ) {
 
@@ -183,6 +460,37 @@ static void adf_set_reg( const uint8_t *reg ) {
     }                           // t6 > 10 ns between set CLK low and set LE high
     IOA = LE_IO;                // set LE high, transfer shift reg to R0..5
     IOA = 0;                    // set LE low
+
+    ++reg_writes;
+    reg_written |= 1 << ( *reg & 0x07 );
+    if ( ( *reg & 0x07 ) == 0 ) { // R0 starts the frequency change
+        uint32_t now = timer_ticks();
+        ++r0_count;
+        ++r0_writes;
+        log_event( EVENT_R0, now );
+        r0_ticks = now;
+        sv_since = now;
+        sv_r0_since_lock = true;
+    }
+}
+
+
+// called from the main loop after poll_muxout(), rewrite R0 if digital lock detect
+// is low for longer than the unlock time; a few us after the unlock time with an idle loop
+static void supervise() {
+    if ( !sv_unlock_ticks || mux_last || ( reg_written & 0x05 ) != 0x05 || !mux_is_lock() )
+        return;
+    if ( sv.retry_max && sv.retries >= sv.retry_max ) // given up until the next lock or register write
+        return;
+    uint32_t now = timer_ticks();
+    if ( now - sv_since < sv_unlock_ticks )
+        return;
+    ++sv.retries;
+    ++sv.relocks;
+    sv.ticks = now;
+    log_event( EVENT_RELOCK, now );
+    adf_set_reg( reg_set ); // R0, restarts the unlock time
+    status_flags |= STATUS_RELOCK;
 }
 
 
@@ -221,6 +529,78 @@ void handle_usb_setup( __xdata struct usb_req_setup *req ) {
 uint8_t ee_page_size = EEPROM_I2C_PAGE_EXP; // log2(page size in bytes)
 
 
+// ACK polling: the EEPROM does not acknowledge its address while a write cycle is running,
+// a page write returns at once and the next access waits only as long as necessary
+static bool ee_ready( uint8_t chip ) {
+    for ( uint16_t poll = EEPROM_I2C_POLL; poll; --poll ) {
+        bool ack = i2c_start( chip << 1 );
+        i2c_stop();
+        if ( ack )
+            return true;
+    }
+    return false;
+}
+
+
+static __xdata uint8_t ee_addr[ 2 ];
+static bool ee_skip_same = false; // EE_SKIP_SAME of the running write request
+
+// start the write cycle of one page or a part of it, w/o waiting for the end
+// with ee_skip_same pages that hold the data already are not written, e.g. when a fleet of boards
+// gets the same image again; the read costs as much I2C traffic as the write, so it is not the default
+static bool ee_write_page( uint8_t chip, uint16_t addr, const __xdata uint8_t *data, uint8_t len, bool dbyte ) {
+    if ( !ee_ready( chip ) )
+        return false;
+    if ( ee_skip_same ) {
+        if ( !eeprom_read( chip, addr, ee_buf, len, dbyte ) )
+            return false;
+        uint8_t same = 0;
+        while ( same < len && ee_buf[ same ] == data[ same ] )
+            ++same;
+        if ( same == len )
+            return true;
+    }
+    ee_addr[ 0 ] = addr >> 8;
+    ee_addr[ 1 ] = addr & 0xFF;
+    bool ok = i2c_start( chip << 1 ) && i2c_write( dbyte ? ee_addr : ee_addr + 1, dbyte ? 2 : 1 ) &&
+              i2c_write( data, len );
+    return i2c_stop() && ok;
+}
+
+
+// write one EP0 packet page by page, the write cycle of its last page runs while the next packet arrives
+static bool ee_write_packet( uint8_t chip, uint16_t addr, const __xdata uint8_t *data, uint8_t len, bool dbyte ) {
+    uint8_t page = ee_page_size < 6 ? 1 << ee_page_size : EP0BUFF_SIZE; // parts of larger pages
+    while ( len ) {
+        uint8_t chunk = page - ( addr & ( page - 1 ) ); // up to the end of the page
+        if ( chunk > len )
+            chunk = len;
+        if ( !ee_write_page( chip, addr, data, chunk, dbyte ) )
+            return false;
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+
+// CRC32 as zlib, reflected polynomial 0xEDB88320, 4 bit table
+static __code const uint32_t crc32_nibble[ 16 ] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t crc32_update( uint32_t crc, const __xdata uint8_t *data, uint8_t len ) {
+    while ( len-- ) {
+        uint8_t b = *data++;
+        crc = crc32_nibble[ ( (uint8_t)crc ^ b ) & 0x0F ] ^ ( crc >> 4 );
+        crc = crc32_nibble[ ( (uint8_t)crc ^ ( b >> 4 ) ) & 0x0F ] ^ ( crc >> 4 );
+    }
+    return crc;
+}
+
+
 static void handle_pending_usb_setup() {
 
     __xdata struct usb_req_setup *req = (__xdata struct usb_req_setup *)SETUPDAT;
@@ -229,6 +609,7 @@ static void handle_pending_usb_setup() {
     if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_OUT ) && req->bRequest == USB_REQ_LIBFX2_PAGE_SIZE ) {
         ee_page_size = req->wValue;
         pending_setup = false;
+        out_done = true;
 
         ACK_EP0();
         return;
@@ -244,6 +625,7 @@ static void handle_pending_usb_setup() {
         bool arg_dbyte = ( req->bRequest == USB_REQ_CYPRESS_EEPROM_DB || // explicite large access
                            arg_addr > 255 || arg_addr + arg_len > 255 ); // start > 255 || end > 255
         uint8_t arg_chip = arg_dbyte ? EEPROM_I2C_ADDR_LARGE : EEPROM_I2C_ADDR_SMALL;
+        ee_skip_same = req->wIndex & EE_SKIP_SAME;
         pending_setup = false;
 
         while ( arg_len > 0 ) {
@@ -261,8 +643,7 @@ static void handle_pending_usb_setup() {
                 SETUP_EP0_BUF( 0 );
                 while ( EP0CS & _BUSY )
                     ;
-                if ( !eeprom_write( arg_chip, arg_addr, EP0BUF, len, arg_dbyte, ee_page_size,
-                                    /*timeout=*/166 ) ) {
+                if ( !ee_write_packet( arg_chip, arg_addr, EP0BUF, len, arg_dbyte ) ) {
                     STALL_EP0();
                     break;
                 }
@@ -271,6 +652,10 @@ static void handle_pending_usb_setup() {
             arg_len -= len;
             arg_addr += len;
         }
+        if ( !arg_read ) { // the last write cycle
+            ee_ready( arg_chip );
+            out_done = !arg_len; // not stalled
+        }
 
         return;
     }
@@ -301,6 +686,7 @@ static void handle_pending_usb_setup() {
             arg_len -= len;
             arg_addr += len;
         }
+        out_done = !arg_read;
 
         return;
     }
@@ -342,6 +728,8 @@ static void handle_pending_usb_setup() {
             return;
         xmemcpy( reg_set + 4 * reg_num, EP0BUF, 4 ); // store this register value
         adf_set_reg( EP0BUF );                       // transfer to the ADF
+        sv.retries = 0;                              // a new setting, the supervisor tries again
+        out_done = true;
         return;
     }
 
@@ -354,15 +742,23 @@ static void handle_pending_usb_setup() {
         while ( EP0CS & _BUSY )
             ;                            // idle
         if ( req->wValue ) {             // add type and checksum to reg set
+            reg_set[ SV_CFG_OFFSET ] = sv.unlock_us & 0xFF;
+            reg_set[ SV_CFG_OFFSET + 1 ] = sv.unlock_us >> 8;
+            reg_set[ SV_CFG_OFFSET + 2 ] = sv.retry_max;
             reg_set[ 30 ] = req->wValue; // 1: init stand alone; 2: init always
             reg_set[ 31 ] = reg_chksum();
         } else { // clear reg set
             xmemclr( reg_set, REG_SET_SIZE );
+            reg_written = 0; // the chip registers are no longer known
         }
         // now store the reg set into EEPROM
         if ( !eeprom_write( EEPROM_I2C_ADDR_LARGE, EEPROM_REG_ADDR, reg_set, REG_SET_SIZE, EEPROM_I2C_DOUBLE_BYTE,
                             EEPROM_I2C_PAGE_EXP, EEPROM_I2C_TIMEOUT ) )
             STALL_EP0(); // stall if not successful
+        else {
+            init_type = req->wValue;
+            out_done = true;
+        }
         return;
     }
 
@@ -376,6 +772,190 @@ static void handle_pending_usb_setup() {
         return;
     }
 
+    // send and remove the oldest lock events
+    // 1 byte number of entries, 1 byte number of lost events, up to 7 x 8 byte struct lock_event
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_GET_EVENTS ) {
+        pending_setup = false;
+        if ( req->wLength < 2 ) {
+            STALL_EP0();
+            return;
+        }
+        uint8_t max = EVENT_PER_REQUEST;
+        if ( req->wLength < 2 + EVENT_PER_REQUEST * sizeof( struct lock_event ) )
+            max = ( req->wLength - 2 ) / sizeof( struct lock_event );
+        while ( EP0CS & _BUSY )
+            ; // idle
+        uint8_t num = 0;
+        __xdata uint8_t *p = EP0BUF + 2;
+        while ( num < max && event_tail != event_head ) {
+            xmemcpy( p, (__xdata void *)( event_log + event_tail ), sizeof( struct lock_event ) );
+            p += sizeof( struct lock_event );
+            event_tail = ( event_tail + 1 ) & ( EVENT_LOG_SIZE - 1 );
+            ++num;
+        }
+        EP0BUF[ 0 ] = num;
+        EP0BUF[ 1 ] = event_lost;
+        event_lost = 0;
+        SETUP_EP0_BUF( 2 + num * sizeof( struct lock_event ) );
+        return;
+    }
+
+    // CRC32 (as zlib.crc32) of an EEPROM or XRAM range, verify a download without reading it back
+    // wValue: start address, wIndex: length + CRC32_XRAM for XRAM; reply: 4 byte little endian
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_CRC32 ) {
+        bool arg_xram = req->wIndex & CRC32_XRAM;
+        uint16_t arg_addr = req->wValue;
+        uint16_t arg_len = req->wIndex & ~CRC32_XRAM;
+        pending_setup = false;
+        if ( req->wLength < 4 || ( !arg_xram && !ee_ready( EEPROM_I2C_ADDR_LARGE ) ) ) {
+            STALL_EP0();
+            return;
+        }
+        uint32_t crc = 0xFFFFFFFF;
+        while ( arg_len > 0 ) {
+            uint8_t len = arg_len < EP0BUFF_SIZE ? arg_len : EP0BUFF_SIZE;
+            if ( arg_xram ) {
+                crc = crc32_update( crc, (__xdata uint8_t *)arg_addr, len );
+            } else {
+                if ( !eeprom_read( EEPROM_I2C_ADDR_LARGE, arg_addr, ee_buf, len, EEPROM_I2C_DOUBLE_BYTE ) ) {
+                    STALL_EP0();
+                    return;
+                }
+                crc = crc32_update( crc, ee_buf, len );
+            }
+            arg_len -= len;
+            arg_addr += len;
+        }
+        crc = ~crc;
+        while ( EP0CS & _BUSY )
+            ; // idle
+        EP0BUF[ 0 ] = crc;
+        EP0BUF[ 1 ] = crc >> 8;
+        EP0BUF[ 2 ] = crc >> 16;
+        EP0BUF[ 3 ] = crc >> 24;
+        SETUP_EP0_BUF( 4 );
+        return;
+    }
+
+    // send the device state, a host tool resyncs its register shadow with one transfer
+    // reply: struct fw_state
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_GET_STATE ) {
+        pending_setup = false;
+        if ( req->wLength < sizeof( struct fw_state ) ) {
+            STALL_EP0();
+            return;
+        }
+        while ( EP0CS & _BUSY )
+            ; // idle
+        __xdata struct fw_state *state = (__xdata struct fw_state *)EP0BUF;
+        xmemcpy( (__xdata void *)state->reg, reg_set, sizeof( state->reg ) );
+        state->init_type = init_type;
+        state->mux = IOB & MUXOUT_IO;
+        state->written = reg_written;
+        state->events = ( event_head - event_tail ) & ( EVENT_LOG_SIZE - 1 );
+        state->reg_writes = reg_writes;
+        state->r0_writes = r0_writes;
+        state->ticks = timer_ticks();
+        SETUP_EP0_BUF( sizeof( struct fw_state ) );
+        return;
+    }
+
+    // wait for the next start of (micro)frame and latch the timer, the host maps the timer
+    // and the frame numbers of the lock events to its own clock; reply: struct fw_clock
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_GET_CLOCK ) {
+        pending_setup = false;
+        if ( req->wLength < sizeof( struct fw_clock ) ) {
+            STALL_EP0();
+            return;
+        }
+        uint32_t start = timer_ticks();
+        uint8_t micro = MICROFRAME;
+        uint8_t lo = USBFRAMEL;
+        uint16_t spin = CLOCK_SPIN_MAX;
+        while ( micro == MICROFRAME && lo == USBFRAMEL ) // tight loop, the edge is seen within ~1 us
+            if ( !--spin ) {
+                STALL_EP0();
+                return;
+            }
+        uint32_t now = timer_ticks();
+        while ( EP0CS & _BUSY )
+            ; // idle
+        __xdata struct fw_clock *clock = (__xdata struct fw_clock *)EP0BUF;
+        clock->ticks = now;
+        clock->frame = usb_frame();
+        clock->wait = now - start;
+        SETUP_EP0_BUF( sizeof( struct fw_clock ) );
+        return;
+    }
+
+    // frequency counter for a self-test with MUXOUT = R counter (3) or N divider (4) output,
+    // count rising edges of PB0 for wValue ms; reply: struct fw_count
+    // PB0 has no counter input (T0/T1 are not bonded out on the 56 pin FX2LP), it is polled
+    // in a loop of about 1 us, so both levels are seen only below ~500 kHz; the host keeps
+    // the rate below 250 kHz, pulses shorter than the loop and edges during interrupts are missed
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_COUNT_MUX ) {
+        pending_setup = false;
+        if ( req->wLength < sizeof( struct fw_count ) || !req->wValue || req->wValue > COUNT_GATE_MAX ) {
+            STALL_EP0();
+            return;
+        }
+        uint16_t units = ( (uint32_t)req->wValue * 125 + 7 ) / 8; // 64 us steps of TH2
+        uint16_t edges_lo = 0;
+        uint16_t edges_hi = 0;
+        uint8_t level = IOB & MUXOUT_IO;
+        uint8_t th = TH2;
+        uint32_t start = timer_ticks();
+        while ( units ) {
+            uint8_t pin = IOB & MUXOUT_IO;
+            if ( pin != level ) {
+                level = pin;
+                if ( pin && !++edges_lo )
+                    ++edges_hi;
+            }
+            if ( TH2 != th ) {
+                th = TH2;
+                --units;
+            }
+        }
+        uint32_t end = timer_ticks();
+        mux_last = IOB & MUXOUT_IO; // no lock event for the counted edges
+        while ( EP0CS & _BUSY )
+            ; // idle
+        __xdata struct fw_count *count = (__xdata struct fw_count *)EP0BUF;
+        count->edges = (uint32_t)edges_hi << 16 | edges_lo;
+        count->ticks = end - start;
+        SETUP_EP0_BUF( sizeof( struct fw_count ) );
+        return;
+    }
+
+    // configure the lock supervisor: wValue unlock time in us (0: off), wIndex R0 rewrites per lock loss
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_OUT ) && req->bRequest == USB_REQ_SUPERVISOR ) {
+        pending_setup = false;
+        if ( req->wIndex > 0xFF ) {
+            STALL_EP0();
+            return;
+        }
+        sv_configure( req->wValue, req->wIndex );
+        out_done = true;
+        ACK_EP0();
+        return;
+    }
+
+    // read the lock supervisor configuration and counters; reply: struct fw_supervisor
+    if ( req->bmRequestType == ( USB_RECIP_DEVICE | USB_TYPE_VENDOR | USB_DIR_IN ) && req->bRequest == USB_REQ_SUPERVISOR ) {
+        pending_setup = false;
+        if ( req->wLength < sizeof( struct fw_supervisor ) ) {
+            STALL_EP0();
+            return;
+        }
+        while ( EP0CS & _BUSY )
+            ; // idle
+        sv.state = !sv.unlock_us ? SV_OFF : mux_is_lock() ? SV_ACTIVE : SV_UNSUPERVISED;
+        xmemcpy( EP0BUF, (__xdata void *)&sv, sizeof( struct fw_supervisor ) );
+        SETUP_EP0_BUF( sizeof( struct fw_supervisor ) );
+        return;
+    }
+
     STALL_EP0(); // unknown request
 }
 
@@ -405,6 +985,8 @@ static uint8_t ee_get_init_type() {
     // then return the init_type
     if ( eeprom_read( EEPROM_I2C_ADDR_LARGE, EEPROM_REG_ADDR, reg_set, REG_SET_SIZE, EEPROM_I2C_DOUBLE_BYTE ) ) {
         if ( reg_set[ 31 ] == reg_chksum() ) { // valid
+            sv_configure( reg_set[ SV_CFG_OFFSET ] | (uint16_t)reg_set[ SV_CFG_OFFSET + 1 ] << 8,
+                          reg_set[ SV_CFG_OFFSET + 2 ] );
             return reg_set[ 30 ];
         }
     }
@@ -416,13 +998,19 @@ int main() {
     uint8_t init_wait = 0;
 
     CPUCS = _CLKOE | _CLKSPD1; // 48 MHz clock
+    I2CTL = _400KHZ;           // the 24LC64 runs at 400 kHz, the boot loader uses it as well (config byte)
 
     prepare_unique_serial_number();
 
     adf_pin_init();
     // adf_reg_init();
 
-    uint8_t init_type = ee_get_init_type();
+    timer_init();
+    mux_last = IOB & MUXOUT_IO;
+    ep1_init();
+
+    xmemclr( (__xdata void *)&sv, sizeof( sv ) ); // supervisor off unless stored in EEPROM
+    init_type = ee_get_init_type();
 
     if ( init_type == INIT_STANDALONE ) {
         init_wait = 200; // wait 2 s for USB
@@ -435,10 +1023,21 @@ int main() {
 
     // check FNADDR -> if not connected to USB after 2 s init the regs
     while ( true ) {
+        poll_muxout();
+        supervise();
         if ( FNADDR ) { // enumerated on USB
             init_wait = 0;
-            if ( pending_setup )
+            if ( pending_setup ) {
+                // SETUPDAT may hold the next request already when the handler returns
+                uint8_t request = SETUPDAT[ 1 ];
+                out_done = false;
                 handle_pending_usb_setup();
+                if ( out_done ) {
+                    status_flags |= STATUS_DONE;
+                    status_request = request;
+                }
+            }
+            send_status();
         } else if ( init_wait ) { // in USB init phase
             if ( --init_wait ) {  // still not over?
                 delay_ms( 10 );   // loop delay
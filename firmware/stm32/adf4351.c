@@ -0,0 +1,165 @@
+/*
+ * This file is part of the adf435x project.
+ *
+ * Copyright (C) 2024 Martin Homuth-Rosemann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "adf4351.h"
+
+/* register bit positions, see ADF4351 data sheet */
+#define R1_MOD 3
+#define R1_PHASE 15
+#define R1_PRESCALER 27
+#define R2_PD_POLARITY 6
+#define R2_LDP 7
+#define R2_LDF 8
+#define R2_CP_CURRENT 9
+#define R2_DOUBLE_BUFFER 13
+#define R2_R_COUNTER 14
+#define R2_RDIV2 24
+#define R2_RMUL2 25
+#define R2_MUXOUT 26
+#define R3_CLK_DIV 3
+#define R4_OUT_POWER 3
+#define R4_OUT_ENABLE 5
+#define R4_MTLD 10
+#define R4_VCO_POWER_DOWN 11
+#define R4_BAND_SEL_CLK_DIV 12
+#define R4_RF_DIV_SEL 20
+#define R4_FEEDBACK 23
+#define R5_LD_PIN_MODE 22
+
+#define CP_CURRENT_2_50 7
+#define MUX_DIGITAL_LOCK 6
+#define POWER_PLUS5DB 3
+#define LD_PIN_DIGITAL_LOCK 1
+
+#define INT_MIN_PRESCALER_8_9 75
+#define PFD_MAX_FRAC 32000000
+#define BAND_SEL_CLK_MAX 125000
+
+/* calculate greatest common divisor */
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+uint32_t adf4351_pfd(const struct adf4351_config *cfg)
+{
+	uint32_t r_counter = cfg->r_counter & 0x3FF;
+	uint64_t ref = cfg->ref_hz;
+
+	if (!r_counter)
+		return 0;
+	if (cfg->flags & ADF4351_CFG_REF_DOUBLER)
+		ref *= 2;
+	if (cfg->flags & ADF4351_CFG_REF_DIV2)
+		r_counter *= 2;
+	return ref / r_counter;
+}
+
+uint8_t adf4351_rf_div(uint64_t freq_hz)
+{
+	uint8_t rf_div = 0;
+
+	for (uint32_t f = 2200000000UL; f > 66000000UL; f /= 2) {
+		if (freq_hz >= f)
+			break;
+		++rf_div;
+	}
+	return rf_div;
+}
+
+bool adf4351_solve(const struct adf4351_config *cfg, uint64_t freq_hz,
+		struct adf4351_solution *sol)
+{
+	uint32_t *R = sol->reg;
+
+	/* init register with default values */
+	R[5] = 0x00180005;
+	R[4] = 0x00000004;
+	R[3] = 0x00000003;
+	R[2] = 0x00000002;
+	R[1] = 0x00000001;
+	R[0] = 0x00000000;
+	sol->INT = 0;
+	sol->FRAC = 0;
+	sol->MOD = 0;
+	sol->rf_div = 0;
+	sol->pfd_hz = adf4351_pfd(cfg);
+
+	if (freq_hz == 0) { /* switch off */
+		R[4] |= 1UL << R4_VCO_POWER_DOWN;
+		return true;
+	}
+
+	if (freq_hz < ADF4351_FREQ_MIN || freq_hz > ADF4351_FREQ_MAX || !sol->pfd_hz)
+		return false;
+
+	const uint32_t pfd = sol->pfd_hz;
+	uint32_t band_sel_clk_div = (pfd + BAND_SEL_CLK_MAX - 1) / BAND_SEL_CLK_MAX;
+	if (band_sel_clk_div > 255)
+		band_sel_clk_div = 255;
+
+	const uint8_t rf_div = adf4351_rf_div(freq_hz);
+	const uint64_t vco = freq_hz << rf_div;
+
+	uint64_t INT = vco / pfd;
+	uint32_t MOD = pfd / 1000;
+	uint32_t FRAC = (uint64_t)MOD * (vco % pfd) / pfd;
+
+	if (INT < INT_MIN_PRESCALER_8_9 || INT > 0xFFFF)
+		return false;
+
+	if (!FRAC) { /* INT mode */
+		MOD = 2;
+		R[2] |= 1UL << R2_LDF | 1UL << R2_LDP; /* LDF_INT, LDP_6NS */
+	} else { /* FRAC mode, LDF_FRAC, LDP_10NS */
+		uint32_t div = gcd(FRAC, MOD);
+		FRAC /= div;
+		MOD /= div;
+		if (MOD > 0x0FFF || pfd > PFD_MAX_FRAC)
+			return false;
+	}
+
+	/* set register values */
+	R[5] |= (uint32_t)LD_PIN_DIGITAL_LOCK << R5_LD_PIN_MODE;
+	R[4] |= 1UL << R4_FEEDBACK | (uint32_t)rf_div << R4_RF_DIV_SEL |
+		band_sel_clk_div << R4_BAND_SEL_CLK_DIV | 1UL << R4_OUT_ENABLE |
+		(uint32_t)POWER_PLUS5DB << R4_OUT_POWER | 1UL << R4_MTLD;
+	R[3] |= 150UL << R3_CLK_DIV;
+	R[2] |= (uint32_t)MUX_DIGITAL_LOCK << R2_MUXOUT |
+		(uint32_t)(cfg->r_counter & 0x3FF) << R2_R_COUNTER |
+		1UL << R2_DOUBLE_BUFFER | (uint32_t)CP_CURRENT_2_50 << R2_CP_CURRENT |
+		1UL << R2_PD_POLARITY;
+	if (cfg->flags & ADF4351_CFG_REF_DOUBLER)
+		R[2] |= 1UL << R2_RMUL2;
+	if (cfg->flags & ADF4351_CFG_REF_DIV2)
+		R[2] |= 1UL << R2_RDIV2;
+	R[1] |= MOD << R1_MOD | 1UL << R1_PHASE | 1UL << R1_PRESCALER;
+	R[0] = adf4351_r0(INT, FRAC);
+
+	sol->INT = INT;
+	sol->FRAC = FRAC;
+	sol->MOD = MOD;
+	sol->rf_div = rf_div;
+	return true;
+}
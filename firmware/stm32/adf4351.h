@@ -0,0 +1,100 @@
+/*
+ * This file is part of the adf435x project.
+ *
+ * Copyright (C) 2024 Martin Homuth-Rosemann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * On-device ADF4351 register solver.
+ * Integer port of ADF4351::calculateFreq() from examples/adf4351-eval,
+ * it produces the same register words for the same input.
+ */
+
+#ifndef ADF4351_H
+#define ADF4351_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ADF4351_REF_DEFAULT 25000000
+#define ADF4351_R_COUNTER_DEFAULT 250
+
+#define ADF4351_FREQ_MIN 33000000ULL
+#define ADF4351_FREQ_MAX 4500000000ULL
+
+/* adf4351_config.flags */
+#define ADF4351_CFG_REF_DOUBLER 0x01
+#define ADF4351_CFG_REF_DIV2 0x02
+
+struct adf4351_config {
+	uint32_t ref_hz;	/* reference input frequency */
+	uint16_t r_counter;	/* 10 bit R counter 1..1023 */
+	uint8_t flags;		/* ADF4351_CFG_xxx */
+};
+
+struct adf4351_solution {
+	uint32_t reg[6];	/* R0..R5 */
+	uint32_t pfd_hz;	/* phase detector frequency */
+	uint16_t INT;
+	uint16_t FRAC;
+	uint16_t MOD;
+	uint8_t rf_div;		/* RF divider select, divider = 1 << rf_div */
+};
+
+/* PFD frequency of a reference configuration, 0 if invalid */
+uint32_t adf4351_pfd(const struct adf4351_config *cfg);
+
+/*
+ * Calculate all six registers for freq_hz, freq_hz == 0 powers down the VCO.
+ * Returns false if the frequency or the configuration is out of range.
+ */
+bool adf4351_solve(const struct adf4351_config *cfg, uint64_t freq_hz,
+		struct adf4351_solution *sol);
+
+/* RF divider select for freq_hz, the output divider is 1 << rf_div */
+uint8_t adf4351_rf_div(uint64_t freq_hz);
+
+/* R0 word for the given INT and FRAC values */
+static inline uint32_t adf4351_r0(uint32_t INT, uint32_t FRAC)
+{
+	return (INT & 0xFFFF) << 15 | (FRAC & 0x0FFF) << 3 | 0;
+}
+
+/* R1 with a new 12 bit modulus */
+static inline uint32_t adf4351_r1_mod(uint32_t r1, uint32_t MOD)
+{
+	return (r1 & ~(0x0FFFUL << 3)) | (MOD & 0x0FFF) << 3;
+}
+
+/* R2 with lock detect function and precision set for FRAC mode */
+static inline uint32_t adf4351_r2_frac_mode(uint32_t r2)
+{
+	return r2 & ~(3UL << 7);
+}
+
+/* R4 with a new RF divider select */
+static inline uint32_t adf4351_r4_rf_div(uint32_t r4, uint8_t rf_div)
+{
+	return (r4 & ~(7UL << 20)) | (uint32_t)(rf_div & 7) << 20;
+}
+
+/* band select clock divider value of R4 */
+static inline uint32_t adf4351_r4_band_sel_div(uint32_t r4)
+{
+	return (r4 >> 12) & 0xFF;
+}
+
+#endif
@@ -18,14 +18,18 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/timer.h>
 #include <libopencm3/usb/usbd.h>
 
+#include "adf4351.h"
+
 #define PORT_LED GPIOC
 #define PIN_LED GPIO13
 
@@ -36,7 +40,28 @@
 
 #define SPI SPI1
 
-#define USB_REQ_SET_REG 0x40
+#define USB_REQ_TYPE_VENDOR_OUT 0x40
+#define USB_REQ_TYPE_VENDOR_IN 0xC0
+
+/* vendor requests */
+#define USB_REQ_SET_FREQ 0xD0	/* calculate and send registers for a frequency */
+#define USB_REQ_SWEEP 0xD1	/* OUT: start (wValue = 1) or stop (wValue = 0), IN: status */
+#define USB_REQ_KEY 0xD2	/* OUT: start (wValue = 1) or stop (wValue = 0) keying, IN: status */
+#define USB_REQ_KEY_DATA 0xD3	/* OUT: symbol buffer data at byte offset wValue */
+#define USB_REQ_SET_REG 0xDD	/* send one 32bit register */
+
+#define SPI_QUEUE_SIZE 16
+
+/* SPI clock 72 MHz / 64, one 32 bit word takes ~29 us */
+#define SPI_WORD_US 29
+/* the VCO band selection takes ~10 cycles of the band select clock */
+#define BAND_SELECT_CYCLES 10
+/* longest dwell time with 100 us timer ticks */
+#define SWEEP_DWELL_MAX_US 6553600UL
+/* symbol buffer, one bit per symbol */
+#define KEY_BUF_SIZE 4096
+/* every symbol may need one SPI word */
+#define KEY_RATE_MAX (1000000 / SPI_WORD_US)
 
 #define LED_TIMEOUT 100
 
@@ -94,10 +119,90 @@ const char *usb_strings[] = {
 
 uint32_t usbd_control_buffer[32];
 
-bool have_reg = false;
-uint32_t reg = 0;
 unsigned int led_countdown = 0;
 
+/* last register values written to the ADF4351 */
+static uint32_t adf_reg[6];
+static uint8_t adf_reg_valid = 0;
+
+/* reference configuration for USB_REQ_SET_FREQ */
+static struct adf4351_config adf_cfg = {
+	.ref_hz = ADF4351_REF_DEFAULT,
+	.r_counter = ADF4351_R_COUNTER_DEFAULT,
+	.flags = 0,
+};
+
+/* register words waiting for transfer, stored MSB first for the DMA */
+static uint32_t spi_queue[SPI_QUEUE_SIZE];
+static volatile uint8_t spi_head = 0;
+static volatile uint8_t spi_tail = 0;
+static volatile bool spi_dma_done = false;
+static uint32_t spi_tag[SPI_QUEUE_SIZE];	/* keying tick + 1 of the word, 0: other word */
+static bool spi_active = false;
+static uint32_t spi_word;
+static uint32_t spi_word_tag;
+
+/*
+ * Linear sweep state. Inside one RF divider band with a fixed MOD the N values
+ * of consecutive points differ by a constant, the timer ISR only adds this
+ * increment to INT/FRAC and writes R0. err accumulates the part of the step
+ * below the channel resolution (pfd / MOD) in units of 1/pfd.
+ * Entering another band also writes R4 with the new RF divider.
+ */
+static struct {
+	uint64_t start_hz;
+	uint64_t stop_hz;
+	uint64_t freq_hz;	/* current point */
+	uint64_t band_top_hz;	/* start of the next band, 0: none */
+	uint32_t step_hz;
+	uint32_t pfd_hz;
+	uint32_t INT;
+	uint32_t FRAC;
+	uint32_t MOD;
+	uint32_t err;
+	uint32_t d_int;		/* increments per step */
+	uint32_t d_frac;
+	uint32_t d_err;
+	uint32_t overruns;	/* steps delayed by a full SPI queue */
+	uint16_t repeat;	/* number of sweeps, 0: forever */
+	uint16_t count;		/* finished sweeps */
+	uint8_t rf_div;
+	volatile bool active;
+} sweep;
+
+/* USB_REQ_SWEEP IN data */
+static uint8_t sweep_status[16];
+
+/*
+ * Keying state. The TIM3 ISR clocks one symbol per tick out of key_buf
+ * (MSB of byte 0 first) and queues the register word of the symbol when it
+ * differs from the previous one: R4 with and without the output enabled
+ * for OOK or two R0 values for 2-FSK. The SPI loop measures the time from
+ * the ideal symbol edge (t0 + tick * period in CPU cycles) to the latch.
+ */
+static uint8_t key_buf[KEY_BUF_SIZE];
+static struct {
+	uint32_t word[2];	/* register word of symbol 0 and 1 */
+	uint32_t idle;		/* written when keying ends */
+	uint32_t symbols;	/* bits in key_buf */
+	uint32_t index;		/* current symbol */
+	uint32_t tick;		/* symbols clocked since start */
+	uint32_t period;	/* symbol period in CPU cycles */
+	uint32_t t0;		/* cycle counter at the timer start */
+	uint32_t overruns;	/* words dropped by a full SPI queue */
+	uint32_t latched;	/* words latched by LE */
+	uint32_t lat_min;	/* latch - ideal symbol edge in cycles */
+	uint32_t lat_max;
+	uint64_t lat_sum;
+	uint16_t repeat;	/* number of passes, 0: forever */
+	uint16_t count;		/* finished passes */
+	uint8_t last;		/* symbol of the last queued word */
+	volatile bool active;
+} key;
+
+/* USB_REQ_KEY IN data */
+static uint8_t key_status[32];
+
 static void setup(void)
 {
 	/* Clock setup */
@@ -142,52 +247,503 @@ static void setup(void)
 	/* DMA */
 	nvic_set_priority(NVIC_DMA1_CHANNEL3_IRQ, 0);
 	nvic_enable_irq(NVIC_DMA1_CHANNEL3_IRQ);
+
+	/* Sweep timer */
+	rcc_periph_clock_enable(RCC_TIM2);
+	nvic_set_priority(NVIC_TIM2_IRQ, 1 << 4);
+	nvic_enable_irq(NVIC_TIM2_IRQ);
+
+	/* Keying timer, the cycle counter measures the symbol timing */
+	rcc_periph_clock_enable(RCC_TIM3);
+	nvic_set_priority(NVIC_TIM3_IRQ, 1 << 4);
+	nvic_enable_irq(NVIC_TIM3_IRQ);
+	dwt_enable_cycle_counter();
 }
 
 
-static int vendor_control_callback(usbd_device *usbd_dev, struct usb_setup_data *req, uint8_t **buf,
-		uint16_t *len, void (**complete)(usbd_device *usbd_dev, struct usb_setup_data *req))
+static uint8_t spi_queue_free(void)
 {
-	(void)buf;
-	(void)len;
-	(void)complete;
-	(void)usbd_dev;
+	return (spi_tail + SPI_QUEUE_SIZE - spi_head - 1) % SPI_QUEUE_SIZE;
+}
 
-	switch (req->bmRequestType) {
-	case USB_REQ_SET_REG: {
-		if (*len != 4)
-			return USBD_REQ_NOTSUPP;
+/* queue one register word for transfer, returns false if the queue is full */
+static bool adf_queue_reg(uint32_t value, uint32_t tag)
+{
+	uint8_t next = (spi_head + 1) % SPI_QUEUE_SIZE;
+
+	if (next == spi_tail)
+		return false;
+	spi_queue[spi_head] = __builtin_bswap32(value);
+	spi_tag[spi_head] = tag;
+	spi_head = next;
 
-		reg = ((*buf)[0] << 24) | ((*buf)[1] << 16) |
-			((*buf)[2] << 8) | (*buf)[3];
+	if ((value & 0x07) < 6) {
+		adf_reg[value & 0x07] = value;
+		adf_reg_valid |= 1 << (value & 0x07);
+	}
+	return true;
+}
 
-		gpio_clear(PORT_SPI, PIN_LE);
+static bool adf_write_reg(uint32_t value)
+{
+	return adf_queue_reg(value, 0);
+}
 
-		dma_channel_reset(DMA1, DMA_CHANNEL3);
+/*
+ * Queue only the registers that differ from the last written values.
+ * R0 is written last and also whenever another register changed
+ * because it latches the double buffered values.
+ */
+static bool adf_write_changed(const uint32_t *reg)
+{
+	bool changed = false;
 
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&SPI1_DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)&reg);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL3, sizeof(reg));
-		dma_set_read_from_memory(DMA1, DMA_CHANNEL3);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
+	if (spi_queue_free() < 6)
+		return false;
 
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
-		dma_enable_channel(DMA1, DMA_CHANNEL3);
+	for (int r = 5; r > 0; --r) {
+		if ((adf_reg_valid & (1 << r)) && adf_reg[r] == reg[r])
+			continue;
+		adf_write_reg(reg[r]);
+		changed = true;
+	}
+	if (changed || !(adf_reg_valid & 1) || adf_reg[0] != reg[0])
+		adf_write_reg(reg[0]);
+	return true;
+}
 
-		spi_enable_tx_dma(SPI);
+/* calculate the registers for freq_hz and queue the changed ones */
+static bool adf_set_freq(uint64_t freq_hz)
+{
+	struct adf4351_solution sol;
 
-		gpio_set(PORT_LED, PIN_LED);
-		led_countdown = LED_TIMEOUT;
+	if (!adf4351_solve(&adf_cfg, freq_hz, &sol))
+		return false;
+	return adf_write_changed(sol.reg);
+}
 
+/* prepare INT, FRAC and the step increments for the band of freq_hz */
+static void sweep_set_band(uint64_t freq_hz)
+{
+	const uint32_t pfd = sweep.pfd_hz;
+	const uint8_t rf_div = adf4351_rf_div(freq_hz);
+	const uint64_t vco = freq_hz << rf_div;
+	const uint64_t frac = (uint64_t)sweep.MOD * (vco % pfd);
+	const uint64_t step = ((uint64_t)sweep.step_hz << rf_div) * sweep.MOD / pfd;
+
+	sweep.rf_div = rf_div;
+	sweep.band_top_hz = rf_div ? 4400000000ULL >> rf_div : 0;
+	sweep.INT = vco / pfd;
+	sweep.FRAC = frac / pfd;
+	sweep.err = frac % pfd;
+	sweep.d_int = step / sweep.MOD;
+	sweep.d_frac = step % sweep.MOD;
+	sweep.d_err = ((uint64_t)sweep.step_hz << rf_div) * sweep.MOD % pfd;
+}
+
+static void sweep_stop(void)
+{
+	timer_disable_irq(TIM2, TIM_DIER_UIE);
+	timer_disable_counter(TIM2);
+	sweep.active = false;
+}
+
+/* called from the timer ISR, advance one point */
+static void sweep_step(void)
+{
+	uint64_t next = sweep.freq_hz + sweep.step_hz;
+	uint8_t rf_div = sweep.rf_div;
+
+	if (spi_queue_free() < 2) { /* SPI did not keep up, retry with next tick */
+		++sweep.overruns;
+		return;
+	}
+
+	if (next > sweep.stop_hz) {
+		if (sweep.repeat && ++sweep.count >= sweep.repeat) {
+			sweep_stop();
+			return;
+		}
+		next = sweep.start_hz;
+		sweep_set_band(next);
+	} else if (sweep.band_top_hz && next >= sweep.band_top_hz) {
+		sweep_set_band(next);
+	} else { /* same band: incremental update */
+		sweep.err += sweep.d_err;
+		if (sweep.err >= sweep.pfd_hz) {
+			sweep.err -= sweep.pfd_hz;
+			++sweep.FRAC;
+		}
+		sweep.FRAC += sweep.d_frac;
+		if (sweep.FRAC >= sweep.MOD) {
+			sweep.FRAC -= sweep.MOD;
+			++sweep.INT;
+		}
+		sweep.INT += sweep.d_int;
+	}
+	sweep.freq_hz = next;
+
+	if (sweep.rf_div != rf_div)
+		adf_write_reg(adf4351_r4_rf_div(adf_reg[4], sweep.rf_div));
+	adf_write_reg(adf4351_r0(sweep.INT, sweep.FRAC));
+}
+
+/* TIM2 update event every dwell_us */
+static void sweep_timer_start(uint32_t dwell_us)
+{
+	const uint32_t timer_hz = rcc_apb1_frequency * 2;
+
+	rcc_periph_reset_pulse(RST_TIM2);
+	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	if (dwell_us <= 0x10000) { /* 1 us ticks */
+		timer_set_prescaler(TIM2, timer_hz / 1000000 - 1);
+		timer_set_period(TIM2, dwell_us - 1);
+	} else { /* 100 us ticks */
+		timer_set_prescaler(TIM2, timer_hz / 10000 - 1);
+		timer_set_period(TIM2, dwell_us / 100 - 1);
+	}
+	timer_generate_event(TIM2, TIM_EGR_UG); /* load the prescaler */
+	timer_clear_flag(TIM2, TIM_SR_UIF);
+	timer_enable_irq(TIM2, TIM_DIER_UIE);
+	timer_enable_counter(TIM2);
+}
+
+/*
+ * Write all registers for start_hz with a fixed MOD = pfd / 1000 in FRAC mode
+ * and let the timer step through the points. The dwell time is raised to the
+ * time the chip needs for the VCO band selection and the SPI for R4 + R0.
+ */
+static bool sweep_start(uint64_t start_hz, uint64_t stop_hz, uint32_t step_hz,
+		uint32_t dwell_us, uint16_t repeat)
+{
+	struct adf4351_solution sol;
+
+	if (!step_hz || start_hz > stop_hz ||
+			!adf4351_solve(&adf_cfg, stop_hz, &sol) ||
+			!adf4351_solve(&adf_cfg, start_hz, &sol))
+		return false;
+
+	sweep_stop();
+
+	sweep.start_hz = start_hz;
+	sweep.stop_hz = stop_hz;
+	sweep.freq_hz = start_hz;
+	sweep.step_hz = step_hz;
+	sweep.pfd_hz = sol.pfd_hz;
+	sweep.MOD = sol.pfd_hz / 1000;
+	sweep.repeat = repeat;
+	sweep.count = 0;
+	sweep.overruns = 0;
+	if (sweep.MOD < 2 || sweep.MOD > 0x0FFF)
+		return false;
+	sweep_set_band(start_hz);
+
+	sol.reg[2] = adf4351_r2_frac_mode(sol.reg[2]);
+	sol.reg[1] = adf4351_r1_mod(sol.reg[1], sweep.MOD);
+	sol.reg[0] = adf4351_r0(sweep.INT, sweep.FRAC);
+	if (!adf_write_changed(sol.reg))
+		return false;
+
+	const uint32_t band_sel_div = adf4351_r4_band_sel_div(sol.reg[4]);
+	uint32_t dwell_min = (uint64_t)BAND_SELECT_CYCLES * band_sel_div * 1000000 / sol.pfd_hz;
+	if (dwell_min < 2 * SPI_WORD_US)
+		dwell_min = 2 * SPI_WORD_US;
+	if (dwell_us < dwell_min)
+		dwell_us = dwell_min;
+	if (dwell_us > SWEEP_DWELL_MAX_US)
+		dwell_us = SWEEP_DWELL_MAX_US;
+
+	sweep.active = true;
+	sweep_timer_start(dwell_us);
+	return true;
+}
+
+static void key_stop(void)
+{
+	timer_disable_irq(TIM3, TIM_DIER_UIE);
+	timer_disable_counter(TIM3);
+	if (key.active)
+		adf_write_reg(key.idle);
+	key.active = false;
+}
+
+static uint8_t key_symbol(uint32_t index)
+{
+	return key_buf[index / 8] >> (7 - index % 8) & 1;
+}
+
+/*
+ * Called from the timer ISR, clock the next symbol. A word that does not
+ * fit into the SPI queue is dropped, the symbols keep their timing and the
+ * next change of the symbol is tried again.
+ */
+static void key_step(void)
+{
+	uint8_t sym;
+
+	++key.tick;
+	if (++key.index >= key.symbols) {
+		key.index = 0;
+		if (key.repeat && ++key.count >= key.repeat) {
+			key_stop();
+			return;
+		}
+	}
+	sym = key_symbol(key.index);
+	if (sym == key.last)
+		return;
+	if (!adf_queue_reg(key.word[sym], key.tick + 1)) {
+		++key.overruns;
+		return;
+	}
+	key.last = sym;
+}
+
+/* LE latched the word of keying tick tag - 1 */
+static void key_latched(uint32_t tag)
+{
+	const uint32_t lat = dwt_read_cycle_counter() - (key.t0 + (tag - 1) * key.period);
+
+	if (!key.latched || lat < key.lat_min)
+		key.lat_min = lat;
+	if (lat > key.lat_max)
+		key.lat_max = lat;
+	key.lat_sum += lat;
+	++key.latched;
+}
+
+/*
+ * TIM3 update event every symbol period, the prescaler only grows for
+ * periods above 16 bit, so the achieved rate is the closest one.
+ */
+static void key_timer_start(uint32_t rate_hz)
+{
+	const uint32_t timer_hz = rcc_apb1_frequency * 2;
+	const uint32_t cycles = (timer_hz + rate_hz / 2) / rate_hz;
+	const uint32_t prescaler = (cycles - 1) >> 16;
+	const uint32_t ticks = (cycles + prescaler / 2) / (prescaler + 1);
+
+	key.period = ticks * (prescaler + 1) * (rcc_ahb_frequency / timer_hz);
+	rcc_periph_reset_pulse(RST_TIM3);
+	timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIM3, prescaler);
+	timer_set_period(TIM3, ticks - 1);
+	timer_generate_event(TIM3, TIM_EGR_UG); /* load the prescaler */
+	timer_clear_flag(TIM3, TIM_SR_UIF);
+	timer_enable_irq(TIM3, TIM_DIER_UIE);
+	key.t0 = dwt_read_cycle_counter();
+	timer_enable_counter(TIM3);
+}
+
+/*
+ * Send the word of the first symbol now and the following ones from the
+ * timer ISR. Both words must address the same register, the symbol rate
+ * is limited to one SPI word per symbol.
+ */
+static bool key_start(uint32_t rate_hz, uint32_t symbols, const uint32_t *word,
+		uint32_t idle, uint16_t repeat)
+{
+	if (!rate_hz || rate_hz > KEY_RATE_MAX ||
+			!symbols || symbols > 8UL * KEY_BUF_SIZE ||
+			(word[0] & 0x07) != (word[1] & 0x07) ||
+			(word[0] & 0x07) > 5 || (idle & 0x07) > 5)
+		return false;
+
+	key_stop();
+
+	/* words of a previous run still queued are not measured against the new start */
+	spi_word_tag = 0;
+	for (uint8_t i = spi_tail; i != spi_head; i = (i + 1) % SPI_QUEUE_SIZE)
+		spi_tag[i] = 0;
+
+	key.word[0] = word[0];
+	key.word[1] = word[1];
+	key.idle = idle;
+	key.symbols = symbols;
+	key.index = 0;
+	key.tick = 0;
+	key.repeat = repeat;
+	key.count = 0;
+	key.overruns = 0;
+	key.latched = 0;
+	key.lat_min = 0;
+	key.lat_max = 0;
+	key.lat_sum = 0;
+	key.last = key_symbol(0);
+	if (!adf_queue_reg(key.word[key.last], 1))
+		return false;
+
+	key.active = true;
+	key_timer_start(rate_hz);
+	return true;
+}
+
+static uint32_t cycles_to_ns(uint64_t cycles)
+{
+	return cycles * 1000000000ULL / rcc_ahb_frequency;
+}
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		buf[i] = value >> (8 * i);
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static int vendor_control_callback(usbd_device *usbd_dev, struct usb_setup_data *req, uint8_t **buf,
+		uint16_t *len, void (**complete)(usbd_device *usbd_dev, struct usb_setup_data *req))
+{
+	(void)complete;
+	(void)usbd_dev;
+
+	/* 16 byte: uint64 current frequency, uint16 finished sweeps, uint8 active, 1 byte reserved, uint32 overruns */
+	if (req->bmRequestType == USB_REQ_TYPE_VENDOR_IN && req->bRequest == USB_REQ_SWEEP) {
+		/* the timer ISR advances the sweep, a consistent snapshot with its IRQ masked */
+		nvic_disable_irq(NVIC_TIM2_IRQ);
+		const uint64_t freq_hz = sweep.freq_hz;
+		const uint16_t count = sweep.count;
+		const bool active = sweep.active;
+		const uint32_t overruns = sweep.overruns;
+		nvic_enable_irq(NVIC_TIM2_IRQ);
+		put_le32(sweep_status, freq_hz);
+		put_le32(sweep_status + 4, freq_hz >> 32);
+		sweep_status[8] = count;
+		sweep_status[9] = count >> 8;
+		sweep_status[10] = active;
+		sweep_status[11] = 0;
+		put_le32(sweep_status + 12, overruns);
+		*buf = sweep_status;
+		if (*len > sizeof(sweep_status))
+			*len = sizeof(sweep_status);
+		return USBD_REQ_HANDLED;
+	}
+
+	/*
+	 * 32 byte: uint32 achieved symbol rate in mHz, uint32 symbols clocked, uint32 words latched,
+	 * uint32 dropped words, uint32 min, max and mean latency in ns from the ideal symbol edge
+	 * to the latch, uint16 finished passes, uint8 active, 1 byte reserved
+	 */
+	if (req->bmRequestType == USB_REQ_TYPE_VENDOR_IN && req->bRequest == USB_REQ_KEY) {
+		put_le32(key_status, key.period ?
+			(uint64_t)rcc_ahb_frequency * 1000 / key.period : 0);
+		put_le32(key_status + 4, key.tick);
+		put_le32(key_status + 8, key.latched);
+		put_le32(key_status + 12, key.overruns);
+		put_le32(key_status + 16, cycles_to_ns(key.lat_min));
+		put_le32(key_status + 20, cycles_to_ns(key.lat_max));
+		put_le32(key_status + 24, key.latched ?
+			cycles_to_ns(key.lat_sum / key.latched) : 0);
+		key_status[28] = key.count;
+		key_status[29] = key.count >> 8;
+		key_status[30] = key.active;
+		key_status[31] = 0;
+		*buf = key_status;
+		if (*len > sizeof(key_status))
+			*len = sizeof(key_status);
 		return USBD_REQ_HANDLED;
 	}
 
-	default:
+	if (req->bmRequestType != USB_REQ_TYPE_VENDOR_OUT)
 		return USBD_REQ_NOTSUPP;
+
+	/*
+	 * The sweep and keying timer ISRs own the register queue while running,
+	 * a request that writes registers stops them, USB_REQ_KEY_DATA does not.
+	 */
+	switch (req->bRequest) {
+	/*
+	 * wValue = 0: stop the sweep
+	 * wValue = 1: start, 28 byte: uint64 start_hz, uint64 stop_hz, uint32 step_hz,
+	 * uint32 dwell_us, uint16 repeat (0 = forever), 2 byte reserved
+	 */
+	case USB_REQ_SWEEP:
+		sweep_stop();
+		if (!req->wValue)
+			break;
+		key_stop();
+		if (*len != 28)
+			return USBD_REQ_NOTSUPP;
+		if (!sweep_start(get_le32(*buf) | (uint64_t)get_le32(*buf + 4) << 32,
+				get_le32(*buf + 8) | (uint64_t)get_le32(*buf + 12) << 32,
+				get_le32(*buf + 16), get_le32(*buf + 20),
+				(*buf)[24] | (*buf)[25] << 8))
+			return USBD_REQ_NOTSUPP;
+		break;
+
+	/*
+	 * wValue = 0: stop keying
+	 * wValue = 1: start, 24 byte: uint32 symbol rate in Hz, uint32 number of symbols,
+	 * uint32 register word of symbol 0 and of symbol 1, uint32 idle word written at the end,
+	 * uint16 repeat (0 = forever), 2 byte reserved
+	 */
+	case USB_REQ_KEY: {
+		key_stop();
+		if (!req->wValue)
+			break;
+		sweep_stop();
+		if (*len != 24)
+			return USBD_REQ_NOTSUPP;
+		const uint32_t word[2] = { get_le32(*buf + 8), get_le32(*buf + 12) };
+		if (!key_start(get_le32(*buf), get_le32(*buf + 4), word,
+				get_le32(*buf + 16), (*buf)[20] | (*buf)[21] << 8))
+			return USBD_REQ_NOTSUPP;
+		break;
+	}
+
+	/* symbol buffer bytes at offset wValue */
+	case USB_REQ_KEY_DATA:
+		if (req->wValue > KEY_BUF_SIZE || *len > KEY_BUF_SIZE - req->wValue)
+			return USBD_REQ_NOTSUPP;
+		for (uint16_t i = 0; i < *len; ++i)
+			key_buf[req->wValue + i] = (*buf)[i];
+		break;
+
+	/*
+	 * 8 byte: uint64 frequency in Hz, little endian
+	 * 16 byte: frequency + uint32 ref_hz, uint16 r_counter, uint8 flags, 1 byte reserved
+	 */
+	case USB_REQ_SET_FREQ: {
+		sweep_stop();
+		key_stop();
+		if (*len != 8 && *len != 16)
+			return USBD_REQ_NOTSUPP;
+
+		uint64_t freq_hz = get_le32(*buf) | (uint64_t)get_le32(*buf + 4) << 32;
+		if (*len == 16) {
+			struct adf4351_config cfg = {
+				.ref_hz = get_le32(*buf + 8),
+				.r_counter = (*buf)[12] | (*buf)[13] << 8,
+				.flags = (*buf)[14],
+			};
+			if (!adf4351_pfd(&cfg))
+				return USBD_REQ_NOTSUPP;
+			adf_cfg = cfg;
+		}
+		if (!adf_set_freq(freq_hz))
+			return USBD_REQ_NOTSUPP;
+		break;
+	}
+
+	/* 4 byte register value, little endian; an optional 5th byte is ignored */
+	case USB_REQ_SET_REG:
+	default: /* the first FW version accepted any vendor request */
+		sweep_stop();
+		key_stop();
+		if (*len != 4 && *len != 5)
+			return USBD_REQ_NOTSUPP;
+		if (!adf_write_reg(get_le32(*buf)))
+			return USBD_REQ_NOTSUPP;
+		break;
 	}
+
+	gpio_set(PORT_LED, PIN_LED);
+	led_countdown = LED_TIMEOUT;
+
+	return USBD_REQ_HANDLED;
 }
 
 static void usb_set_config_cb(usbd_device *usbd_dev, uint16_t wValue)
@@ -197,6 +753,24 @@ static void usb_set_config_cb(usbd_device *usbd_dev, uint16_t wValue)
 		USB_REQ_TYPE_TYPE, vendor_control_callback);
 }
 
+void tim2_isr(void)
+{
+	if (timer_get_flag(TIM2, TIM_SR_UIF)) {
+		timer_clear_flag(TIM2, TIM_SR_UIF);
+		if (sweep.active)
+			sweep_step();
+	}
+}
+
+void tim3_isr(void)
+{
+	if (timer_get_flag(TIM3, TIM_SR_UIF)) {
+		timer_clear_flag(TIM3, TIM_SR_UIF);
+		if (key.active)
+			key_step();
+	}
+}
+
 void sys_tick_handler(void)
 {
 	if (led_countdown && !--led_countdown)
@@ -212,12 +786,50 @@ void dma1_channel3_isr(void)
 	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
 	spi_disable_tx_dma(SPI1);
 	dma_disable_channel(DMA1, DMA_CHANNEL3);
+	spi_dma_done = true;
+}
+
+static void spi_start_dma(uint32_t value)
+{
+	spi_word = value;
+	spi_dma_done = false;
+
+	dma_channel_reset(DMA1, DMA_CHANNEL3);
+
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&SPI1_DR);
+	dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)&spi_word);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL3, sizeof(spi_word));
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL3);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
+
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
+	dma_enable_channel(DMA1, DMA_CHANNEL3);
+
+	/* LE low after the setup time above stretches the previous LE pulse */
+	gpio_clear(PORT_SPI, PIN_LE);
+	spi_enable_tx_dma(SPI);
 }
 
+/* latch the finished word with LE, then start the next queued one */
 static void spi_poll(void)
 {
-	if (!(SPI_SR(SPI) & SPI_SR_BSY))
+	if (spi_active) {
+		if (!spi_dma_done || !(SPI_SR(SPI) & SPI_SR_TXE) || (SPI_SR(SPI) & SPI_SR_BSY))
+			return;
 		gpio_set(PORT_SPI, PIN_LE);
+		if (spi_word_tag)
+			key_latched(spi_word_tag);
+		spi_active = false;
+	}
+	if (spi_tail != spi_head) {
+		spi_word_tag = spi_tag[spi_tail];
+		spi_start_dma(spi_queue[spi_tail]);
+		spi_tail = (spi_tail + 1) % SPI_QUEUE_SIZE;
+		spi_active = true;
+	}
 }
 
 int main(void)
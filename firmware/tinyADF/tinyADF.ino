@@ -10,6 +10,17 @@
 #include <ctype.h>
 
 
+//-----------------------------------------------------------------------------
+// Global Variables
+//-----------------------------------------------------------------------------
+
+bool verbose = false;
+bool echo = true;
+bool binary = false; // binary frame mode, see parse_frame()
+
+uint32_t argument = 0;
+
+
 //-----------------------------------------------------------------------------
 // Main routines
 //-----------------------------------------------------------------------------
@@ -25,18 +36,38 @@ void setup() {
 
 // the loop routine runs over and over again forever:
 void loop() {
-    parse_command();
+    if ( binary )
+        parse_frame();
+    else
+        parse_command();
 }
 
 
 //-----------------------------------------------------------------------------
-// Global Variables
+// Binary frame protocol
+//   [len] [type] [payload ...] [crc]
+//   len: number of bytes following the len byte (type + payload + crc)
+//   type: bit 7 set -> frame ends with a CRC-8 (poly 0x07, init 0)
+//         over len, type and payload
+//   reply: ACK or NAK, a mux query is answered with ACK + mux byte (0, 1 or MUX_UNKNOWN)
 //-----------------------------------------------------------------------------
+#define FRAME_EXIT 0x00 // back to ASCII mode
+#define FRAME_REG  0x01 // payload: one 32 bit register, little endian
+#define FRAME_REGS 0x02 // payload: 1..6 registers, written in order
+#define FRAME_MUX  0x03 // no payload, reply ACK + mux status
+#define FRAME_CRC  0x80
 
-bool verbose = false;
-bool echo = true;
+#define MUX_UNKNOWN 0xFF // mux status without MUX_PIN
 
-uint32_t argument = 0;
+#define ACK 0x06
+#define NAK 0x15
+
+#define FRAME_MAX 26         // type + 6 registers + crc
+#define FRAME_TIMEOUT_MS 100 // drop an incomplete frame after this pause
+
+// the Digispark has no free pin for MUXOUT (PB3, PB4: USB, PB5: reset),
+// define MUX_PIN if the board provides one, otherwise the mux query returns MUX_UNKNOWN
+// #define MUX_PIN PB5
 
 
 //-----------------------------------------------------------------------------
@@ -86,6 +117,12 @@ void parse_command( void ) {
                         show_help();
                     }
                     break;
+                case 'X': // binary frame mode (B is a hex digit)
+                    if ( echo )
+                        SerialUSB.println();
+                    binary = true;
+                    SerialUSB.write( ACK ); // sync the host
+                    break;
                 case 'R': // set Register
                     if ( echo )
                         SerialUSB.println();
@@ -111,19 +148,111 @@ void parse_command( void ) {
 
 void show_help() {
     SerialUSB.println( F( "tiny ADF4351 programmer" ) );
-    SerialUSB.println( F( "usage: <hexvalue>[RTV]" ) );
+    SerialUSB.println( F( "usage: <hexvalue>[RTV] or X" ) );
     SerialUSB.println( F( "<hexvalue>: 1..8 hex digits" ) );
+    SerialUSB.println( F( "X: binary frame mode" ) );
     SerialUSB.println( F( "R: write Register" ) );
     SerialUSB.println( F( "T: tx Echo" ) );
     SerialUSB.println( F( "V: Verbose" ) );
 }
 
 
+//-----------------------------------------------------------------------------
+// parse frame
+//   collect the bytes of one binary frame and execute it when complete
+//-----------------------------------------------------------------------------
+void parse_frame( void ) {
+    static byte frame[ FRAME_MAX ];
+    static byte len = 0; // expected number of bytes after the len byte, 0: wait for len
+    static byte pos = 0;
+    static unsigned long last = 0;
+
+    if ( SerialUSB.available() <= 0 )
+        return;
+    if ( len && millis() - last > FRAME_TIMEOUT_MS ) // resync after a lost byte
+        len = 0;
+    last = millis();
+
+    byte b = SerialUSB.read();
+    if ( !len ) {
+        if ( b < 1 || b > FRAME_MAX ) {
+            SerialUSB.write( NAK );
+            return;
+        }
+        len = b;
+        pos = 0;
+        return;
+    }
+    frame[ pos++ ] = b;
+    if ( pos < len )
+        return;
+
+    // frame complete
+    byte type = frame[ 0 ];
+    byte size = len; // type + payload (+ crc)
+    len = 0;
+    if ( type & FRAME_CRC ) {
+        if ( size < 2 ) { // type without crc
+            SerialUSB.write( NAK );
+            return;
+        }
+        byte crc = crc8( 0, size );
+        for ( byte iii = 0; iii < size - 1; ++iii )
+            crc = crc8( crc, frame[ iii ] );
+        if ( crc != frame[ --size ] ) {
+            SerialUSB.write( NAK );
+            return;
+        }
+    }
+    byte *payload = frame + 1;
+    --size; // payload size
+    switch ( type & ~FRAME_CRC ) {
+        case FRAME_EXIT:
+            binary = false;
+            break;
+        case FRAME_REG:
+        case FRAME_REGS:
+            if ( !size || size % 4 || size > 24 || ( ( type & ~FRAME_CRC ) == FRAME_REG && size != 4 ) ) {
+                SerialUSB.write( NAK );
+                return;
+            }
+            for ( ; size; size -= 4, payload += 4 ) {
+                argument = payload[ 0 ] | (uint32_t)payload[ 1 ] << 8 | (uint32_t)payload[ 2 ] << 16 | (uint32_t)payload[ 3 ] << 24;
+                set_register();
+            }
+            break;
+        case FRAME_MUX:
+            SerialUSB.write( ACK );
+#ifdef MUX_PIN
+            SerialUSB.write( ( PINB & _BV( MUX_PIN ) ) ? 1 : 0 );
+#else
+            SerialUSB.write( MUX_UNKNOWN );
+#endif
+            return;
+        default:
+            SerialUSB.write( NAK );
+            return;
+    }
+    SerialUSB.write( ACK );
+}
+
+
+//-----------------------------------------------------------------------------
+// CRC-8, polynomial x^8 + x^2 + x + 1 (0x07)
+//-----------------------------------------------------------------------------
+byte crc8( byte crc, byte data ) {
+    crc ^= data;
+    for ( byte iii = 0; iii < 8; ++iii )
+        crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x07 : crc << 1;
+    return crc;
+}
+
+
 //-----------------------------------------------------------------------------
 // set register
 //-----------------------------------------------------------------------------
 void set_register() {
-    if ( verbose ) {
+    if ( verbose && !binary ) {
         SerialUSB.println( argument, HEX );
     }
     LE_LOW();
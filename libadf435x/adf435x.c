@@ -0,0 +1,518 @@
+/*
+ * This file is part of the adf435x project.
+ *
+ * Copyright (C) 2024 Martin Homuth-Rosemann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "adf435x.h"
+
+#define FREQ_MIN_ADF4350 137500000ULL
+#define FREQ_MIN_ADF4351 33000000ULL
+#define FREQ_MAX 4500000000ULL
+#define FREQ_LIMIT (1ULL << 40)		/* no overflow in the solver below */
+
+#define PFD_MAX_FRAC 32000000ULL
+#define PFD_MAX_INT_ADF4351 90000000ULL
+#define BAND_SEL_CLK_MAX_LOW 125000ULL
+#define BAND_SEL_CLK_MAX_HIGH 500000ULL
+
+#define INT_MIN_PRESCALER_4_5 23
+#define INT_MIN_PRESCALER_8_9 75
+
+/* double buffered fields, see adf435x_stream */
+#define R1_BUFFERED (0x0FFFUL << 15 | 0x0FFFUL << 3)		/* phase, MOD */
+#define R2_BUFFERED (3UL << 24 | 0x3FFUL << 14 | 0x0FUL << 9)	/* doubler, div2, R, CP */
+#define R2_DOUBLE_BUFFER (1UL << 13)
+#define R4_RF_DIV (7UL << 20)
+
+#define CLK_DIV_MODE_RESYNC 2
+#define CLOCK_DIVIDER_MAX 4095
+
+/* register defaults of ADF4351::calculateFreq() */
+static const adf435x_params params_default = {
+	.phase = 1,
+	.prescaler_8_9 = 1,
+	.muxout = 6,
+	.r_counter = 250,
+	.double_buffer = 1,
+	.cp_current = 7,
+	.pd_polarity = 1,
+	.clock_divider = 150,
+	.feedback_fundamental = 1,
+	.mtld = 1,
+	.output_enable = 1,
+	.output_power = 3,
+	.ld_pin_mode = 1,
+};
+
+/* calculate greatest common divisor */
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+void adf435x_config_default(adf435x_config *cfg)
+{
+	cfg->ref_hz = 25000000;
+	cfg->channel_hz = 1000;
+	cfg->r_counter = 250;
+	cfg->flags = 0;
+	cfg->device = ADF435X_ADF4351;
+}
+
+void adf435x_params_default(adf435x_params *p)
+{
+	*p = params_default;
+}
+
+void adf435x_pfd(const adf435x_config *cfg, uint64_t *num, uint64_t *den)
+{
+	*num = (uint64_t)cfg->ref_hz;
+	*den = cfg->r_counter & 0x3FF;
+	if (cfg->flags & ADF435X_CFG_REF_DOUBLER)
+		*num *= 2;
+	if (cfg->flags & ADF435X_CFG_REF_DIV2)
+		*den *= 2;
+}
+
+uint8_t adf435x_rf_div(uint64_t freq_hz)
+{
+	uint8_t rf_div = 0;
+
+	for (uint32_t f = 2200000000UL; f > 66000000UL; f /= 2) {
+		if (freq_hz >= f)
+			break;
+		++rf_div;
+	}
+	return rf_div;
+}
+
+int adf435x_solve(const adf435x_config *cfg, uint64_t freq_hz, adf435x_params *p)
+{
+	const uint8_t flags = cfg->flags;
+	const int adf4351 = cfg->device == ADF435X_ADF4351;
+	int err = ADF435X_OK;
+	uint64_t num, den;
+
+/* keep the first error */
+#define FAIL(e) do { if (err == ADF435X_OK) err = (e); } while (0)
+
+	adf435x_pfd(cfg, &num, &den);
+	p->r_counter = cfg->r_counter & 0x3FF;
+	p->ref_doubler = !!(flags & ADF435X_CFG_REF_DOUBLER);
+	p->ref_div2 = !!(flags & ADF435X_CFG_REF_DIV2);
+	p->feedback_fundamental = !(flags & ADF435X_CFG_FEEDBACK_DIVIDED);
+	p->band_select_clock_mode = !!(flags & ADF435X_CFG_BAND_SELECT_HIGH);
+
+	if (!num || !den || !cfg->channel_hz)
+		return ADF435X_ERR_PARAM;
+	/* fixed point frequency: N = n_hz * den / (num << shift), n_hz * den < 2^60 */
+	const unsigned shift = flags & ADF435X_CFG_FREQ_Q16 ? 16 : 0;
+	if (freq_hz > (shift ? FREQ_MAX << shift : FREQ_LIMIT))
+		return ADF435X_ERR_FREQ;
+	if (freq_hz < (adf4351 ? FREQ_MIN_ADF4351 : FREQ_MIN_ADF4350) << shift || freq_hz > FREQ_MAX << shift)
+		FAIL(ADF435X_ERR_FREQ);
+
+	const uint8_t rf_div = adf435x_rf_div(freq_hz >> shift);
+	const uint64_t n_hz = p->feedback_fundamental ? freq_hz << rf_div : freq_hz;
+	const uint64_t num_n = num << shift;
+
+	/* N = n_hz / fPFD = n_hz * den / num, exact */
+	uint64_t INT = n_hz * den / num_n;
+	const uint64_t rem = n_hz * den % num_n;
+	const uint64_t channel = den * cfg->channel_hz;
+	uint64_t MOD = flags & ADF435X_CFG_NEAREST ? (num + channel / 2) / channel : num / channel;
+	uint64_t FRAC = 0;
+
+	if (MOD > (UINT64_MAX - num_n) / num_n)
+		return ADF435X_ERR_MOD;
+	if (flags & ADF435X_CFG_NEAREST) {
+		FRAC = (MOD * rem + num_n / 2) / num_n;
+		if (FRAC && FRAC == MOD) { /* rounded up to the next integer */
+			++INT;
+			FRAC = 0;
+		}
+	} else {
+		FRAC = MOD * rem / num_n;
+	}
+
+	if (!FRAC) { /* INT mode */
+		if (!(flags & ADF435X_CFG_KEEP_MOD) || MOD < 2)
+			MOD = 2;
+		p->ldf = 1; /* LDF_INT */
+		p->ldp = 1; /* LDP_6NS */
+	} else { /* FRAC mode */
+		if (!(flags & ADF435X_CFG_KEEP_MOD)) {
+			uint64_t div = gcd(FRAC, MOD);
+			FRAC /= div;
+			MOD /= div;
+		}
+		p->ldf = 0; /* LDF_FRAC */
+		p->ldp = 0; /* LDP_10NS */
+		if (num > PFD_MAX_FRAC * den)
+			FAIL(ADF435X_ERR_PFD);
+	}
+	if (!FRAC && num > PFD_MAX_FRAC * den &&
+			(!adf4351 || num > PFD_MAX_INT_ADF4351 * den || !p->band_select_clock_mode))
+		FAIL(ADF435X_ERR_PFD);
+	if (INT < (p->prescaler_8_9 ? INT_MIN_PRESCALER_8_9 : INT_MIN_PRESCALER_4_5) || INT > 0xFFFF)
+		FAIL(ADF435X_ERR_INT);
+	if (MOD > 0x0FFF)
+		FAIL(ADF435X_ERR_MOD);
+
+	/* band select clock = fPFD / divider <= 125 kHz (500 kHz in high mode) */
+	const uint64_t bsc = den * (adf4351 && p->band_select_clock_mode ?
+			BAND_SEL_CLK_MAX_HIGH : BAND_SEL_CLK_MAX_LOW);
+	uint64_t band_sel_clk_div = (num + bsc - 1) / bsc;
+	if (band_sel_clk_div > 255) {
+		band_sel_clk_div = 255;
+		FAIL(ADF435X_ERR_BAND_SELECT);
+	}
+
+	p->INT = INT;
+	p->FRAC = FRAC;
+	p->MOD = MOD;
+	p->rf_div_select = rf_div;
+	p->band_select_clock_divider = band_sel_clk_div;
+	return err;
+#undef FAIL
+}
+
+void adf435x_pack(const adf435x_params *p, uint32_t reg[6])
+{
+	reg[0] = (uint32_t)(p->INT & 0xFFFF) << 15 |
+		(uint32_t)(p->FRAC & 0x0FFF) << 3 | 0;
+	reg[1] = (uint32_t)(p->phase_adjust & 1) << 28 |
+		(uint32_t)(p->prescaler_8_9 & 1) << 27 |
+		(uint32_t)(p->phase & 0x0FFF) << 15 |
+		(uint32_t)(p->MOD & 0x0FFF) << 3 | 1;
+	reg[2] = (uint32_t)(p->low_noise_spur_mode & 3) << 29 |
+		(uint32_t)(p->muxout & 7) << 26 |
+		(uint32_t)(p->ref_doubler & 1) << 25 |
+		(uint32_t)(p->ref_div2 & 1) << 24 |
+		(uint32_t)(p->r_counter & 0x3FF) << 14 |
+		(uint32_t)(p->double_buffer & 1) << 13 |
+		(uint32_t)(p->cp_current & 0x0F) << 9 |
+		(uint32_t)(p->ldf & 1) << 8 |
+		(uint32_t)(p->ldp & 1) << 7 |
+		(uint32_t)(p->pd_polarity & 1) << 6 |
+		(uint32_t)(p->powerdown & 1) << 5 |
+		(uint32_t)(p->cp_three_state & 1) << 4 |
+		(uint32_t)(p->counter_reset & 1) << 3 | 2;
+	reg[3] = (uint32_t)(p->band_select_clock_mode & 1) << 23 |
+		(uint32_t)(p->abp & 1) << 22 |
+		(uint32_t)(p->charge_cancel & 1) << 21 |
+		(uint32_t)(p->csr & 1) << 18 |
+		(uint32_t)(p->clk_div_mode & 3) << 15 |
+		(uint32_t)(p->clock_divider & 0x0FFF) << 3 | 3;
+	reg[4] = (uint32_t)(p->feedback_fundamental & 1) << 23 |
+		(uint32_t)(p->rf_div_select & 7) << 20 |
+		(uint32_t)p->band_select_clock_divider << 12 |
+		(uint32_t)(p->vco_powerdown & 1) << 11 |
+		(uint32_t)(p->mtld & 1) << 10 |
+		(uint32_t)(p->aux_output_select & 1) << 9 |
+		(uint32_t)(p->aux_output_enable & 1) << 8 |
+		(uint32_t)(p->aux_output_power & 3) << 6 |
+		(uint32_t)(p->output_enable & 1) << 5 |
+		(uint32_t)(p->output_power & 3) << 3 | 4;
+	reg[5] = (uint32_t)(p->ld_pin_mode & 3) << 22 | 3UL << 19 | 5;
+}
+
+int adf435x_unpack(const uint32_t reg[6], adf435x_params *p)
+{
+	for (uint32_t r = 0; r < 6; ++r)
+		if ((reg[r] & 7) != r)
+			return ADF435X_ERR_REGISTER;
+
+	p->INT = reg[0] >> 15 & 0xFFFF;
+	p->FRAC = reg[0] >> 3 & 0x0FFF;
+
+	p->phase_adjust = reg[1] >> 28 & 1;
+	p->prescaler_8_9 = reg[1] >> 27 & 1;
+	p->phase = reg[1] >> 15 & 0x0FFF;
+	p->MOD = reg[1] >> 3 & 0x0FFF;
+
+	p->low_noise_spur_mode = reg[2] >> 29 & 3;
+	p->muxout = reg[2] >> 26 & 7;
+	p->ref_doubler = reg[2] >> 25 & 1;
+	p->ref_div2 = reg[2] >> 24 & 1;
+	p->r_counter = reg[2] >> 14 & 0x3FF;
+	p->double_buffer = reg[2] >> 13 & 1;
+	p->cp_current = reg[2] >> 9 & 0x0F;
+	p->ldf = reg[2] >> 8 & 1;
+	p->ldp = reg[2] >> 7 & 1;
+	p->pd_polarity = reg[2] >> 6 & 1;
+	p->powerdown = reg[2] >> 5 & 1;
+	p->cp_three_state = reg[2] >> 4 & 1;
+	p->counter_reset = reg[2] >> 3 & 1;
+
+	p->band_select_clock_mode = reg[3] >> 23 & 1;
+	p->abp = reg[3] >> 22 & 1;
+	p->charge_cancel = reg[3] >> 21 & 1;
+	p->csr = reg[3] >> 18 & 1;
+	p->clk_div_mode = reg[3] >> 15 & 3;
+	p->clock_divider = reg[3] >> 3 & 0x0FFF;
+
+	p->feedback_fundamental = reg[4] >> 23 & 1;
+	p->rf_div_select = reg[4] >> 20 & 7;
+	p->band_select_clock_divider = reg[4] >> 12 & 0xFF;
+	p->vco_powerdown = reg[4] >> 11 & 1;
+	p->mtld = reg[4] >> 10 & 1;
+	p->aux_output_select = reg[4] >> 9 & 1;
+	p->aux_output_enable = reg[4] >> 8 & 1;
+	p->aux_output_power = reg[4] >> 6 & 3;
+	p->output_enable = reg[4] >> 5 & 1;
+	p->output_power = reg[4] >> 3 & 3;
+
+	p->ld_pin_mode = reg[5] >> 22 & 3;
+	return ADF435X_OK;
+}
+
+size_t adf435x_solve_n(const adf435x_config *cfg, const adf435x_params *base,
+		const uint64_t *freq_hz, size_t n, uint32_t *regs, int *err)
+{
+	adf435x_params p;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		p = *base;
+		int rc = adf435x_solve(cfg, freq_hz[i], &p);
+		if (rc != ADF435X_OK) {
+			if (err)
+				*err = rc;
+			return i;
+		}
+		adf435x_pack(&p, regs + 6 * i);
+	}
+	if (err)
+		*err = ADF435X_OK;
+	return i;
+}
+
+/* PFD of a parameter set, 0 if the R counter is 0 */
+static double params_pfd(uint32_t ref_hz, const adf435x_params *p)
+{
+	const uint32_t r_div = p->r_counter * (p->ref_div2 ? 2 : 1);
+
+	return r_div ? (double)ref_hz * (p->ref_doubler ? 2 : 1) / r_div : 0;
+}
+
+int adf435x_output_of(uint32_t ref_hz, const adf435x_params *p, adf435x_output *o)
+{
+	o->rf_divider = 1 << p->rf_div_select;
+	o->rf_power_dbm = -4 + 3 * p->output_power;
+	o->aux_power_dbm = -4 + 3 * p->aux_output_power;
+	o->cp_current_ma = (p->cp_current + 1) * 0.3125;
+	o->off = p->powerdown || p->vco_powerdown || !p->output_enable;
+	o->pfd_hz = params_pfd(ref_hz, p);
+	o->band_select_clock_hz = p->band_select_clock_divider ?
+		o->pfd_hz / p->band_select_clock_divider : 0;
+	if (!o->pfd_hz || (p->FRAC && !p->MOD)) {
+		o->n = o->vco_hz = o->rf_hz = o->aux_hz = o->step_hz = NAN;
+		return ADF435X_ERR_PARAM;
+	}
+
+	/* the N counter sees the VCO (fundamental) or the RF output */
+	o->n = p->INT + (p->FRAC ? (double)p->FRAC / p->MOD : 0);
+	if (p->feedback_fundamental) {
+		o->vco_hz = o->pfd_hz * o->n;
+		o->rf_hz = o->vco_hz / o->rf_divider;
+		o->step_hz = p->MOD ? o->pfd_hz / p->MOD / o->rf_divider : 0;
+	} else {
+		o->rf_hz = o->pfd_hz * o->n;
+		o->vco_hz = o->rf_hz * o->rf_divider;
+		o->step_hz = p->MOD ? o->pfd_hz / p->MOD : 0;
+	}
+	o->aux_hz = p->aux_output_select ? o->vco_hz : o->rf_hz;
+	return ADF435X_OK;
+}
+
+int adf435x_decode(uint32_t ref_hz, const uint32_t reg[6], adf435x_params *p, adf435x_output *o)
+{
+	int err = adf435x_unpack(reg, p);
+
+	if (err != ADF435X_OK)
+		return err;
+	return adf435x_output_of(ref_hz, p, o);
+}
+
+/* PFD of the active R2 */
+static double stream_pfd(const adf435x_stream *s)
+{
+	const uint32_t r2 = s->active[2];
+	const uint32_t r_div = (r2 >> 14 & 0x3FF) * (r2 >> 24 & 1 ? 2 : 1);
+
+	return r_div ? (double)s->ref_hz * (r2 >> 25 & 1 ? 2 : 1) / r_div : 0;
+}
+
+/* RF output of the active registers, fields as in adf435x_output_of() */
+static double stream_rf(const adf435x_stream *s)
+{
+	const uint32_t *a = s->active;
+	const uint32_t INT = a[0] >> 15 & 0xFFFF;
+	const uint32_t FRAC = a[0] >> 3 & 0x0FFF;
+	const uint32_t MOD = a[1] >> 3 & 0x0FFF;
+	double f;
+
+	if (a[2] & 1UL << 5 || a[4] & 1UL << 11 || !(a[4] & 1UL << 5)) /* powered down or disabled */
+		return 0;
+	if (!s->pfd_hz || (FRAC && !MOD))
+		return NAN;
+	f = s->pfd_hz * (FRAC ? INT + (double)FRAC / MOD : INT);
+	if (a[4] & 1UL << 23) /* fundamental feedback */
+		f /= 1 << (a[4] >> 20 & 7);
+	return f;
+}
+
+void adf435x_stream_init(adf435x_stream *s, uint32_t ref_hz, const uint32_t reg[6])
+{
+	for (uint32_t r = 0; r < 6; ++r)
+		s->reg[r] = s->active[r] = reg ? reg[r] : r;
+	s->ref_hz = ref_hz;
+	s->pfd_hz = stream_pfd(s);
+	s->rf_hz = stream_rf(s);
+}
+
+size_t adf435x_decode_stream(adf435x_stream *s, const uint32_t *words, size_t n, double *rf_hz)
+{
+	size_t changes = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t w = words[i];
+		const uint32_t r = w & 7;
+		uint32_t buffered;
+
+		if (r < 6) {
+			s->reg[r] = w;
+			switch (r) {
+			case 0: /* latches the double buffered fields */
+				for (int k = 0; k < 6; ++k)
+					s->active[k] = s->reg[k];
+				s->pfd_hz = stream_pfd(s);
+				break;
+			case 1:
+				s->active[1] = (w & ~R1_BUFFERED) | (s->active[1] & R1_BUFFERED);
+				break;
+			case 2:
+				s->active[2] = (w & ~R2_BUFFERED) | (s->active[2] & R2_BUFFERED);
+				break;
+			case 4:
+				buffered = s->active[2] & R2_DOUBLE_BUFFER ? R4_RF_DIV : 0;
+				s->active[4] = (w & ~buffered) | (s->active[4] & buffered);
+				break;
+			default:
+				s->active[r] = w;
+				break;
+			}
+			if (r == 0 || r == 2 || r == 4) {
+				const double f = stream_rf(s);
+				if (f != s->rf_hz && !(isnan(f) && isnan(s->rf_hz)))
+					++changes;
+				s->rf_hz = f;
+			}
+		}
+		if (rf_hz)
+			rf_hz[i] = s->rf_hz;
+	}
+	return changes;
+}
+
+double adf435x_sync_time(uint32_t ref_hz, const adf435x_params *p)
+{
+	const double pfd = params_pfd(ref_hz, p);
+
+	if (p->clk_div_mode != CLK_DIV_MODE_RESYNC || !pfd)
+		return 0;
+	return (double)p->clock_divider * p->MOD / pfd;
+}
+
+int adf435x_resync(uint32_t ref_hz, adf435x_params *p, double lock_s)
+{
+	const double pfd = params_pfd(ref_hz, p);
+	double div;
+
+	if (!pfd || !p->MOD || lock_s < 0)
+		return ADF435X_ERR_PARAM;
+	div = ceil(lock_s * pfd / p->MOD);
+	if (div > CLOCK_DIVIDER_MAX)
+		return ADF435X_ERR_PARAM;
+	p->clk_div_mode = CLK_DIV_MODE_RESYNC;
+	p->clock_divider = div < 1 ? 1 : (uint16_t)div;
+	p->phase_adjust = 0;
+	return ADF435X_OK;
+}
+
+uint16_t adf435x_phase_word(const adf435x_params *p, double deg)
+{
+	double turns = deg / 360 - floor(deg / 360);	/* 0 .. 1 */
+	uint32_t phase;
+
+	if (!p->MOD)
+		return 0;
+	phase = (uint32_t)llround(turns * p->MOD);
+	return phase >= p->MOD ? 0 : phase;
+}
+
+unsigned adf435x_changed(const uint32_t old_reg[6], const uint32_t reg[6])
+{
+	unsigned mask = 0;
+
+	for (unsigned r = 0; r < 6; ++r)
+		if (old_reg[r] != reg[r])
+			mask |= 1U << r;
+	return mask;
+}
+
+const char *adf435x_strerror(int err)
+{
+	switch (err) {
+	case ADF435X_OK:
+		return "ok";
+	case ADF435X_ERR_PARAM:
+		return "configuration out of range";
+	case ADF435X_ERR_FREQ:
+		return "frequency out of range";
+	case ADF435X_ERR_PFD:
+		return "PFD frequency too high";
+	case ADF435X_ERR_INT:
+		return "INT out of range for the prescaler";
+	case ADF435X_ERR_MOD:
+		return "MOD does not fit into 12 bit";
+	case ADF435X_ERR_BAND_SELECT:
+		return "band select clock divider above 255";
+	case ADF435X_ERR_REGISTER:
+		return "wrong register control bits";
+	case ADF435X_ERR_TRANSPORT:
+		return "register transfer failed";
+	default:
+		return "unknown error";
+	}
+}
+
+int adf435x_write_regs(const adf435x_transport *t, const uint32_t reg[6], unsigned mask)
+{
+	for (int r = 5; r >= 0; --r)
+		if (mask & 1U << r && t->write_reg(t->ctx, reg[r]) < 0)
+			return ADF435X_ERR_TRANSPORT;
+	return ADF435X_OK;
+}
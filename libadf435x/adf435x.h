@@ -0,0 +1,268 @@
+/*
+ * This file is part of the adf435x project.
+ *
+ * Copyright (C) 2024 Martin Homuth-Rosemann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libadf435x - ADF4350/ADF4351 register math shared by the GUI, the
+ * command line tools and the python package.
+ *
+ * - solver:    frequency -> INT, FRAC, MOD, RF divider, band select clock,
+ *              exact integer arithmetic (same results as ADF4351::Plan)
+ * - pack:      all register fields -> R0..R5
+ * - unpack:    R0..R5 -> all register fields
+ * - decode:    R0..R5 -> fields and output frequencies, also for a recorded
+ *              stream of register writes (readback, trace analysis)
+ * - resync:    phase resync timing and phase words for coherent retunes
+ * - transport: write register words to a device through callbacks
+ *
+ * No function allocates memory or keeps hidden state, all are thread safe.
+ */
+
+#ifndef ADF435X_H
+#define ADF435X_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADF435X_ADF4350 0
+#define ADF435X_ADF4351 1
+
+/* error codes, negative */
+#define ADF435X_OK 0
+#define ADF435X_ERR_PARAM (-1)		/* configuration out of range */
+#define ADF435X_ERR_FREQ (-2)		/* frequency out of range */
+#define ADF435X_ERR_PFD (-3)		/* PFD too high for FRAC or INT mode */
+#define ADF435X_ERR_INT (-4)		/* INT out of range for the prescaler */
+#define ADF435X_ERR_MOD (-5)		/* MOD does not fit into 12 bit */
+#define ADF435X_ERR_BAND_SELECT (-6)	/* band select clock divider > 255 */
+#define ADF435X_ERR_REGISTER (-7)	/* wrong control bits */
+#define ADF435X_ERR_TRANSPORT (-8)	/* device write failed */
+
+/* all register fields, values as in the data sheet tables */
+typedef struct adf435x_params {
+	/* R0 */
+	uint16_t INT;			/* 23/75 .. 65535 */
+	uint16_t FRAC;			/* 0 .. MOD - 1 */
+	/* R1 */
+	uint16_t MOD;			/* 2 .. 4095 */
+	uint16_t phase;			/* 12 bit */
+	uint8_t prescaler_8_9;		/* 0: 4/5, 1: 8/9 */
+	uint8_t phase_adjust;
+	/* R2 */
+	uint8_t low_noise_spur_mode;	/* 0: low noise, 3: low spur */
+	uint8_t muxout;			/* 0 .. 7, 6: digital lock detect */
+	uint8_t ref_doubler;
+	uint8_t ref_div2;
+	uint16_t r_counter;		/* 1 .. 1023 */
+	uint8_t double_buffer;
+	uint8_t cp_current;		/* 0 .. 15: ( n + 1 ) * 0.3125 mA */
+	uint8_t ldf;			/* 0: FRAC-N, 1: INT-N */
+	uint8_t ldp;			/* 0: 10 ns, 1: 6 ns */
+	uint8_t pd_polarity;		/* 1: positive */
+	uint8_t powerdown;
+	uint8_t cp_three_state;
+	uint8_t counter_reset;
+	/* R3 */
+	uint8_t band_select_clock_mode;	/* 0: low, 1: high (ADF4351) */
+	uint8_t abp;			/* 0: 6 ns (FRAC-N), 1: 3 ns (INT-N) */
+	uint8_t charge_cancel;
+	uint8_t csr;
+	uint8_t clk_div_mode;		/* 0: off, 1: fast lock, 2: resync */
+	uint16_t clock_divider;		/* 12 bit */
+	/* R4 */
+	uint8_t feedback_fundamental;	/* 1: fundamental, 0: divided */
+	uint8_t rf_div_select;		/* divider = 1 << rf_div_select */
+	uint8_t band_select_clock_divider; /* 1 .. 255 */
+	uint8_t vco_powerdown;
+	uint8_t mtld;
+	uint8_t aux_output_select;	/* 0: divided, 1: fundamental */
+	uint8_t aux_output_enable;
+	uint8_t aux_output_power;	/* 0 .. 3: -4, -1, +2, +5 dBm */
+	uint8_t output_enable;
+	uint8_t output_power;		/* 0 .. 3: -4, -1, +2, +5 dBm */
+	/* R5 */
+	uint8_t ld_pin_mode;		/* 0: low, 1: digital lock detect, 3: high */
+} adf435x_params;
+
+/* adf435x_config.flags */
+#define ADF435X_CFG_REF_DOUBLER 0x01
+#define ADF435X_CFG_REF_DIV2 0x02
+#define ADF435X_CFG_FEEDBACK_DIVIDED 0x04	/* N counter after the RF divider */
+#define ADF435X_CFG_BAND_SELECT_HIGH 0x08	/* band select clock up to 500 kHz (ADF4351) */
+#define ADF435X_CFG_NEAREST 0x10	/* round MOD and FRAC to nearest, default truncate */
+#define ADF435X_CFG_KEEP_MOD 0x20	/* do not reduce FRAC / MOD, keep MOD in INT mode */
+#define ADF435X_CFG_FREQ_Q16 0x40	/* freq_hz of the solver with 16 fractional bits (1/65536 Hz) */
+
+/* solver input besides the frequency */
+typedef struct adf435x_config {
+	uint32_t ref_hz;		/* reference input frequency */
+	uint32_t channel_hz;		/* MOD = fPFD / channel_hz before reduction */
+	uint16_t r_counter;		/* 10 bit R counter 1..1023 */
+	uint8_t flags;			/* ADF435X_CFG_xxx */
+	uint8_t device;			/* ADF435X_ADF4350 or ADF435X_ADF4351 */
+} adf435x_config;
+
+/*
+ * 25 MHz reference, R = 250, 1 kHz channel, ADF4351, fundamental feedback,
+ * truncated FRAC like ADF4351::calculateFreq() and the STM32 firmware
+ */
+void adf435x_config_default(adf435x_config *cfg);
+
+/*
+ * Register defaults of the command line tools: digital lock detect on MUXOUT
+ * and LD pin, double buffer, 2.50 mA, phase 1, prescaler 8/9, clock divider
+ * 150, MTLD, output enabled with +5 dBm.
+ */
+void adf435x_params_default(adf435x_params *p);
+
+/* PFD frequency of a configuration as fraction num / den Hz, den == 0 if invalid */
+void adf435x_pfd(const adf435x_config *cfg, uint64_t *num, uint64_t *den);
+
+/* RF divider select for freq_hz, the output divider is 1 << result */
+uint8_t adf435x_rf_div(uint64_t freq_hz);
+
+/*
+ * Set the frequency dependent fields of p for freq_hz: INT, FRAC, MOD,
+ * rf_div_select, band_select_clock_divider, ldf, ldp and the fields from
+ * cfg (r_counter, ref_doubler, ref_div2, feedback_fundamental,
+ * band_select_clock_mode). FRAC = 0 gives INT mode with MOD = 2, FRAC mode
+ * reduces FRAC / MOD by their GCD.
+ * The prescaler is not changed, INT is checked against it.
+ * Returns ADF435X_OK or the first error found, the fields are set anyway
+ * (masked by adf435x_pack()) unless the PFD is 0. With ADF435X_CFG_FREQ_Q16
+ * freq_hz is fixed point, a frequency above the range returns at once.
+ */
+int adf435x_solve(const adf435x_config *cfg, uint64_t freq_hz, adf435x_params *p);
+
+/* R0..R5 from all fields, fields are masked to their width */
+void adf435x_pack(const adf435x_params *p, uint32_t reg[6]);
+
+/* all fields from R0..R5, ADF435X_ERR_REGISTER if a control bit field is wrong */
+int adf435x_unpack(const uint32_t reg[6], adf435x_params *p);
+
+/*
+ * adf435x_solve() and adf435x_pack() for n frequencies, the fields that are
+ * not frequency dependent are taken from base. regs gets 6 * n words (R0..R5
+ * for every frequency). Returns the number of frequencies done, stops at the
+ * first error and stores the error code in *err (if err is not NULL).
+ */
+size_t adf435x_solve_n(const adf435x_config *cfg, const adf435x_params *base,
+		const uint64_t *freq_hz, size_t n, uint32_t *regs, int *err);
+
+/* values that follow from a register set */
+typedef struct adf435x_output {
+	double pfd_hz;			/* phase detector frequency */
+	double n;			/* INT + FRAC / MOD */
+	double vco_hz;
+	double rf_hz;			/* RF output */
+	double aux_hz;			/* AUX output, divided or fundamental */
+	double step_hz;			/* RF output step of FRAC +- 1 */
+	double band_select_clock_hz;
+	double cp_current_ma;		/* charge pump current */
+	uint8_t rf_divider;		/* 1 .. 64 */
+	int8_t rf_power_dbm;		/* -4, -1, +2, +5 */
+	int8_t aux_power_dbm;
+	uint8_t off;			/* power-down, VCO power-down or RF output disabled */
+} adf435x_output;
+
+/*
+ * Output values of a parameter set with the reference ref_hz, the frequencies
+ * are those the chip synthesizes when the output is on.
+ * ADF435X_ERR_PARAM if R counter or MOD are 0 (MOD = 0 is allowed for FRAC = 0).
+ */
+int adf435x_output_of(uint32_t ref_hz, const adf435x_params *p, adf435x_output *o);
+
+/* adf435x_unpack() followed by adf435x_output_of() */
+int adf435x_decode(uint32_t ref_hz, const uint32_t reg[6], adf435x_params *p, adf435x_output *o);
+
+/*
+ * Register state of a chip for the bulk decoder. reg holds the words written
+ * last, active the values in use: MOD, phase, R counter, doubler, divide-by-2
+ * and charge pump current wait for the next R0 write, the RF divider too if
+ * double buffering (R2[13]) is on.
+ */
+typedef struct adf435x_stream {
+	uint32_t reg[6];
+	uint32_t active[6];
+	uint32_t ref_hz;
+	double pfd_hz;			/* of active, 0 if R counter is 0 */
+	double rf_hz;			/* of active, NAN if invalid, 0 if the output is off */
+} adf435x_stream;
+
+/* start with the registers reg (both written and active), reg == NULL: all fields 0 */
+void adf435x_stream_init(adf435x_stream *s, uint32_t ref_hz, const uint32_t reg[6]);
+
+/*
+ * Apply n recorded register words in order. rf_hz[i] (if rf_hz is not NULL)
+ * gets the RF output frequency after words[i]: NAN while the active state is
+ * invalid (R counter 0, MOD 0 with FRAC != 0), 0 while the output is off.
+ * Words with control bits 6 or 7 change nothing.
+ * Returns the number of words that changed the output frequency.
+ */
+size_t adf435x_decode_stream(adf435x_stream *s, const uint32_t *words, size_t n, double *rf_hz);
+
+/*
+ * Phase resync (clk_div_mode 2): t_sync = clock_divider * MOD / fPFD after
+ * the R0 write the output phase is set to phase / MOD * 360 degrees relative
+ * to the reference. Devices that share the reference and latch R0 on the same
+ * PFD edge (any edge in INT mode) have the same output phase plus their
+ * phase offsets. The phase step is 360 / MOD degrees, ADF435X_CFG_KEEP_MOD
+ * keeps MOD high.
+ */
+
+/* t_sync in s, 0 if the resync mode is off or the R counter is 0 */
+double adf435x_sync_time(uint32_t ref_hz, const adf435x_params *p);
+
+/*
+ * Enable phase resync with the shortest t_sync >= lock_s (VCO band selection
+ * and lock must be done before), phase_adjust is cleared as the R0 write has
+ * to start the band selection. ADF435X_ERR_PARAM if the clock divider would
+ * exceed 4095 or PFD or MOD are 0, p is not changed then.
+ */
+int adf435x_resync(uint32_t ref_hz, adf435x_params *p, double lock_s);
+
+/* phase word of p->MOD for a phase offset of deg degrees (any sign), rounded */
+uint16_t adf435x_phase_word(const adf435x_params *p, double deg);
+
+/* mask of the registers that differ (bit n: Rn), e.g. for adf435x_write_regs() */
+unsigned adf435x_changed(const uint32_t old_reg[6], const uint32_t reg[6]);
+
+const char *adf435x_strerror(int err);
+
+/* device access, write_reg() transfers one register word */
+typedef struct adf435x_transport {
+	void *ctx;
+	int (*write_reg)(void *ctx, uint32_t reg);	/* 0: ok, < 0: error */
+	int (*read_mux)(void *ctx, uint8_t *mux);	/* optional, 0: ok */
+} adf435x_transport;
+
+/*
+ * Write the registers selected by mask (bit n: Rn) in the order R5 .. R0,
+ * R0 last as it starts the VCO band selection.
+ */
+int adf435x_write_regs(const adf435x_transport *t, const uint32_t reg[6], unsigned mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
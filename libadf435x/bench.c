@@ -0,0 +1,133 @@
+/*
+ * This file is part of the adf435x project.
+ *
+ * Copyright (C) 2024 Martin Homuth-Rosemann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * adf435x-bench [COUNT] - solves, packs, unpacks and decodes per second of libadf435x
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "adf435x.h"
+
+#define N_FREQ 4096	/* frequency table, fits into the L1 cache with its registers */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, unsigned long n, double dt, uint32_t check)
+{
+	printf("%-10s %10lu in %7.3f s %8.1f ns %12.0f /s  (0x%08X)\n",
+			name, n, dt, dt * 1e9 / n, n / dt, check);
+}
+
+int main(int argc, char *argv[])
+{
+	static uint64_t freq[N_FREQ];
+	static uint32_t regs[6 * N_FREQ];
+	static adf435x_params params[N_FREQ];
+	static uint32_t words[6 * N_FREQ];
+	static double rf_hz[6 * N_FREQ];
+	adf435x_output out;
+	adf435x_stream stream;
+	size_t changes = 0;
+	unsigned long count = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+	adf435x_config cfg;
+	adf435x_params base;
+	uint32_t check = 0;
+	double t0;
+	int err;
+
+	if (count < N_FREQ)
+		count = N_FREQ;
+	count -= count % N_FREQ;
+	adf435x_config_default(&cfg);
+	adf435x_params_default(&base);
+
+	/* 1 kHz grid 35 MHz .. 4.4 GHz, FRAC and INT mode */
+	srand(4351);
+	for (int i = 0; i < N_FREQ; ++i)
+		freq[i] = 35000000ULL + (uint64_t)(rand() % 4365000) * 1000;
+
+	t0 = now();
+	for (unsigned long n = 0; n < count; n += N_FREQ)
+		for (int i = 0; i < N_FREQ; ++i) {
+			params[i] = base;
+			check += adf435x_solve(&cfg, freq[i], &params[i]);
+			check += params[i].FRAC;
+		}
+	report("solve", count, now() - t0, check);
+
+	check = 0;
+	t0 = now();
+	for (unsigned long n = 0; n < count; n += N_FREQ)
+		for (int i = 0; i < N_FREQ; ++i) {
+			adf435x_pack(&params[i], regs + 6 * i);
+			check += regs[6 * i];
+		}
+	report("pack", count, now() - t0, check);
+
+	check = 0;
+	t0 = now();
+	for (unsigned long n = 0; n < count; n += N_FREQ)
+		for (int i = 0; i < N_FREQ; ++i) {
+			adf435x_unpack(regs + 6 * i, &params[i]);
+			check += params[i].INT;
+		}
+	report("unpack", count, now() - t0, check);
+
+	check = 0;
+	t0 = now();
+	for (unsigned long n = 0; n < count; n += N_FREQ) {
+		if (adf435x_solve_n(&cfg, &base, freq, N_FREQ, regs, &err) != N_FREQ) {
+			fprintf(stderr, "adf435x_solve_n: %s\n", adf435x_strerror(err));
+			return 1;
+		}
+		check += regs[0];
+	}
+	report("solve_n", count, now() - t0, check);
+
+	check = 0;
+	t0 = now();
+	for (unsigned long n = 0; n < count; n += N_FREQ)
+		for (int i = 0; i < N_FREQ; ++i) {
+			adf435x_decode(cfg.ref_hz, regs + 6 * i, &params[i], &out);
+			check += (uint32_t)out.rf_hz;
+		}
+	report("decode", count, now() - t0, check);
+
+	/* register stream as sent to the chip, R5 .. R0 for every frequency */
+	for (int i = 0; i < N_FREQ; ++i)
+		for (int r = 0; r < 6; ++r)
+			words[6 * i + r] = regs[6 * i + 5 - r];
+	adf435x_stream_init(&stream, cfg.ref_hz, NULL);
+	t0 = now();
+	for (unsigned long n = 0; n < 6 * count; n += 6 * N_FREQ)
+		changes += adf435x_decode_stream(&stream, words, 6 * N_FREQ, rf_hz);
+	report("stream", 6 * count, now() - t0, (uint32_t)changes);
+	return 0;
+}
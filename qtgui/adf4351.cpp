@@ -1,86 +1,88 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "adf4351.h"
+#include "adf435x.h"
 #include <math.h>
 #include <stdlib.h>
 
 
-ADF4351::ADF4351() { enable_gcd = true; }
-
-
-inline int min( const int a, const int b ) {
-    if ( a > b )
-        return b;
-    return a;
-}
-
-uint32_t gcd( uint32_t a, uint32_t b ) {
-    while ( true ) {
-        if ( a == 0 ) {
-            return b;
-        } else if ( b == 0 ) {
-            return a;
-        } else if ( a > b ) {
-            a = a % b;
-        } else {
-            b = b % a;
-        }
-    }
+ADF4351::ADF4351() {
+    enable_gcd = true;
+    band_select_auto = true;
+    memset( reg_values, 0, sizeof( reg_values ) );
 }
 
 
-void ADF4351::buildRegisters() {
+void ADF4351::buildRegisters( uint8_t mask ) {
     if ( verbose > 1 )
-        printf( " AD4351::BuildRegisters()\n" );
-
+        printf( " AD4351::BuildRegisters( 0x%02X )\n", mask );
+
+    // INT, FRAC, MOD, output and band select divider by libadf435x, rounded to the nearest kHz step
+    adf435x_config cfg;
+    adf435x_config_default( &cfg );
+    cfg.ref_hz = REF_FREQ * 1000000;
+    cfg.r_counter = r_counter;
+    cfg.flags = ADF435X_CFG_NEAREST;
+    if ( ref_doubler )
+        cfg.flags |= ADF435X_CFG_REF_DOUBLER;
+    if ( ref_div2 )
+        cfg.flags |= ADF435X_CFG_REF_DIV2;
+    if ( !feedback_select )
+        cfg.flags |= ADF435X_CFG_FEEDBACK_DIVIDED;
+    if ( band_select_clock_mode )
+        cfg.flags |= ADF435X_CFG_BAND_SELECT_HIGH;
+    if ( !enable_gcd )
+        cfg.flags |= ADF435X_CFG_KEEP_MOD;
+
+    adf435x_params p;
+    p.phase_adjust = PHASE_ADJUST;
+    p.prescaler_8_9 = PR1;
+    p.phase = PHASE;
+    p.low_noise_spur_mode = NOISE_MODE;
+    p.muxout = muxout;
+    p.double_buffer = double_buff;
+    p.cp_current = charge_pump_current;
+    p.pd_polarity = PD_Polarity;
+    p.powerdown = POWERDOWN;
+    p.cp_three_state = cp_3stage;
+    p.counter_reset = counter_reset;
+    p.abp = ABP;
+    p.charge_cancel = charge_cancelletion;
+    p.csr = CSR;
+    p.clk_div_mode = CLK_DIV_MODE;
+    p.clock_divider = clock_divider;
+    p.vco_powerdown = VCO_POWERDOWN;
+    p.mtld = mtld;
+    p.aux_output_select = AUX_OUTPUT_SELECT;
+    p.aux_output_enable = AUX_OUTPUT_ENABLE;
+    p.aux_output_power = AUX_OUTPUT_POWER;
+    p.output_enable = RF_ENABLE;
+    p.output_power = output_power;
+    p.ld_pin_mode = LD;
+    // frequency fields stay 0 if the reference setting is invalid
+    p.INT = p.FRAC = p.MOD = p.rf_div_select = p.ldf = p.ldp = 0;
+    p.band_select_clock_divider = 1;
+    int err = adf435x_solve( &cfg, frequency > 0 ? uint64_t( llround( frequency * 1e6 ) ) : 0, &p );
+    if ( err != ADF435X_OK && verbose )
+        printf( " %g MHz: %s\n", frequency, adf435x_strerror( err ) );
+    if ( LDF >= 0 ) // not auto
+        p.ldf = LDF;
+    if ( LDP >= 0 )
+        p.ldp = LDP;
+    if ( band_select_auto )
+        band_select_clock_divider = p.band_select_clock_divider;
+    else
+        p.band_select_clock_divider = band_select_clock_divider;
+
+    INT = p.INT;
+    FRAC = p.FRAC;
+    MOD = p.MOD;
     PFDFreq = ( REF_FREQ * double( ref_doubler ? 2 : 1 ) / double( ref_div2 ? 2 : 1 ) / double( r_counter ) );
-    uint16_t output_divider = 1;
-    if ( frequency >= 2200.0 ) {
-        output_divider = 1;
-    }
-    if ( frequency < 2200.0 ) {
-        output_divider = 2;
-    }
-    if ( frequency < 1100.0 ) {
-        output_divider = 4;
-    }
-    if ( frequency < 550.0 ) {
-        output_divider = 8;
-    }
-    if ( frequency < 275.0 ) {
-        output_divider = 16;
-    }
-    if ( frequency < 137.5 ) {
-        output_divider = 32;
-    }
-    if ( frequency < 68.75 ) {
-        output_divider = 64;
-    }
-
-    if ( feedback_select ) {
-        N = frequency * output_divider / PFDFreq;
-    } else {
-        N = frequency / PFDFreq;
-    }
-
-    N += 1e-9; // correct double to int error
-    INT = uint32_t( N );
-    MOD = uint32_t( round( 1000 * PFDFreq ) );
-    FRAC = uint32_t( round( ( N - INT ) * MOD ) );
-    if ( LDP < 0 ) // auto
-        LDP = FRAC ? 0 : 1;
-    if ( LDF < 0 ) // auto
-        LDF = FRAC ? 0 : 1;
-    if ( enable_gcd ) {
-        uint32_t div = gcd( uint32_t( MOD ), uint32_t( FRAC ) );
-        MOD = MOD / div;
-        FRAC = FRAC / div;
-    }
-    if ( MOD == 1.0 ) {
-        MOD = 2.0;
-    }
+    N = MOD ? INT + FRAC / MOD : 0;
+    band_select_clock_freq = 1000 * PFDFreq / band_select_clock_divider;
 
     if ( verbose > 1 ) {
+        const int output_divider = 1 << p.rf_div_select;
         printf( " PFDFreq: %d MHz * %d / %d / %d = %d kHz\n", REF_FREQ, ref_doubler ? 2 : 1, ref_div2 ? 2 : 1, r_counter,
                 int( PFDFreq * 1000 ) );
         printf( " f: %d kHz * %f / %d = %f MHz\n", int( PFDFreq * 1000 ), N, feedback_select ? output_divider : 1,
@@ -88,64 +90,83 @@ void ADF4351::buildRegisters() {
         printf( " N: %f, INT: %d, FRAC: %d, MOD: %d\n", N, INT, int( FRAC ), int( MOD ) );
     }
 
-    if ( band_select_auto ) {
-        uint32_t temp;
-        if ( band_select_clock_mode == 0 ) // low
-        {
-            temp = uint32_t( round( 8.0 * PFDFreq ) );
-            if ( 8.0 * PFDFreq - temp > 0 ) {
-                temp += 1u;
-            }
-            temp = ( ( temp > 255u ) ? 255u : temp );
-        } else {
-            temp = uint32_t( round( PFDFreq * 2.0 ) );
-            if ( 2.0 * PFDFreq - temp > 0 ) {
-                temp += 1u;
-            }
-            temp = ( ( temp > 255u ) ? 255u : temp );
-        }
-        band_select_clock_divider = temp;
-        band_select_clock_freq = ( 1000 * PFDFreq / (uint32_t)temp );
-    }
-
-    reg_values[ 0 ] =
-        (uint32_t)( (double)( (uint32_t)INT & 65535 ) * ( 1 << 15 ) + (double)( (uint32_t)FRAC & 4095 ) * ( 1 << 3 ) + 0 );
-    reg_values[ 1 ] = (uint32_t)( (double)PHASE_ADJUST * ( 1 << 28 ) + (double)PR1 * ( 1 << 27 ) + (double)PHASE * ( 1 << 15 ) +
-                                  (double)( (int)MOD & 4095 ) * ( 1 << 3 ) + 1 );
-    reg_values[ 2 ] =
-        (uint32_t)( (double)NOISE_MODE * ( 1 << 29 ) + (double)muxout * ( 1 << 26 ) +
-                    (double)( ref_doubler ? 1 : 0 ) * ( 1 << 25 ) + (double)( ref_div2 ? 1 : 0 ) * ( 1 << 24 ) +
-                    (double)r_counter * ( 1 << 14 ) + (double)double_buff * ( 1 << 13 ) + (double)charge_pump_current * ( 1 << 9 ) +
-                    (double)LDF * ( 1 << 8 ) + (double)LDP * ( 1 << 7 ) + (double)PD_Polarity * ( 1 << 6 ) +
-                    (double)POWERDOWN * ( 1 << 5 ) + (double)cp_3stage * ( 1 << 4 ) + (double)counter_reset * ( 1 << 3 ) + 2 );
-    reg_values[ 3 ] = (uint32_t)( (uint32_t)band_select_clock_mode * ( 1 << 23 ) + (uint32_t)ABP * ( 1 << 22 ) +
-                                  (uint32_t)charge_cancelletion * ( 1 << 21 ) + (uint32_t)CSR * ( 1 << 18 ) +
-                                  (uint32_t)CLK_DIV_MODE * ( 1 << 15 ) + (uint32_t)clock_divider * ( 1 << 3 ) + 3 );
-    reg_values[ 4 ] = (uint32_t)( (uint32_t)feedback_select * ( 1 << 23 ) + log2( (uint32_t)output_divider ) * ( 1 << 20 ) +
-                                  (uint32_t)band_select_clock_divider * ( 1 << 12 ) + (uint32_t)VCO_POWERDOWN * ( 1 << 11 ) +
-                                  (uint32_t)mtld * ( 1 << 10 ) + (uint32_t)AUX_OUTPUT_SELECT * ( 1 << 9 ) +
-                                  (uint32_t)AUX_OUTPUT_ENABLE * ( 1 << 8 ) + (uint32_t)AUX_OUTPUT_POWER * ( 1 << 6 ) +
-                                  (uint32_t)RF_ENABLE * ( 1 << 5 ) + (uint32_t)output_power * ( 1 << 3 ) + 4 );
-    reg_values[ 5 ] = (uint32_t)( (uint32_t)LD * ( 1 << 22 ) + (uint32_t)0x3 * ( 1 << 19 ) + 5 );
-
-    if ( CLK_DIV_MODE == 2 ) {
-        tSync = 1.0 / PFDFreq * MOD * clock_divider;
-    } else {
-        tSync = 0;
-    }
+    uint32_t reg[ 6 ];
+    adf435x_pack( &p, reg );
+    const uint32_t old_values[ 6 ] = { reg_values[ 0 ], reg_values[ 1 ], reg_values[ 2 ],
+                                       reg_values[ 3 ], reg_values[ 4 ], reg_values[ 5 ] };
+    for ( int r = 0; r < 6; ++r )
+        if ( mask & 1 << r )
+            reg_values[ r ] = reg[ r ];
+
+    tSync = adf435x_sync_time( cfg.ref_hz, &p ) * 1e6; // us, 0 if not in resync mode
+    uint8_t changed = 0;
+    for ( int r = 0; r < 6; ++r )
+        if ( reg_values[ r ] != old_values[ r ] )
+            changed |= 1 << r;
     if ( verbose )
         for ( int r = 0; r < 6; ++r )
-            printf( "R%d: 0x%08X\n", r, reg_values[ r ] );
+            if ( changed & 1 << r )
+                printf( "R%d: 0x%08X\n", r, reg_values[ r ] );
 
-    emit regUpdateResult();
+    emit regUpdateResult( changed );
 }
 
 
-void ADF4351::initFromRegisters() {
+bool ADF4351::initFromRegisters() {
     if ( verbose > 1 )
         printf( " ADF4351::initFromRegisters()\n" );
-    uint16_t uINT = ( reg_values[ 0 ] >> 15 ) & 0xFFFF;
-    uint16_t uFRAC = ( reg_values[ 0 ] >> 3 ) & 0x0FFF;
+    adf435x_params p;
+    adf435x_output o;
+    int err = adf435x_decode( REF_FREQ * 1000000, reg_values, &p, &o );
+    if ( err != ADF435X_OK && err != ADF435X_ERR_PARAM ) { // wrong control bits, no field is valid
+        if ( verbose )
+            printf( " %s\n", adf435x_strerror( err ) );
+        return false;
+    }
+
+    INT = p.INT;
+    FRAC = p.FRAC;
+    MOD = p.MOD;
+    PHASE = p.phase;
+    PR1 = p.prescaler_8_9;
+    PHASE_ADJUST = p.phase_adjust;
+    NOISE_MODE = p.low_noise_spur_mode;
+    muxout = p.muxout;
+    ref_doubler = p.ref_doubler;
+    ref_div2 = p.ref_div2;
+    r_counter = p.r_counter;
+    double_buff = p.double_buffer;
+    charge_pump_current = p.cp_current;
+    // keep auto if the bits are those of the automatic setting
+    LDF = p.ldf == ( FRAC ? 0 : 1 ) ? -1 : p.ldf;
+    LDP = p.ldp == ( FRAC ? 0 : 1 ) ? -1 : p.ldp;
+    PD_Polarity = p.pd_polarity;
+    POWERDOWN = p.powerdown;
+    cp_3stage = p.cp_three_state;
+    counter_reset = p.counter_reset;
+    band_select_clock_mode = p.band_select_clock_mode;
+    ABP = p.abp;
+    charge_cancelletion = p.charge_cancel;
+    CSR = p.csr;
+    CLK_DIV_MODE = p.clk_div_mode;
+    clock_divider = p.clock_divider;
+    feedback_select = p.feedback_fundamental;
+    band_select_clock_divider = p.band_select_clock_divider;
+    VCO_POWERDOWN = p.vco_powerdown;
+    mtld = p.mtld;
+    AUX_OUTPUT_SELECT = p.aux_output_select;
+    AUX_OUTPUT_ENABLE = p.aux_output_enable;
+    AUX_OUTPUT_POWER = p.aux_output_power;
+    RF_ENABLE = p.output_enable;
+    output_power = p.output_power;
+    LD = p.ld_pin_mode;
+
+    PFDFreq = o.pfd_hz / 1e6;
+    N = err ? 0 : o.n;
+    frequency = err ? 0 : o.rf_hz / 1e6;
+    band_select_clock_freq = o.band_select_clock_hz / 1e3;
+    tSync = adf435x_sync_time( REF_FREQ * 1000000, &p ) * 1e6;
     if ( verbose > 2 )
-        printf( "  0x%04X 0x%03X\n", uINT, uFRAC );
+        printf( "  INT: %d, FRAC: %d, MOD: %d, f: %f MHz\n", INT, int( FRAC ), int( MOD ), frequency );
+    return err == ADF435X_OK;
 }
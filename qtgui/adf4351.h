@@ -65,11 +65,14 @@ class ADF4351 : public QObject {
     double MOD;
     double FRAC;
     // void calculateRegFromFreq( uint32_t frequency );
-    void initFromRegisters();
+    // set all fields and the frequency from reg_values (e.g. edited or read back registers),
+    // false if the registers are invalid, the fields are set anyway
+    bool initFromRegisters();
 
   public slots:
-    void buildRegisters();
+    // rebuild the registers in mask, all intermediate values are updated
+    void buildRegisters( uint8_t mask = 0b00111111 );
 
   signals:
-    void regUpdateResult();
+    void regUpdateResult( uint8_t changed ); // registers with a new value
 };
@@ -13,12 +13,26 @@ TEMPLATE = app
 SOURCES += main.cpp\
     usbioboard.cpp \
     usbctrl.cpp \
-    adf4351.cpp
+    adf4351.cpp \
+    ../examples/adf4351-eval/regstream.cpp \
+    ../examples/adf4351-eval/trace.cpp
 
 HEADERS += \
     usbioboard.h \
     usbctrl.h \
-    adf4351.h
+    adf4351.h \
+    ../examples/adf4351-eval/regstream.h \
+    ../examples/adf4351-eval/trace.h
+
+INCLUDEPATH += ../examples/adf4351-eval
+
+# register calculation, "make lib" in the top directory builds it
+INCLUDEPATH += ../libadf435x
+LIBS += $$PWD/../libadf435x/libadf435x.a
+PRE_TARGETDEPS += $$PWD/../libadf435x/libadf435x.a
+
+# USB transfer tracing (option --trace), remove to build without it
+DEFINES += ADF_TRACE
 
 
 FORMS   += \
@@ -31,7 +45,7 @@ FORMS   += \
 #-------------------------------------------------
 macx: LIBS += -framework CoreFoundation -framework IOkit
 win32: LIBS += -lSetupAPI
-unix: !macx: LIBS += -lusb-1.0
+unix: !macx: LIBS += -lusb-1.0 -pthread
 
 #-------------------------------------------------
 # Make sure output directory for object file and
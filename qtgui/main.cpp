@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "trace.h"
 #include "usbioboard.h"
 #include <QApplication>
 #include <QCommandLineParser>
@@ -7,6 +8,7 @@
 
 uint8_t verbose = 0;
 double optionFrequency = 0;
+const char *optionRecord = nullptr;
 
 int main( int argc, char *argv[] ) {
 
@@ -15,8 +17,14 @@ int main( int argc, char *argv[] ) {
     QCommandLineParser p;
     QCommandLineOption frequencyOption( { "f", "frequency" }, "set initial frequency", "frequency" );
     QCommandLineOption verboseOption( { "v", "verbose" }, "Trace program start and processing steps", "verbosity" );
+    QCommandLineOption traceOption( { "t", "trace" }, "Write all USB transfers to file, show latency summary at exit",
+                                    "file" );
+    QCommandLineOption recordOption( { "r", "record" }, "Record all register writes to file for adf4351-replay", "file" );
     p.addOption( frequencyOption );
     p.addOption( verboseOption );
+    p.addOption( recordOption );
+    if ( Trace::enabled )
+        p.addOption( traceOption );
     p.addHelpOption();
     p.process( application );
     const double F_MIN = 33;   // 34.375
@@ -30,11 +38,22 @@ int main( int argc, char *argv[] ) {
     }
     if ( p.isSet( verboseOption ) )
         verbose = p.value( "verbose" ).toInt();
+    QByteArray recordFile = p.value( recordOption ).toLocal8Bit();
+    if ( p.isSet( recordOption ) )
+        optionRecord = recordFile.constData();
+    bool trace = Trace::enabled && p.isSet( traceOption );
+    if ( trace && !Trace::tracer().startDump( p.value( "trace" ).toLocal8Bit().constData() ) )
+        return -1;
 
     application.setStyle( QStyleFactory::create( "Fusion" ) );
 
     USBIOBoard mainWindow;
     mainWindow.show();
 
-    return application.exec();
+    int rc = application.exec();
+    if ( trace ) {
+        Trace::tracer().stopDump();
+        Trace::tracer().summary( stderr );
+    }
+    return rc;
 }
@@ -2,6 +2,9 @@
 
 #include "usbctrl.h"
 #include "QThread"
+#include "trace.h"
+
+#include <sys/time.h>
 
 USBCTRL::USBCTRL( QObject *parent ) : QObject( parent ) {
     if ( verbose > 1 )
@@ -18,6 +21,19 @@ USBCTRL::USBCTRL( QObject *parent ) : QObject( parent ) {
 
     memset( uiData.reg, 0, sizeof( uiData.reg ) );
 
+    if ( optionRecord )
+        recorder.open( optionRecord );
+
+    // the status transfer completes in the event thread, the GUI thread gets it as queued signal
+    connect( this, SIGNAL( statusArrived( int, int ) ), this, SLOT( handleStatus( int, int ) ), Qt::QueuedConnection );
+    connect( this, SIGNAL( statusStopped( bool ) ), this, SLOT( statusEnded( bool ) ), Qt::QueuedConnection );
+    eventThread = std::thread( [ this ]() {
+        while ( !eventStop ) {
+            struct timeval wait = { 0, 100000 }; // check eventStop
+            libusb_handle_events_timeout_completed( context, &wait, nullptr );
+        }
+    } );
+
     timer = new QTimer();
     connect( timer, SIGNAL( timeout() ), this, SLOT( pollUSB() ) );
     timer->start( 250 );
@@ -39,6 +55,8 @@ void USBCTRL::pollUSB() {
         printf( "    PollUSB\n" );
 
     if ( uiData.isConnected == false ) {
+        if ( statusTransfer ) // statusEnded() of the previous connection not yet run
+            return;
 
         device_handle = libusb_open_device_with_vid_pid( context, USB_VENDOR_ID, USB_PRODUCT_ID );
 
@@ -61,7 +79,12 @@ void USBCTRL::pollUSB() {
                 uiData.firmwareVersionMinor = ( bcdDevice & 0x00F0 ) >> 4;
                 uiData.firmwarePatchNumber = bcdDevice & 0x000F;
                 uiData.readFirmwareInfoPending = false;
+                uiData.relocks = 0;
+                uiData.deviceStateValid = readDeviceState();
+                if ( subscribeStatus() && verbose > 1 )
+                    printf( " MUXOUT from status messages\n" );
                 emit usbctrlUpdate( uiData.isConnected, &uiData );
+                uiData.deviceStateValid = false; // used once after the connect
             }
             timer->start( 20 ); // poll fast
         }
@@ -74,8 +97,14 @@ void USBCTRL::pollUSB() {
                 if ( uiData.regUpdatePending & ( 1 << r ) ) {
                     if ( verbose )
                         printf( "XFER 0x%08X -> R%d\n", uiData.reg[ r ], r );
-                    libusb_control_transfer( device_handle, 0x40, USB_REQ_SET_REG, 0x00, 0x00, (uint8_t *)( uiData.reg + r ), 4,
-                                             10 );
+                    ADF_TRACE_START( t );
+                    int rc = libusb_control_transfer( device_handle, 0x40, USB_REQ_SET_REG, 0x00, 0x00,
+                                                      (uint8_t *)( uiData.reg + r ), 4, 10 );
+                    ADF_TRACE_STOP( t, SET_REG, rc, uiData.reg[ r ], 0 );
+                    if ( rc != 4 && verbose )
+                        printf( "XFER R%d: %s\n", r, libusb_strerror( rc ) );
+                    else if ( rc == 4 && recorder.isOpen() )
+                        recorder.append( uiData.reg[ r ] );
                     QThread::msleep( 1 );
                 }
             }
@@ -85,10 +114,13 @@ void USBCTRL::pollUSB() {
             if ( verbose > 3 )
                 printf( "   readMUXOUT_pending\n" );
             uiData.readMuxoutPending = false;
-            if ( 1 == libusb_control_transfer( device_handle, 0xC0, USB_REQ_GET_MUX, 0x00, 0x00, &muxStat, 1, 10 ) )
+            ADF_TRACE_START( t );
+            int rc = libusb_control_transfer( device_handle, 0xC0, USB_REQ_GET_MUX, 0x00, 0x00, &muxStat, 1, 10 );
+            ADF_TRACE_STOP( t, GET_MUX, rc, muxStat, 0 );
+            if ( 1 == rc )
                 uiData.muxoutStat = muxStat;
             else {
-                uiData.isConnected = false;
+                releaseDevice();
                 if ( verbose > 1 )
                     printf( " Device disconnected\n" );
             }
@@ -102,29 +134,137 @@ void USBCTRL::changeReg( const uint32_t *reg, bool autoTx, uint8_t mask ) {
     if ( verbose > 2 )
         printf( "  USBCTRL::changeReg( %d, 0x%02X )\n", autoTx, mask );
     memcpy( uiData.reg, reg, sizeof( uiData.reg ) );
-    if ( autoTx )
+    if ( autoTx ) {
         uiData.autoTxPending = true;
-    else
-        uiData.regUpdatePending = mask;
+        uiData.autoTxMask |= mask;
+    } else
+        uiData.regUpdatePending |= mask;
+}
+
+
+// registers, init type and lock status with one transfer, false for FW without USB_REQ_GET_STATE
+bool USBCTRL::readDeviceState() {
+    uint8_t state[ 40 ];
+    ADF_TRACE_START( t );
+    int rc = libusb_control_transfer( device_handle, 0xC0, USB_REQ_GET_STATE, 0x00, 0x00, state, sizeof( state ), 10 );
+    ADF_TRACE_STOP( t, GET_STATE, rc, rc == sizeof( state ) ? state[ 26 ] : 0, 0 );
+    if ( rc != sizeof( state ) )
+        return false;
+    for ( int r = 0; r < 6; ++r )
+        uiData.deviceReg[ r ] = state[ 4 * r ] | state[ 4 * r + 1 ] << 8 | state[ 4 * r + 2 ] << 16 |
+                                uint32_t( state[ 4 * r + 3 ] ) << 24;
+    uiData.deviceInitType = state[ 24 ];
+    uiData.muxoutStat = state[ 25 ];
+    uiData.deviceRegWritten = state[ 26 ];
+    if ( verbose > 1 )
+        printf( " Device state: registers 0x%02X written, init type %u\n", uiData.deviceRegWritten,
+                uiData.deviceInitType );
+    return true;
+}
+
+
+// FW 0.4.4 and later push MUXOUT changes, the interface with the endpoint must be claimed
+bool USBCTRL::subscribeStatus() {
+    if ( libusb_claim_interface( device_handle, 0 ) )
+        return false;
+    interfaceClaimed = true;
+    statusTransfer = libusb_alloc_transfer( 0 );
+    if ( statusTransfer ) {
+        libusb_fill_interrupt_transfer( statusTransfer, device_handle, EP_STATUS, statusMessage, sizeof( statusMessage ),
+                                        statusReceived, this, 0 );
+        statusActive = true;
+        if ( !libusb_submit_transfer( statusTransfer ) )
+            return true;
+        statusActive = false;
+        libusb_free_transfer( statusTransfer );
+        statusTransfer = nullptr;
+    }
+    libusb_release_interface( device_handle, 0 ); // older FW without the endpoint
+    interfaceClaimed = false;
+    return false;
+}
+
+
+// event thread: hand the message over to the GUI thread and wait for the next one
+void LIBUSB_CALL USBCTRL::statusReceived( libusb_transfer *transfer ) {
+    USBCTRL *self = static_cast< USBCTRL * >( transfer->user_data );
+    if ( transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length == sizeof( self->statusMessage ) ) {
+        emit self->statusArrived( self->statusMessage[ 0 ], self->statusMessage[ 1 ] );
+        if ( !libusb_submit_transfer( transfer ) )
+            return;
+    }
+    self->statusActive = false;
+    emit self->statusStopped( transfer->status == LIBUSB_TRANSFER_NO_DEVICE );
+}
+
+
+void USBCTRL::handleStatus( int flags, int mux ) {
+    if ( verbose > 3 )
+        printf( "   status 0x%02X, MUXOUT %u\n", flags, mux );
+    if ( !uiData.isConnected )
+        return;
+    if ( flags & STATUS_RELOCK ) {
+        ++uiData.relocks;
+        if ( verbose )
+            printf( "R0 rewritten by the lock supervisor (%u)\n", uiData.relocks );
+    }
+    uiData.muxoutStat = mux;
+    emit usbctrlUpdate( uiData.isConnected, &uiData );
+}
+
+
+// cancelled, failed or disconnected: poll USB_REQ_GET_MUX again
+void USBCTRL::statusEnded( bool disconnected ) {
+    if ( !statusTransfer )
+        return;
+    libusb_free_transfer( statusTransfer );
+    statusTransfer = nullptr;
+    if ( disconnected && uiData.isConnected ) {
+        releaseDevice();
+        if ( verbose > 1 )
+            printf( " Device disconnected\n" );
+        emit usbctrlUpdate( uiData.isConnected, &uiData );
+    }
 }
 
 
 void USBCTRL::closeDevice() {
     if ( verbose > 2 )
         printf( "  USBCTRL::closeDevice()\n" );
-    libusb_close( device_handle );
+    releaseDevice(); // cancels the status transfer
+    eventStop = true;
+    if ( eventThread.joinable() )
+        eventThread.join();
+    if ( statusTransfer && !statusActive )
+        libusb_free_transfer( statusTransfer );
+    statusTransfer = nullptr;
     libusb_exit( context );
-    uiData.isConnected = false;
     emit usbctrlUpdate( uiData.isConnected, &uiData );
+}
+
+
+void USBCTRL::releaseDevice() {
+    if ( statusActive && !libusb_cancel_transfer( statusTransfer ) )
+        for ( int iii = 0; statusActive && iii < 100; ++iii ) // until the event thread ran the callback
+            QThread::msleep( 1 );
+    if ( device_handle ) {
+        if ( interfaceClaimed )
+            libusb_release_interface( device_handle, 0 );
+        libusb_close( device_handle );
+        device_handle = nullptr;
+    }
+    interfaceClaimed = false;
+    uiData.isConnected = false;
     timer->start( 250 );
 }
 
 
 void USBCTRL::slowReadTimeout() {
-    uiData.readMuxoutPending = true;
-    if ( uiData.autoTxPending ) {
+    uiData.readMuxoutPending = !statusTransfer; // poll only w/o status messages
+    if ( uiData.autoTxPending ) { // only the registers changed since the last transfer
         uiData.autoTxPending = false;
-        uiData.regUpdatePending = 0b00111111;
+        uiData.regUpdatePending |= uiData.autoTxMask;
+        uiData.autoTxMask = 0;
     }
     if ( verbose > 3 )
         printf( "   USBCTRL::slowReadTimeou1(), regUpdatePendig = 0x%02X\n", uiData.regUpdatePending );
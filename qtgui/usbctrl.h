@@ -6,26 +6,39 @@
 #include <QTimer>
 #include <libusb-1.0/libusb.h>
 
+#include "regstream.h"
+
+#include <atomic>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 #include <wchar.h>
 
 #define MAX_STR 65
 
 extern uint8_t verbose;
 extern double optionFrequency;
+extern const char *optionRecord;
 
 typedef enum {
     USB_REQ_SET_REG = 0xDD,
     USB_REQ_EE_REGS = 0xDE,
     USB_REQ_GET_MUX = 0xDF,
+    USB_REQ_GET_STATE = 0xE2, // FX2 FW 0.4.3
 } CUSTOM_VENDOR_COMMANDS;
 
+// FX2 FW 0.4.4: interrupt endpoint, 8 byte message when MUXOUT changes or an OUT request is done
+#define EP_STATUS 0x81
+#define STATUS_MUX 0x01 // message flags
+#define STATUS_DONE 0x02
+#define STATUS_RELOCK 0x04 // FW 0.4.7: the lock supervisor rewrote R0
+
 class UI_Data {
   public:
     bool isConnected;
     uint8_t regUpdatePending = 0;
     bool autoTxPending = false;
+    uint8_t autoTxMask = 0; // registers changed while autoTxPending
     bool readFirmwareInfoPending = true;
     uint8_t readMuxoutPending = false;
     uint8_t firmwareVersionMajor;
@@ -34,6 +47,12 @@ class UI_Data {
     uint32_t reg[ 6 ];
     bool muxoutStat = false;
     uint8_t verbose = 0;
+    // device state read at connect, registers as last written to the chip
+    bool deviceStateValid = false;
+    uint32_t deviceReg[ 6 ];
+    uint8_t deviceRegWritten = 0; // bit n: Rn written since power-on
+    uint8_t deviceInitType = 0;
+    uint32_t relocks = 0; // R0 rewrites of the lock supervisor since the connect
 };
 
 class USBCTRL : public QObject {
@@ -44,12 +63,19 @@ class USBCTRL : public QObject {
 
   signals:
     void usbctrlUpdate( bool isConnected, UI_Data *uiData );
+    // from the libusb event thread, queued to handleStatus() / statusEnded()
+    void statusArrived( int flags, int mux );
+    void statusStopped( bool disconnected );
 
   public slots:
     void pollUSB();
     void changeReg( const uint32_t *reg, bool auto_tx, uint8_t mask = 0b00111111 );
     void slowReadTimeout();
 
+  private slots:
+    void handleStatus( int flags, int mux );
+    void statusEnded( bool disconnected );
+
   private:
     const uint16_t USB_VENDOR_ID = 0x0456;
     const uint16_t USB_PRODUCT_ID = 0xb40d;
@@ -57,7 +83,7 @@ class USBCTRL : public QObject {
     UI_Data uiData;
 
     libusb_context *context = NULL;
-    libusb_device_handle *device_handle;
+    libusb_device_handle *device_handle = nullptr;
     libusb_device *device;
     libusb_device_descriptor device_descriptor;
     uint16_t bcdDevice = 0;
@@ -66,5 +92,18 @@ class USBCTRL : public QObject {
     QTimer *timer;
     QTimer *slowRead;
     unsigned char buf[ MAX_STR ];
+    RegStreamWriter recorder; // register words sent to the device
     void closeDevice();
+    void releaseDevice(); // after a disconnect, pollUSB() opens the device again
+    bool readDeviceState();
+    // MUXOUT from the status messages instead of polling USB_REQ_GET_MUX,
+    // the callback runs in eventThread, the transfer is freed by statusEnded()
+    libusb_transfer *statusTransfer = nullptr; // nullptr: poll
+    std::atomic< bool > statusActive{ false }; // submitted, the callback will run
+    bool interfaceClaimed = false;
+    uint8_t statusMessage[ 8 ];
+    bool subscribeStatus();
+    static void LIBUSB_CALL statusReceived( libusb_transfer *transfer );
+    std::thread eventThread;
+    std::atomic< bool > eventStop{ false };
 };
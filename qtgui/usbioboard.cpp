@@ -4,6 +4,16 @@
 #include "ui_usbio.h"
 
 
+// register masks
+static const uint8_t R0 = 1 << 0;
+static const uint8_t R1 = 1 << 1;
+static const uint8_t R2 = 1 << 2;
+static const uint8_t R3 = 1 << 3;
+static const uint8_t R4 = 1 << 4;
+static const uint8_t R5 = 1 << 5;
+static const uint8_t R_ALL = 0b00111111;
+
+
 USBIOBoard::USBIOBoard( QWidget *parent ) : QMainWindow( parent ), ui( new Ui::USB_ADF4351_form ) {
 
     ui->setupUi( this );
@@ -194,17 +204,17 @@ USBIOBoard::USBIOBoard( QWidget *parent ) : QMainWindow( parent ), ui( new Ui::U
                                            "timeout counter for fast lock." );
 
 
-    connect( this, SIGNAL( signalRecalculate() ), adf4351, SLOT( buildRegisters() ) );
+    connect( this, SIGNAL( signalRecalculate( uint8_t ) ), adf4351, SLOT( buildRegisters( uint8_t ) ) );
 
     connect( this, SIGNAL( signalUpdateReg( const uint32_t *, bool, uint8_t ) ), usbCtrl,
              SLOT( changeReg( const uint32_t *, bool, uint8_t ) ) );
-    connect( this, SIGNAL( signalAutoTx() ), this, SLOT( updateReg() ) );
+    connect( this, SIGNAL( signalAutoTx( uint8_t ) ), this, SLOT( updateReg( uint8_t ) ) );
     connect( ui->USBTX, &QPushButton::clicked, this, [ this ]() { updateReg(); } );
     for ( int r = 0; r < 6; ++r )
         connect( txReg[ r ], &QPushButton::clicked, this, [ this, r ]() { updateReg( 1 << r ); } );
 
     connect( usbCtrl, SIGNAL( usbctrlUpdate( bool, UI_Data * ) ), this, SLOT( updateGUI( bool, UI_Data * ) ) );
-    connect( adf4351, SIGNAL( regUpdateResult() ), this, SLOT( displayReg() ) );
+    connect( adf4351, SIGNAL( regUpdateResult( uint8_t ) ), this, SLOT( displayReg( uint8_t ) ) );
 
     connect( ui->checkBox_autotx, &QCheckBox::clicked, this, [ this ]() {
         autoTX = ui->checkBox_autotx->isChecked();
@@ -212,46 +222,73 @@ USBIOBoard::USBIOBoard( QWidget *parent ) : QMainWindow( parent ), ui( new Ui::U
         for ( int r = 0; r < 6; ++r )
             txReg[ r ]->setEnabled( !autoTX );
         if ( autoTX && regChanged )
-            updateReg();
+            updateReg( regChanged );
     } );
 
-    connect( ui->doubleSpinBox_frequency, SIGNAL( valueChanged( double ) ), this, SLOT( recalculate() ) );
-
-    connect( ui->groupBox_main, SIGNAL( clicked( bool ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_ABP, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_NOISE_MODE, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_muxout, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_mtld, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_band_select_clk_mode, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_AUX_OUTPUT_ENABLE, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_AUX_OUTPUT_SELECT, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_AUX_OUTPUT_POWER, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_phase_adjust, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_double_buff, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_charge_cancellation, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_charge_pump_current, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_counter_rst, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_cp_3_state, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_CLK_div_mode, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_CSR, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_feedback_select, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_LDF, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_LDP, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_LDPIN, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_POWERDOWN, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_prescaler, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_PD_polarity, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_VCO_POWERDOWN, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_rf_out, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->comboBox_output_power, SIGNAL( currentIndexChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->spinBox_clock_divider, SIGNAL( valueChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->spinBox_r_counter, SIGNAL( valueChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->spinBox_phase_val, SIGNAL( valueChanged( int ) ), this, SLOT( recalculate() ) );
-    connect( ui->checkBox_refdiv2, SIGNAL( clicked( bool ) ), this, SLOT( recalculate() ) );
-    connect( ui->checkBox_refx2, SIGNAL( clicked( bool ) ), this, SLOT( recalculate() ) );
-    connect( ui->lineEdit_ref, SIGNAL( textChanged( QString ) ), this, SLOT( recalculate() ) );
-    for ( int r = 0; r < 6; ++r )
+    // every input schedules a recalculation of the registers that contain it,
+    // all changes of one event loop turn are coalesced into one recalculation
+    const uint8_t R_FREQ = R0 | R1 | R2 | R4; // INT/FRAC/MOD, auto LDF/LDP, output and band select divider
+    connect( ui->doubleSpinBox_frequency, QOverload< double >::of( &QDoubleSpinBox::valueChanged ), this,
+             [ this, R_FREQ ]() { scheduleRecalculate( R_FREQ ); } );
+    connect( ui->lineEdit_ref, &QLineEdit::textChanged, this, [ this, R_FREQ ]() { scheduleRecalculate( R_FREQ ); } );
+    connect( ui->groupBox_main, &QGroupBox::clicked, this, [ this ]() { scheduleRecalculate( R_ALL ); } );
+    const struct {
+        QCheckBox *box;
+        uint8_t regs;
+    } checkInputs[] = { { ui->checkBox_refdiv2, R_FREQ }, { ui->checkBox_refx2, R_FREQ } };
+    for ( const auto &input : checkInputs ) {
+        const uint8_t regs = input.regs;
+        connect( input.box, &QCheckBox::clicked, this, [ this, regs ]() { scheduleRecalculate( regs ); } );
+    }
+    const struct {
+        QSpinBox *box;
+        uint8_t regs;
+    } spinInputs[] = { { ui->spinBox_r_counter, R_FREQ }, { ui->spinBox_phase_val, R1 }, { ui->spinBox_clock_divider, R3 } };
+    for ( const auto &input : spinInputs ) {
+        const uint8_t regs = input.regs;
+        connect( input.box, QOverload< int >::of( &QSpinBox::valueChanged ), this,
+                 [ this, regs ]() { scheduleRecalculate( regs ); } );
+    }
+    const struct {
+        QComboBox *box;
+        uint8_t regs;
+    } comboInputs[] = {
+        { ui->comboBox_feedback_select, R_FREQ },
+        { ui->comboBox_prescaler, R1 },
+        { ui->comboBox_phase_adjust, R1 },
+        { ui->comboBox_NOISE_MODE, R2 },
+        { ui->comboBox_muxout, R2 },
+        { ui->comboBox_double_buff, R2 },
+        { ui->comboBox_charge_pump_current, R2 },
+        { ui->comboBox_LDF, R2 },
+        { ui->comboBox_LDP, R2 },
+        { ui->comboBox_PD_polarity, R2 },
+        { ui->comboBox_POWERDOWN, R2 },
+        { ui->comboBox_cp_3_state, R2 },
+        { ui->comboBox_counter_rst, R2 },
+        { ui->comboBox_band_select_clk_mode, R3 | R4 }, // mode bit and band select clock divider
+        { ui->comboBox_ABP, R3 },
+        { ui->comboBox_charge_cancellation, R3 },
+        { ui->comboBox_CSR, R3 },
+        { ui->comboBox_CLK_div_mode, R3 },
+        { ui->comboBox_VCO_POWERDOWN, R4 },
+        { ui->comboBox_mtld, R4 },
+        { ui->comboBox_AUX_OUTPUT_SELECT, R4 },
+        { ui->comboBox_AUX_OUTPUT_ENABLE, R4 },
+        { ui->comboBox_AUX_OUTPUT_POWER, R4 },
+        { ui->comboBox_rf_out, R4 },
+        { ui->comboBox_output_power, R4 },
+        { ui->comboBox_LDPIN, R5 },
+    };
+    for ( const auto &input : comboInputs ) {
+        const uint8_t regs = input.regs;
+        connect( input.box, QOverload< int >::of( &QComboBox::currentIndexChanged ), this,
+                 [ this, regs ]() { scheduleRecalculate( regs ); } );
+    }
+    for ( int r = 0; r < 6; ++r ) {
         connect( regLineEdit[ r ], &QLineEdit::textChanged, this, [ this, r ]() { showRegChanged( 1 << r ); } );
+        connect( regLineEdit[ r ], &QLineEdit::returnPressed, this, &USBIOBoard::loadRegisters );
+    }
     connect( ui->adaptiveScroll, &QCheckBox::clicked, this, [ this ]() {
         if ( ui->adaptiveScroll->isChecked() ) { // reset frequency to multiples of step width
             ui->doubleSpinBox_frequency->setStepType( QAbstractSpinBox::AdaptiveDecimalStepType );
@@ -350,9 +387,73 @@ void USBIOBoard::getDataFromUI() {
 }
 
 
-void USBIOBoard::recalculate() {
+void USBIOBoard::setDataToUI() {
+    if ( adf4351->frequency > 0 )
+        ui->doubleSpinBox_frequency->setValue( adf4351->frequency );
+    ui->spinBox_r_counter->setValue( adf4351->r_counter );
+    ui->spinBox_phase_val->setValue( adf4351->PHASE );
+    ui->comboBox_phase_adjust->setCurrentIndex( adf4351->PHASE_ADJUST );
+    ui->checkBox_refdiv2->setChecked( adf4351->ref_div2 );
+    ui->checkBox_refx2->setChecked( adf4351->ref_doubler );
+    ui->comboBox_NOISE_MODE->setCurrentIndex( adf4351->NOISE_MODE );
+    ui->comboBox_muxout->setCurrentIndex( adf4351->muxout );
+    ui->comboBox_double_buff->setCurrentIndex( adf4351->double_buff );
+    ui->comboBox_charge_pump_current->setCurrentIndex( adf4351->charge_pump_current );
+    ui->comboBox_LDF->setCurrentIndex( adf4351->LDF + 1 ); // auto -> index 0
+    ui->comboBox_LDP->setCurrentIndex( adf4351->LDP + 1 ); // auto -> index 0
+    ui->comboBox_PD_polarity->setCurrentIndex( adf4351->PD_Polarity );
+    ui->comboBox_cp_3_state->setCurrentIndex( adf4351->cp_3stage );
+    ui->comboBox_counter_rst->setCurrentIndex( adf4351->counter_reset );
+    ui->comboBox_band_select_clk_mode->setCurrentIndex( adf4351->band_select_clock_mode );
+    ui->comboBox_charge_cancellation->setCurrentIndex( adf4351->charge_cancelletion );
+    ui->comboBox_ABP->setCurrentIndex( adf4351->ABP );
+    ui->comboBox_CSR->setCurrentIndex( adf4351->CSR );
+    ui->spinBox_clock_divider->setValue( adf4351->clock_divider );
+    ui->comboBox_CLK_div_mode->setCurrentIndex( adf4351->CLK_DIV_MODE );
+    ui->comboBox_LDPIN->setCurrentIndex( adf4351->LD );
+    ui->comboBox_POWERDOWN->setCurrentIndex( adf4351->POWERDOWN );
+    ui->comboBox_VCO_POWERDOWN->setCurrentIndex( adf4351->VCO_POWERDOWN );
+    ui->comboBox_mtld->setCurrentIndex( adf4351->mtld );
+    ui->comboBox_AUX_OUTPUT_SELECT->setCurrentIndex( adf4351->AUX_OUTPUT_SELECT );
+    ui->comboBox_AUX_OUTPUT_ENABLE->setCurrentIndex( adf4351->AUX_OUTPUT_ENABLE );
+    ui->comboBox_AUX_OUTPUT_POWER->setCurrentIndex( 3 - adf4351->AUX_OUTPUT_POWER ); // index 0: max power
+    ui->comboBox_output_power->setCurrentIndex( 3 - adf4351->output_power );         // index 0: max power
+    ui->comboBox_rf_out->setCurrentIndex( adf4351->RF_ENABLE );
+    ui->comboBox_prescaler->setCurrentIndex( adf4351->PR1 );
+    ui->comboBox_feedback_select->setCurrentIndex( adf4351->feedback_select );
+}
+
+
+// registers entered by hand are decoded into the inputs, the registers themselves are kept
+// even if the frequency would give other INT/FRAC/MOD values
+void USBIOBoard::loadRegisters() {
+    for ( int r = 0; r < 6; ++r )
+        adf4351->reg_values[ r ] = regLineEdit[ r ]->text().toUInt( nullptr, 16 );
+    adf4351->REF_FREQ = ui->lineEdit_ref->text().toInt();
+    if ( !adf4351->initFromRegisters() && verbose )
+        printf( " invalid registers\n" );
+    setDataToUI();
+    recalcMask = 0; // the input changes above are no edits, the scheduled recalculation does nothing
+    displayReg( regChanged );
+}
+
+
+void USBIOBoard::scheduleRecalculate( uint8_t mask ) {
+    if ( !recalcMask ) // first change in this event loop turn, the widget values are read when it runs
+        QTimer::singleShot( 0, this, [ this ]() { recalculate( 0 ); } );
+    recalcMask |= mask;
+}
+
+
+void USBIOBoard::recalculate( uint8_t mask ) {
+    mask |= recalcMask;
+    recalcMask = 0;
+    if ( !mask )
+        return;
+    if ( verbose > 2 )
+        printf( "  USBIOBoard::recalculate( 0x%02X )\n", mask );
     getDataFromUI();
-    emit signalRecalculate();
+    emit signalRecalculate( mask );
 }
 
 
@@ -384,17 +485,29 @@ void USBIOBoard::updateReg( uint8_t regs_changed ) {
 }
 
 
-void USBIOBoard::displayReg() {
-    for ( int r = 0; r < 6; ++r )
-        regLineEdit[ r ]->setText( QString( "%1" ).arg( adf4351->reg_values[ r ], 8, 16, QChar( '0' ) ).toUpper() );
+void USBIOBoard::displayReg( uint8_t changed ) {
+    const uint32_t oldR4 = regLineEdit[ 4 ]->text().toUInt( nullptr, 16 ); // as shown (and sent with auto TX)
+    // rewrite only the changed fields and those edited by hand
+    for ( int r = 0; r < 6; ++r ) {
+        const QString text = QString( "%1" ).arg( adf4351->reg_values[ r ], 8, 16, QChar( '0' ) ).toUpper();
+        if ( regLineEdit[ r ]->text() != text ) {
+            regLineEdit[ r ]->setText( text );
+            changed |= 1 << r;
+        }
+    }
     if ( adf4351->tSync ) {
         ui->label_Tsync->setText( QString( "t SYNC = %1 µs" ).arg( adf4351->tSync ) );
         ui->label_Tsync->setVisible( true );
     } else
         ui->label_Tsync->setVisible( false );
 
-    if ( autoTX ) {
-        emit signalAutoTx();
+    if ( autoTX && changed ) {
+        // R1 (phase, MOD) and R2 (R counter, doubler, RDIV2, CP current) are double buffered and take
+        // effect with the next R0 write, so is the RF divider select (R4 DB22..20) if R2 DB13 is set
+        const bool rfDivChanged = ( changed & 0b010000 ) && ( ( oldR4 ^ adf4351->reg_values[ 4 ] ) & 7 << 20 );
+        if ( ( changed & 0b000110 ) || ( rfDivChanged && ( adf4351->reg_values[ 2 ] & 1 << 13 ) ) )
+            changed |= 1;
+        emit signalAutoTx( changed );
     }
 }
 
@@ -414,10 +527,29 @@ void USBIOBoard::updateGUI( bool isConnected, UI_Data *ui_data ) {
         }
         setWindowTitle( windowTitle );
 
-        if ( !wasConnected && autoInit )
+        if ( !wasConnected && ui_data->deviceStateValid && ui_data->deviceRegWritten == 0x3F ) {
+            // the chip runs known registers: send only the differing ones (and R0 for the double
+            // buffered fields) or show what the chip runs instead of overwriting it
+            if ( autoInit ) {
+                uint8_t differ = 0;
+                for ( int r = 0; r < 6; ++r )
+                    if ( ui_data->deviceReg[ r ] != adf4351->reg_values[ r ] )
+                        differ |= 1 << r;
+                if ( differ )
+                    updateReg( differ | 1 );
+            } else {
+                for ( int r = 0; r < 6; ++r )
+                    regLineEdit[ r ]->setText(
+                        QString( "%1" ).arg( ui_data->deviceReg[ r ], 8, 16, QChar( '0' ) ).toUpper() );
+                loadRegisters();
+            }
+        } else if ( !wasConnected && autoInit )
             updateReg();
         ui->labelMuxOut->setStyleSheet( ui_data->muxoutStat ? "QLabel { background-color : lightgreen; }"
                                                             : "QLabel { background-color : lightgrey; }" );
+        ui->labelMuxOut->setToolTip( ui_data->relocks
+                                         ? QString( "R0 rewritten %1 times by the lock supervisor" ).arg( ui_data->relocks )
+                                         : QString() );
     } else {
         ui_data->readMuxoutPending = true;
         ui_data->readFirmwareInfoPending = true;
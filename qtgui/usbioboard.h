@@ -34,19 +34,23 @@ class USBIOBoard : public QMainWindow {
     bool autoTX = false;
     bool autoInit = false;
     void getDataFromUI();
+    void setDataToUI(); // inverse of getDataFromUI()
     void showEvent( QShowEvent *event );
     QString windowTitle;
     void showRegChanged( uint8_t mask, bool set = true );
     uint8_t regChanged = 0;
+    void scheduleRecalculate( uint8_t mask ); // coalesce input changes, mask: registers to rebuild
+    uint8_t recalcMask = 0;                   // registers of the pending recalculation
 
   signals:
     void signalUpdateReg( const uint32_t *reg, bool enableAutoTx, uint8_t mask = 0b00111111 );
-    void signalAutoTx();
-    void signalRecalculate();
+    void signalAutoTx( uint8_t mask );
+    void signalRecalculate( uint8_t mask );
 
   public slots:
     void updateGUI( bool isConnected, UI_Data *uiData );
-    void displayReg();
+    void displayReg( uint8_t changed );
     void updateReg( uint8_t mask = 0b00111111 );
-    void recalculate();
+    void recalculate( uint8_t mask = 0b00111111 ); // now, together with the pending changes
+    void loadRegisters();                          // set all inputs from the register line edits
 };
@@ -1,3 +1,9 @@
-from setuptools import setup
+from setuptools import Extension, setup
 
-setup()
+setup(
+    ext_modules=[
+        # python binding of libadf435x, core.py does the register calculation only here
+        Extension('adf435x._core', ['adf435x/_core.cpp', 'libadf435x/adf435x.c'], include_dirs=['libadf435x'],
+                  depends=['libadf435x/adf435x.h'], extra_compile_args=['-O2']),
+    ]
+)